@@ -0,0 +1,747 @@
+// G29LedBench: checks and measurements of the plugin's hot paths, run
+// outside the game.
+//
+// Usage: G29LedBench alloc [--iterations N] [--warmup N]
+//        G29LedBench seqlock [--readers N] [--seconds S] [--second-writer]
+//        G29LedBench hidraw (Linux only)
+//
+// alloc drives the steady state of an LED update the way the poller does:
+// the fuel gauge's quantizer and dithering, the layer compositor, the timer
+// wheel and the wheel's LED encoder, then hands the LED state over through
+// the HID writer's queue and mailbox to a writer thread, which builds the
+// output report and feeds it to the mock wheel; the wheel is also reopened
+// every now and then, resizing the report. After `warmup` updates it counts
+// every heap allocation made on either thread during `iterations` more, and
+// fails if there was any: none of these may allocate once the plugin is
+// running.
+//
+// seqlock hammers a seqlock_t around a structure shaped like truck_info_t
+// the way the plugin uses it: the game thread is its only writer, changing it
+// nonstop like in a burst of telemetry and applying at every round the fuel
+// capacity a search thread publishes nonstop through an atomic and a
+// generation, while `readers` threads read() it nonstop. It reports the
+// writer's begin_write() and end_write() latencies (mean, p99 and max, in
+// ns) and the readers' retries, and fails if a reader ever got a torn copy
+// or a writer ever had to wait for another one. --second-writer makes the
+// search thread write into the seqlock itself, as it once did, which the
+// check has to catch.
+//
+// hidraw checks the Linux backend without a wheel: the output report size
+// it parses from report descriptors, the G29's and ones using report IDs or
+// Push and Pop, then writes and reads through open_node() on a FIFO and a
+// plain file, and finds a fake G29 through open() in a fake sysfs tree.
+//
+// Allocations are counted through replaced global operator new and delete,
+// and for the C heap through malloc() and friends replaced on glibc or the
+// debug CRT's allocation hook on Windows. Release builds on Windows only
+// count operator new.
+//
+// Builds on Windows and Linux alike.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#if defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
+#include "hidmock.h"
+#include "hidqueue.h"
+#include "hidreport.h"
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hidtransport.h"
+#endif
+#include "ledcompositor.h"
+#include "leddither.h"
+#include "quantizer.h"
+#include "seqlock.h"
+#include "timerwheel.h"
+#include "wheels.h"
+
+static std::atomic<bool> countingAllocations(false);
+static std::atomic<unsigned long long> allocations(0);
+
+static void countAllocation() {
+    if (countingAllocations.load(std::memory_order_relaxed)) allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+#if defined(__GLIBC__)
+// Every malloc() of the process ends up here, the C++ runtime's included.
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* block, size_t size);
+extern "C" void __libc_free(void* block);
+
+extern "C" void* malloc(size_t size) {
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* block, size_t size) {
+    countAllocation();
+    return __libc_realloc(block, size);
+}
+
+extern "C" void free(void* block) {
+    __libc_free(block);
+}
+
+#define HEAP_ALLOC __libc_malloc
+#define HEAP_FREE __libc_free
+#define NEW_COUNTS true
+#elif defined(_MSC_VER) && defined(_DEBUG)
+// Sees operator new's blocks too, since it allocates with malloc().
+static int allocHook(int type, void*, size_t, int block_type, long, const unsigned char*, int) {
+    if (type != _HOOK_FREE && block_type != _CRT_BLOCK) countAllocation();
+    return 1;
+}
+
+#define HEAP_ALLOC malloc
+#define HEAP_FREE free
+#define NEW_COUNTS false
+#else
+#define HEAP_ALLOC malloc
+#define HEAP_FREE free
+#define NEW_COUNTS true
+#endif
+
+static void* countedNew(size_t size) {
+    if (NEW_COUNTS) countAllocation();
+    void* block = HEAP_ALLOC(size ? size : 1);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new(size_t size) { return countedNew(size); }
+void* operator new[](size_t size) { return countedNew(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    if (NEW_COUNTS) countAllocation();
+    return HEAP_ALLOC(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    if (NEW_COUNTS) countAllocation();
+    return HEAP_ALLOC(size ? size : 1);
+}
+void operator delete(void* block) noexcept { HEAP_FREE(block); }
+void operator delete[](void* block) noexcept { HEAP_FREE(block); }
+void operator delete(void* block, size_t) noexcept { HEAP_FREE(block); }
+void operator delete[](void* block, size_t) noexcept { HEAP_FREE(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { HEAP_FREE(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { HEAP_FREE(block); }
+
+// Same gauge as g29led.cpp.
+static const float fillThresholds[] = { 0.15f, 0.25f, 0.50f, 0.75f };
+static const unsigned char fillStates[] = {
+    G29_LED_00000,
+    G29_LED_00001,
+    G29_LED_00011,
+    G29_LED_00111,
+    G29_LED_01111,
+    G29_LED_11111
+};
+#define FILL_LEVELS (sizeof(fillThresholds) / sizeof(float))
+#define DITHER_LEVELS 4
+#define REPORT_LEN 64 // the G29's OutputReportByteLength, rounded up
+
+// The HID writer thread's side of the path: hidwriter.cpp's loop, waking
+// up on a condition variable instead of an event.
+struct led_writer_t {
+    hid_command_queue_t queue;
+    hid_report_t report;
+    hid_mock_device_t wheel; // only the writer thread's until it's stopped
+    std::atomic<unsigned long long> written;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    bool signalled;
+    bool running;
+    std::thread* thread;
+
+    led_writer_t() : written(0), signalled(false), running(true), thread(nullptr) {}
+
+    void start() { thread = new std::thread(&led_writer_t::writeLoop, this); }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running = false;
+            signalled = true;
+        }
+        wakeup.notify_one();
+        thread->join();
+        delete thread;
+        thread = nullptr;
+    }
+
+    void signal() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            signalled = true;
+        }
+        wakeup.notify_one();
+    }
+
+    void writeLoop() {
+        hid_command_t command;
+        long long origin;
+        bool keep_running = true;
+
+        while (keep_running) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wakeup.wait(guard, [this] { return signalled; });
+                signalled = false;
+                keep_running = running;
+            }
+            while (queue.next(&command, &origin)) {
+                const unsigned char* data = report.build(command);
+                wheel.receive(data, report.size(), origin + 1000, origin);
+                written++;
+            }
+        }
+    }
+};
+
+struct led_path_t {
+    level_quantizer_t fill_level;
+    led_dither_t dither;
+    led_layer_t gauge_layer;
+    led_layer_t warning_layer;
+    led_layer_t* layers[2];
+    led_compositor_t compositor;
+    timer_wheel_t timers;
+    timer_entry_t gauge_timer;
+    led_writer_t writer;
+    const wheel_model_t* model;
+    unsigned long long now; // ms
+    unsigned long long timer_fires;
+    unsigned long long queued;
+    unsigned long long coalesced;
+    unsigned long long dropped;
+    unsigned char sent;
+
+    led_path_t() :
+        fill_level(fillThresholds, FILL_LEVELS, 0.01f),
+        dither(DITHER_LEVELS),
+        gauge_layer("gauge", 0, LED_BLEND_REPLACE, G29_LED_ALL),
+        warning_layer("warning", 10, LED_BLEND_INVERT, G29_LED_10001),
+        layers{ &gauge_layer, &warning_layer },
+        compositor(layers, 2),
+        gauge_timer(onGaugeDue, this),
+        model(&WHEEL_MODELS[1]),
+        now(0),
+        timer_fires(0),
+        queued(0),
+        coalesced(0),
+        dropped(0),
+        sent(0xff) {}
+
+    static void onGaugeDue(timer_entry_t*, void* context) {
+        ((led_path_t*)context)->timer_fires++;
+    }
+
+    // One poller round: a new fuel reading, the layers composed and the LED
+    // state queued if it changed.
+    void update(unsigned long long round) {
+        // Sloshing around a threshold, slowly draining.
+        float fill = 0.9f - (float)(round % 4000) / 5000.0f + ((round & 1) ? 0.004f : -0.004f);
+        unsigned int level = fill_level.quantize(fill);
+        // How far into its band the fill is, in dither steps.
+        float low = level ? fillThresholds[level - 1] : 0, high = level < FILL_LEVELS ? fillThresholds[level] : 1;
+        unsigned int step = dither.step((fill - low) / (high - low));
+        dither.set(fillStates[level + 1], level + 2 < sizeof(fillStates) ? fillStates[level + 2] : 0, step % DITHER_LEVELS);
+        compositor.show(&gauge_layer, dither.steady() ? fillStates[level + 1] : dither.frame());
+
+        // A warning blinking for a while, every now and then.
+        if (round % 256 == 0) compositor.show(&warning_layer, G29_LED_ALL, now, 100);
+
+        // The wheel unplugged and back, with shorter reports this time: the
+        // report is sized again, but keeps its buffer. The plugin stops the
+        // writer meanwhile; waiting for it to go idle does here.
+        if (round % 1000 == 999) {
+            while (!idle()) std::this_thread::yield();
+            writer.report.init(round % 2000 == 999 ? HID_COMMAND_LEN + 1 : REPORT_LEN);
+        }
+
+        now += 8;
+        timers.schedule_in(&gauge_timer, 8);
+        timers.advance(now);
+
+        unsigned char composite = compositor.compose(now);
+        if (composite == sent) return;
+        sent = composite;
+        hid_queue_result_t result = writer.queue.queue(EncodeWheelLEDs(*model, composite), true, (long long)now * 1000);
+        if (result == HID_QUEUE_FULL) dropped++;
+        else if (result == HID_QUEUE_COALESCED) coalesced++;
+        queued++;
+        writer.signal();
+    }
+
+    // Every LED state queued was written, replaced by a newer one or
+    // dropped: the writer is idle.
+    bool idle() const {
+        return writer.written.load() + coalesced + dropped == queued;
+    }
+};
+
+static int allocCommand(int argc, char** argv) {
+    unsigned long long iterations = 5000, warmup = 100;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) warmup = strtoull(argv[++i], nullptr, 10);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+    _CrtSetAllocHook(allocHook);
+#endif
+    // Set up like the plugin does on load, before anything is counted.
+    led_path_t* path = new led_path_t();
+    if (!path->writer.report.init(REPORT_LEN)) {
+        fprintf(stderr, "Can't allocate the output report\n");
+        return 1;
+    }
+    path->writer.start();
+
+    unsigned long long round = 0;
+    for (; round < warmup; round++) path->update(round);
+
+    unsigned long long written_before = path->writer.written.load();
+    countingAllocations.store(true);
+    for (; round < warmup + iterations; round++) path->update(round);
+    while (!path->idle()) std::this_thread::yield();
+    countingAllocations.store(false);
+    unsigned long long counted = allocations.load();
+    unsigned long long written = path->writer.written.load() - written_before;
+    path->writer.stop();
+
+    printf("%llu updates after %llu warm-up ones: %llu LED states queued (%llu coalesced, %llu dropped), %llu reports to the mock wheel (last LEDs %02x), %llu timer fires\n",
+        iterations, warmup, path->queued, path->coalesced, path->dropped, written, path->writer.wheel.leds() & 0xff, path->timer_fires);
+    printf("Heap allocations: %llu\n", counted);
+    delete path;
+
+    if (written == 0) {
+        fprintf(stderr, "FAIL: the mock wheel got no report\n");
+        return 1;
+    }
+    if (counted != 0) {
+        fprintf(stderr, "FAIL: the LED update path allocated\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
+
+// truck_info_t's layout, without the plugin's headers.
+struct bench_truck_t {
+    bool paused;
+    float fuel_max;
+    float rpm_limit;
+    unsigned int flags;
+    float values[5];
+};
+
+#define SEQLOCK_MAX_SAMPLES (1u << 22) // per writer, latencies past them aren't kept
+
+struct writer_stats_t {
+    const char* name;
+    unsigned long long writes;
+    std::vector<unsigned int> begin_ns;
+    std::vector<unsigned int> end_ns;
+
+    explicit writer_stats_t(const char* name) : name(name), writes(0) {}
+};
+
+static unsigned long long nsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+static void keepSample(std::vector<unsigned int>& samples, unsigned long long ns) {
+    if (samples.size() < samples.capacity()) samples.push_back(ns > 0xffffffffULL ? 0xffffffffu : (unsigned int)ns);
+}
+
+static void reportLatency(const char* what, std::vector<unsigned int>& samples) {
+    if (samples.empty()) return;
+    unsigned long long total = 0;
+    for (unsigned int ns : samples) total += ns;
+    std::sort(samples.begin(), samples.end());
+    printf("  %-12s mean %6.1f ns, p99 %6u ns, max %8u ns\n", what, (double)total / samples.size(),
+        samples[(samples.size() - 1) * 99 / 100], samples.back());
+}
+
+static int seqlockCommand(int argc, char** argv) {
+    unsigned int readers = 2;
+    double seconds = 2;
+    bool second_writer = false;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--readers") == 0 && i + 1 < argc) readers = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--second-writer") == 0) second_writer = true;
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    static seqlock_t<bench_truck_t> data;
+    std::atomic<bool> running(true);
+    writer_stats_t stats[2] = { writer_stats_t("game"), writer_stats_t("search") };
+    std::vector<unsigned long long> reads(readers), retries(readers), torn(readers);
+    std::vector<std::thread> threads;
+
+    // Like dllmain.cpp's capacity search.
+    std::mutex search_lock;
+    std::atomic<float> found_fuel_max(0.0f);
+    std::atomic<unsigned int> found_generation(0);
+    unsigned long long published = 0, applied = 0;
+
+    // What it costs to time an empty stretch, included in every latency.
+    const int CLOCK_ROUNDS = 100000;
+    auto clock_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < CLOCK_ROUNDS; i++) std::chrono::steady_clock::now();
+    double clock_ns = (double)nsBetween(clock_start, std::chrono::steady_clock::now()) / CLOCK_ROUNDS;
+
+    for (unsigned int w = 0; w < 2; w++) {
+        stats[w].begin_ns.reserve(SEQLOCK_MAX_SAMPLES);
+        stats[w].end_ns.reserve(SEQLOCK_MAX_SAMPLES);
+    }
+
+    // Writes keep every value equal to the flags, and fuel_max equal to
+    // rpm_limit, so readers can tell a torn copy.
+    threads.emplace_back([&] {
+        writer_stats_t& own = stats[0];
+        unsigned int n = 0, applied_generation = 0;
+        while (running.load(std::memory_order_relaxed)) {
+            n = (n + 1) & 0xffffff; // exact in a float
+            auto t0 = std::chrono::steady_clock::now();
+            bench_truck_t* value = data.begin_write();
+            auto t1 = std::chrono::steady_clock::now();
+            for (float& v : value->values) v = (float)n;
+            value->flags = n;
+            auto t2 = std::chrono::steady_clock::now();
+            data.end_write();
+            auto t3 = std::chrono::steady_clock::now();
+            keepSample(own.begin_ns, nsBetween(t0, t1));
+            keepSample(own.end_ns, nsBetween(t2, t3));
+            own.writes++;
+
+            // The frame end: the capacity found, if there's a new one.
+            unsigned int generation = found_generation.load(std::memory_order_acquire);
+            if (generation != applied_generation) {
+                applied_generation = generation;
+                value = data.begin_write();
+                value->fuel_max = value->rpm_limit = found_fuel_max.load(std::memory_order_relaxed);
+                data.end_write();
+                own.writes++;
+                applied++;
+            }
+        }
+    });
+    threads.emplace_back([&] {
+        writer_stats_t& own = stats[1];
+        unsigned int n = 0;
+        while (running.load(std::memory_order_relaxed)) {
+            n = (n + 1) & 0xffffff;
+            if (second_writer) {
+                auto t0 = std::chrono::steady_clock::now();
+                bench_truck_t* value = data.begin_write();
+                auto t1 = std::chrono::steady_clock::now();
+                value->fuel_max = value->rpm_limit = (float)n;
+                auto t2 = std::chrono::steady_clock::now();
+                data.end_write();
+                auto t3 = std::chrono::steady_clock::now();
+                keepSample(own.begin_ns, nsBetween(t0, t1));
+                keepSample(own.end_ns, nsBetween(t2, t3));
+                own.writes++;
+            } else {
+                std::lock_guard<std::mutex> guard(search_lock);
+                found_fuel_max.store((float)n, std::memory_order_relaxed);
+                found_generation.store(n, std::memory_order_release);
+            }
+            published++;
+        }
+    });
+    for (unsigned int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r] {
+            unsigned long long own_reads = 0, own_retries = 0, own_torn = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                bench_truck_t copy = data.read(&own_retries);
+                own_reads++;
+                bool consistent = copy.fuel_max == copy.rpm_limit;
+                for (float v : copy.values) consistent = consistent && v == (float)copy.flags;
+                if (!consistent) own_torn++;
+            }
+            reads[r] = own_reads;
+            retries[r] = own_retries;
+            torn[r] = own_torn;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    running.store(false);
+    for (std::thread& thread : threads) thread.join();
+
+    printf("%u reader(s) for %.1f s on %u hardware thread(s), %u byte value; timing costs %.1f ns\n",
+        readers, seconds, std::thread::hardware_concurrency(), (unsigned int)sizeof(bench_truck_t), clock_ns);
+    for (unsigned int w = 0; w < 2; w++) {
+        if (stats[w].writes == 0) continue;
+        printf("Writer %u (%s): %llu writes\n", w + 1, stats[w].name, stats[w].writes);
+        reportLatency("begin_write", stats[w].begin_ns);
+        reportLatency("end_write", stats[w].end_ns);
+    }
+    if (second_writer) printf("Search: %llu capacities written into the seqlock\n", published);
+    else printf("Search: %llu capacities published, %llu applied by the game thread\n", published, applied);
+
+    unsigned long long total_reads = 0, total_retries = 0, total_torn = 0;
+    for (unsigned int r = 0; r < readers; r++) {
+        printf("Reader %u: %llu reads, %llu retries\n", r + 1, reads[r], retries[r]);
+        total_reads += reads[r];
+        total_retries += retries[r];
+        total_torn += torn[r];
+    }
+    if (readers) {
+        printf("Readers: %llu reads, %llu retries (%.3f per read), %llu torn\n", total_reads, total_retries,
+            total_reads ? (double)total_retries / total_reads : 0.0, total_torn);
+    }
+    printf("Writer waits on another writer: %llu\n", data.writer_waits());
+
+    if (total_torn != 0) {
+        fprintf(stderr, "FAIL: a reader got a torn copy\n");
+        return 1;
+    }
+    if (data.writer_waits() != 0) {
+        fprintf(stderr, "FAIL: a writer spun on another writer\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
+
+#ifdef __linux__
+// The G29's report descriptor in its native (PC) mode, as the kernel shows
+// it in sysfs: a joystick input report, then the 7 byte vendor output
+// report LED and force feedback commands go to.
+static const unsigned char G29_DESCRIPTOR[] = {
+    0x05, 0x01, 0x09, 0x04, 0xa1, 0x01, // Usage Page (Generic Desktop), Usage (Joystick), Collection (Application)
+    0xa1, 0x02, // Collection (Logical)
+    0x95, 0x01, 0x75, 0x0a, 0x15, 0x00, 0x26, 0xff, 0x03, 0x35, 0x00, 0x46, 0xff, 0x03,
+    0x09, 0x30, 0x81, 0x02, // 10 bit wheel
+    0x95, 0x0c, 0x75, 0x01, 0x25, 0x01, 0x45, 0x01, 0x05, 0x09, 0x19, 0x01, 0x29, 0x0c,
+    0x81, 0x02, // 12 buttons
+    0x95, 0x02, 0x06, 0x00, 0xff, 0x09, 0x01, 0x81, 0x02, // vendor bits
+    0x05, 0x01, 0x09, 0x31, 0x26, 0xff, 0x00, 0x46, 0xff, 0x00, 0x95, 0x01, 0x75, 0x08,
+    0x81, 0x02, // pedals
+    0x25, 0x07, 0x46, 0x3b, 0x01, 0x75, 0x04, 0x65, 0x14, 0x09, 0x39, 0x81, 0x42, // hat
+    0x75, 0x01, 0x95, 0x04, 0x65, 0x00, 0x06, 0x00, 0xff, 0x09, 0x01, 0x25, 0x01, 0x45, 0x01,
+    0x81, 0x02,
+    0x05, 0x01, 0x95, 0x01, 0x75, 0x08, 0x26, 0xff, 0x00, 0x46, 0xff, 0x00, 0x09, 0x32,
+    0x81, 0x02, 0x09, 0x35, 0x81, 0x02,
+    0xc0, // End Collection
+    0xa1, 0x02, // Collection (Logical)
+    0x26, 0xff, 0x00, 0x46, 0xff, 0x00, 0x95, 0x07, 0x75, 0x08, 0x09, 0x03,
+    0x91, 0x02, // Output: 7 bytes
+    0xc0, // End Collection
+    0xc0 // End Collection
+};
+
+// Two output reports numbered 1 and 2: the longest sets the size.
+static const unsigned char NUMBERED_DESCRIPTOR[] = {
+    0x06, 0x00, 0xff, 0x09, 0x01, 0xa1, 0x01,
+    0x85, 0x01, 0x75, 0x08, 0x95, 0x07, 0x09, 0x02, 0x91, 0x02, // report 1: 7 bytes
+    0x85, 0x02, 0x95, 0x13, 0x09, 0x03, 0x91, 0x02, // report 2: 19 bytes
+    0xc0
+};
+
+// Push saves 8 bit fields, the 1 bit fields between are popped away.
+static const unsigned char PUSH_POP_DESCRIPTOR[] = {
+    0x06, 0x00, 0xff, 0x09, 0x01, 0xa1, 0x01,
+    0x75, 0x08, 0x95, 0x07, // Report Size (8), Report Count (7)
+    0xa4, // Push
+    0x75, 0x01, 0x95, 0x08, 0x09, 0x02, 0x81, 0x02, // 8 input bits
+    0xb4, // Pop
+    0x09, 0x03, 0x91, 0x02, // Output: 7 bytes
+    0xc0
+};
+
+// A Pop with nothing pushed.
+static const unsigned char UNBALANCED_DESCRIPTOR[] = {
+    0x06, 0x00, 0xff, 0x09, 0x01, 0xa1, 0x01,
+    0x75, 0x08, 0x95, 0x07, 0xb4, 0x09, 0x03, 0x91, 0x02,
+    0xc0
+};
+
+// More Pushes than the parser keeps.
+static const unsigned char DEEP_PUSH_DESCRIPTOR[] = {
+    0x06, 0x00, 0xff, 0x09, 0x01, 0xa1, 0x01,
+    0x75, 0x08, 0x95, 0x07, 0xa4, 0xa4, 0xa4, 0xa4, 0xa4, 0xa4, 0xa4, 0xa4, 0xa4,
+    0x09, 0x03, 0x91, 0x02,
+    0xc0
+};
+
+static int hidrawFailures = 0;
+
+static void expect(bool passed, const char* what) {
+    printf("%s: %s\n", passed ? "ok" : "FAILED", what);
+    if (!passed) hidrawFailures++;
+}
+
+static bool writeFile(const char* path, const void* data, size_t length) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    bool written = fwrite(data, 1, length, file) == length;
+    return fclose(file) == 0 && written;
+}
+
+static bool matchG29(const hid_device_id_t& found, void*) {
+    const wheel_model_t* model = FindWheel(found);
+    return model != nullptr && model->led_encoding != WHEEL_LEDS_NONE;
+}
+
+// Writes an LED report through `transport` and reads it back from `peer`,
+// the other end of the node.
+static bool roundTrip(hidraw_transport_t& transport, int peer) {
+    hid_report_t report;
+    unsigned char received[64];
+
+    if (!report.init(transport.output_report_size())) return false;
+    if (transport.write(report.build(EncodeLEDs(G29_LED_10101)), report.size(), 100) != S_OK) return false;
+    ssize_t count = read(peer, received, sizeof(received));
+    return count == report.size() && memcmp(received, report.data(), report.size()) == 0;
+}
+
+static int hidrawCommand(int argc, char** argv) {
+    if (argc != 0) {
+        fprintf(stderr, "Unknown option %s\n", argv[0]);
+        return 1;
+    }
+
+    expect(hidraw_transport_t::ParseOutputReportSize(G29_DESCRIPTOR, sizeof(G29_DESCRIPTOR)) == HID_COMMAND_LEN + 1,
+        "the G29's output reports are 8 bytes, report ID included");
+    expect(hidraw_transport_t::ParseOutputReportSize(NUMBERED_DESCRIPTOR, sizeof(NUMBERED_DESCRIPTOR)) == 20,
+        "the longest of several numbered output reports sets the size");
+    expect(hidraw_transport_t::ParseOutputReportSize(PUSH_POP_DESCRIPTOR, sizeof(PUSH_POP_DESCRIPTOR)) == 8,
+        "Pop restores the report size and count Push saved");
+    expect(hidraw_transport_t::ParseOutputReportSize(UNBALANCED_DESCRIPTOR, sizeof(UNBALANCED_DESCRIPTOR)) == 0,
+        "a Pop without a Push gives no output report");
+    expect(hidraw_transport_t::ParseOutputReportSize(DEEP_PUSH_DESCRIPTOR, sizeof(DEEP_PUSH_DESCRIPTOR)) == 0,
+        "Pushes nested too deep give no output report");
+    expect(hidraw_transport_t::ParseOutputReportSize(G29_DESCRIPTOR, 20) == 0,
+        "a descriptor cut before its output report gives none");
+
+    char root[] = "/tmp/g29ledbench-XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char fifo[256], file[256], sysfs[256], device[256], path[512], dev[256];
+    snprintf(fifo, sizeof(fifo), "%s/fifo", root);
+    snprintf(file, sizeof(file), "%s/file", root);
+    snprintf(sysfs, sizeof(sysfs), "%s/sys", root);
+    snprintf(device, sizeof(device), "%s/sys/hidraw3", root);
+    snprintf(dev, sizeof(dev), "%s/dev", root);
+
+    {
+        hidraw_transport_t transport;
+        unsigned char buffer[8];
+        unsigned short read_len;
+
+        expect(mkfifo(fifo, 0600) == 0, "made a FIFO to stand in for the wheel");
+        expect(transport.open_node(fifo, 0) == E_INVALIDARG, "open_node() turns down a zero report size");
+        expect(transport.open_node(fifo, HID_COMMAND_LEN + 1) == S_OK && transport.is_open(), "open_node() opens the FIFO");
+        int peer = open(fifo, O_RDWR | O_NONBLOCK);
+        expect(peer >= 0 && roundTrip(transport, peer), "an LED report written comes out of the FIFO whole");
+        expect(transport.read(buffer, sizeof(buffer), &read_len, 10) == HRESULT_FROM_ERRNO(ETIMEDOUT),
+            "read() times out with nothing to read");
+        if (peer >= 0) {
+            expect(write(peer, "\x01\x02\x03", 3) == 3 && transport.read(buffer, sizeof(buffer), &read_len, 100) == S_OK && read_len == 3,
+                "read() returns what the device sent");
+            close(peer);
+        }
+        transport.close();
+        expect(!transport.is_open() && transport.output_report_size() == 0, "close() forgets the node");
+    }
+
+    {
+        hidraw_transport_t transport;
+
+        expect(writeFile(file, "", 0) && transport.open_node(file, HID_COMMAND_LEN + 1) == S_OK, "open_node() opens a plain file");
+        int peer = open(file, O_RDONLY);
+        expect(peer >= 0 && roundTrip(transport, peer), "an LED report written lands in the file");
+        if (peer >= 0) close(peer);
+        snprintf(path, sizeof(path), "%s/missing", root);
+        expect(transport.open_node(path, HID_COMMAND_LEN + 1) == HRESULT_FROM_ERRNO(ENOENT), "open_node() reports a missing node");
+    }
+
+    {
+        static const char UEVENT[] = "DRIVER=logitech\nHID_ID=0003:0000046D:0000C24F\nHID_NAME=Logitech G29 Driving Force Racing Wheel\nHID_PHYS=usb-0000:00:14.0-2/input0\n";
+        hidraw_transport_t transport(sysfs, dev);
+        hid_device_filter_t filter = { matchG29, nullptr };
+
+        snprintf(path, sizeof(path), "%s/device", device);
+        bool made = mkdir(sysfs, 0700) == 0 && mkdir(device, 0700) == 0 && mkdir(path, 0700) == 0 && mkdir(dev, 0700) == 0;
+        snprintf(path, sizeof(path), "%s/device/uevent", device);
+        made = made && writeFile(path, UEVENT, sizeof(UEVENT) - 1);
+        snprintf(path, sizeof(path), "%s/device/report_descriptor", device);
+        made = made && writeFile(path, G29_DESCRIPTOR, sizeof(G29_DESCRIPTOR));
+        snprintf(path, sizeof(path), "%s/hidraw3", dev);
+        made = made && mkfifo(path, 0600) == 0;
+        expect(made, "made a fake sysfs tree holding a G29");
+
+        expect(transport.open(filter) == S_OK, "open() finds the G29 through sysfs");
+        hid_device_id_t id = transport.device_id();
+        expect(id.vendor_id == LOGITECH_VID && id.product_id == 0xc24f && id.interface_number == 0, "it's the G29, interface 0");
+        expect(transport.output_report_size() == HID_COMMAND_LEN + 1, "with the report size of its descriptor");
+        transport.close();
+
+        hid_discovery_stats_t stats;
+        transport.discovery_stats(&stats);
+        expect(stats.enumerations == 1, "one sysfs scan counted");
+        unlink(path);
+        expect(transport.open(filter) != S_OK, "open() fails once the node is gone");
+    }
+
+    // Leaves nothing behind, whatever was made.
+    snprintf(path, sizeof(path), "rm -rf '%s'", root);
+    if (system(path) != 0) fprintf(stderr, "Unable to remove %s\n", root);
+
+    if (hidrawFailures) {
+        fprintf(stderr, "FAIL: %d hidraw check(s) failed\n", hidrawFailures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
+#endif
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "alloc") == 0) return allocCommand(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "seqlock") == 0) return seqlockCommand(argc - 2, argv + 2);
+#ifdef __linux__
+    if (argc >= 2 && strcmp(argv[1], "hidraw") == 0) return hidrawCommand(argc - 2, argv + 2);
+#endif
+
+    fprintf(stderr, "Usage: %s alloc [--iterations N] [--warmup N]\n"
+        "       %s seqlock [--readers N] [--seconds S] [--second-writer]\n"
+        "       %s hidraw (Linux only)\n",
+        argv[0], argv[0], argv[0]);
+    return 1;
+}
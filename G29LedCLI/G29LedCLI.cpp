@@ -3,175 +3,74 @@
 #include <Windows.h>
 #include <hidsdi.h>
 #include <SetupAPI.h>
+#include <mmsystem.h>
+#include "../G29LedPlugin/hidreport.h"
+#include "../G29LedPlugin/hidmock.h"
+#include "../G29LedPlugin/leddither.h"
+#include "../G29LedPlugin/ledeffects.h"
+#include "../G29LedPlugin/wheels.h"
 
-#define G29_LED_00000 0x00
-#define G29_LED_10000 0x01
-#define G29_LED_01000 0x02
-#define G29_LED_11000 0x03
-#define G29_LED_00100 0x04
-#define G29_LED_10100 0x05
-#define G29_LED_01100 0x06
-#define G29_LED_11100 0x07
-#define G29_LED_00010 0x08
-#define G29_LED_10010 0x09
-#define G29_LED_01010 0x0a
-#define G29_LED_11010 0x0b
-#define G29_LED_00110 0x0c
-#define G29_LED_10110 0x0d
-#define G29_LED_01110 0x0e
-#define G29_LED_11110 0x0f
-#define G29_LED_00001 0x10
-#define G29_LED_10001 0x11
-#define G29_LED_01001 0x12
-#define G29_LED_11001 0x13
-#define G29_LED_00101 0x14
-#define G29_LED_10101 0x15
-#define G29_LED_01101 0x16
-#define G29_LED_11101 0x17
-#define G29_LED_00011 0x18
-#define G29_LED_10011 0x19
-#define G29_LED_01011 0x1a
-#define G29_LED_11011 0x1b
-#define G29_LED_00111 0x1c
-#define G29_LED_10111 0x1d
-#define G29_LED_01111 0x1e
-#define G29_LED_11111 0x1f
-
-#define G29_LED_NONE G29_LED_00000
-#define G29_LED_ALL G29_LED_11111
+#pragma comment(lib, "winmm.lib")
 
 USHORT HIDPayloadLen = 0;
 WCHAR* HIDPath;
+hid_report_t HIDReport;
 bool Verbose = false;
 
-static unsigned const int G29_PID = 0xc24f;
-static unsigned const int G29_VID = 0x046d;
+// With --mock (or G29LEDPLUGIN_DEVICE=mock) reports go to a fake wheel, which
+// times the LED ones from the key press that caused them.
+hid_mock_device_t* MockDevice = nullptr;
+static long long keyPressedAt = 0;
 
-// FIXME: Use Regexp to match the device.
-static const WCHAR G29_sVPID[] = L"VID_046D&PID_C24F&";
-static const WCHAR G29_sMI[] = L"&MI_00";
+// The wheel found, or the one the mock poses as.
+static const wheel_model_t* Wheel = nullptr;
+static const hid_device_id_t MOCK_WHEEL = { LOGITECH_VID, 0xc24f, 0 };
 
 static unsigned __int64 rdtsc();
 
 static byte ledState = 0x00;
 static const byte fillStates[] = { 0x00, 0x10, 0x18, 0x1c, 0x1e, 0x1f };
 static const byte rpmStates[] = { 0x00, 0x01, 0x03, 0x07, 0x0f, 0x1f};
-static const byte loneStates[] = { 0x01, 0x02, 0x04, 0x08, 0x10};
-static const byte miss1States[] = { 0x0f, 0x17, 0x1b, 0x1d, 0x1e };
 
 void detailedError(const WCHAR* msg);
+void findHID();
+void printMockLatency();
 void ledSync();
 void loadHID();
-HRESULT sendHIDPayload(byte cmd, byte arg1 = 0x00, byte arg2 = 0x00, byte arg3 = 0x00, byte arg4 = 0x00, byte arg5 = 0x00, byte arg6 = 0x00);
-static HRESULT InitFuelGaugeAnimation();
-static HRESULT ShutdownFuelGaugeAnimation();
+HRESULT sendHIDPayload(const hid_command_t& command);
+static HRESULT playEffect(const led_effect_t& effect, unsigned char live);
+static void ditherSweep();
 
-int main()
+int main(int argc, char* argv[])
 {
-    GUID hidIdx;
-    HDEVINFO hidDevsHandle;
-    SP_DEVINFO_DATA device;
-    SP_DEVICE_INTERFACE_DATA devData;
-    devData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
-
-    PSP_DEVICE_INTERFACE_DETAIL_DATA devDetails;
-
-    DWORD memberIdx = 0, dwSize, dwType;
-    PBYTE buf;
-
-    HidD_GetHidGuid(&hidIdx);
-    hidDevsHandle = SetupDiGetClassDevs(&hidIdx, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
-
-    if (hidDevsHandle == INVALID_HANDLE_VALUE) {
-        detailedError(L"Unable to enumerate HID devices on system");
-        exit(1);
+    char device[16];
+    DWORD deviceLen = GetEnvironmentVariableA("G29LEDPLUGIN_DEVICE", device, sizeof(device));
+    bool mock = deviceLen > 0 && deviceLen < sizeof(device) && _stricmp(device, "mock") == 0;
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "--mock") == 0) mock = true;
     }
 
-    unsigned short cnnnttt = 0;
-    while (true) {
-        cnnnttt++;
-        if (cnnnttt > 200) {
-            printf("Error: Iterated 200 times without listing all HID devices?\n");
-            exit(1);
-        }
-
-        device.cbSize = sizeof(SP_DEVINFO_DATA);
-        if (!SetupDiEnumDeviceInfo(hidDevsHandle, memberIdx, &device)) {
-            printf("Error: Unable to locate a Logitech G29 steering wheel plugged to the system.");
-            exit(1);
-        }
-
-        SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_HARDWAREID, &dwType, NULL, 0, &dwSize);
-        if (dwSize > 0 && dwSize < 16384) {
-            buf = (PBYTE)malloc(dwSize * sizeof(BYTE));
-
-            //printf("Allocated buf with %lu entries of %zi bytes.\n", dwSize, sizeof(BYTE));
-            if (SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_HARDWAREID, &dwType, buf, dwSize, NULL) &&
-                wcsstr((WCHAR*)buf, (WCHAR*)&G29_sVPID) && wcsstr((WCHAR*)buf, (WCHAR*)&G29_sMI)) {
-                
-                wprintf(L"Found: %s\n", (WCHAR*)buf);
-
-                SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_DEVICEDESC, &dwType, NULL, 0, &dwSize);
-                if (dwSize <= 0 || dwSize > 16384) {
-                    printf("Error: Unable to fetch device description from: %ws\n", (WCHAR*)buf);
-                    exit(1);
-                }
-
-                free(buf);
-                buf = (PBYTE)malloc(dwSize * sizeof(BYTE));
-
-                if (!SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_DEVICEDESC, &dwType, buf, dwSize, NULL)) {
-                    printf("Error: Unable to fetch device description from: %ws\n", (WCHAR*)buf);
-                    exit(1);
-                }
-
-                wprintf(L"Device: %ws\n", (WCHAR*)buf);
-
-                SetupDiEnumDeviceInterfaces(hidDevsHandle, NULL, &hidIdx, memberIdx, &devData);
-                SetupDiGetDeviceInterfaceDetail(hidDevsHandle, &devData, NULL, 0, &dwSize, NULL);
-                if (dwSize < 1 || dwSize > 16384) {
-                    printf("Error: Unable to get device details.\n");
-                    exit(1);
-                }
-
-                devDetails = (PSP_INTERFACE_DEVICE_DETAIL_DATA)malloc(dwSize);
-                devDetails->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
-
-                if (!SetupDiGetDeviceInterfaceDetail(hidDevsHandle, &devData, devDetails, dwSize, &dwSize, NULL)) {
-                    printf("Error: Unable to get device details.\n");
-                    exit(1);
-                }
-
-                //wprintf(L"Device path: %s\n", devDetails->DevicePath);
-
-                dwSize = (lstrlen(devDetails->DevicePath) + 1) * sizeof(WCHAR);
-                HIDPath = (WCHAR *)malloc(dwSize);
-                memcpy_s(HIDPath, dwSize, devDetails->DevicePath, dwSize);
-                //wprintf(L"Device path (copy): %s\n", DevHIDPath);
-                free(devDetails);
-                //wprintf(L"Device path (copy safe): %s\n", DevHIDPath);
-                break;
-            }
-            free(buf);
-        }
-        memberIdx++;
+    if (mock) {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        MockDevice = new hid_mock_device_t(freq.QuadPart);
+        Wheel = FindWheel(MOCK_WHEEL);
+        printf("Using a mock %s steering wheel.\n", Wheel->name);
+    } else {
+        findHID();
     }
 
-    wprintf(L"HID path: %s\n", HIDPath);
-
     loadHID();
     
     // Initialize the joystick in G29 native mode.
-    //sendHIDPayload(0xf8, 0x0a);
-    //sendHIDPayload(0xf8, 0x09, 0x05, 0x01, 0x01);
+    //sendHIDPayload(EncodeRevertMode());
+    //sendHIDPayload(EncodeSwitchMode(G29_MODE_G29));
 
     char cmd = ' ';
     bool handled = false;
     unsigned short i = 0;
     byte fillStateCount = sizeof(fillStates) / sizeof(byte);
     byte rpmStateCount = sizeof(rpmStates) / sizeof(byte);
-    byte loneStateCount = sizeof(loneStates) / sizeof(byte);
-    byte miss1StateCount = sizeof(loneStates) / sizeof(byte);
 
     while (true) {
         printf("Type a command to change the LEDs in the G29 wheel.\n"
@@ -182,13 +81,21 @@ int main()
             "r) truck shutdown animation (fuel gauge)\n"
             "f) star wars laser shot effect\n"
             "g) full animation effect\n"
+            "d) sweep the dithered fill gauge, timing it\n"
             "v) toggle HID commands verbosity\n"
-            "q) quit\n Choose an option ::> "
+            "%s"
+            "q) quit\n Choose an option ::> ",
+            MockDevice ? "h) mock wheel latency histogram\n" : ""
         );
 
         while (true) {
             handled = false;
             cmd = _getche();
+            if (MockDevice) {
+                LARGE_INTEGER now;
+                QueryPerformanceCounter(&now);
+                keyPressedAt = now.QuadPart;
+            }
             printf("\b \b");
 
             if (cmd == 'q') {
@@ -261,54 +168,34 @@ int main()
                 }
             } else if (cmd == 'f') {
                 printf("laser fire animation...");
-                for (unsigned short j = 0; j < 4; j++) {
-                    for (i = 0; i < loneStateCount; i++) {
-                        ledState = loneStates[i];
-                        ledSync();
-                        Sleep(50 + (50 * i));
-                    }
-                    Sleep(200);
-                    ledState = 0x00;
-                    ledSync();
-                    Sleep(100);
-                }
-                Sleep(500);
+                playEffect(EFFECT_LASER, G29_LED_NONE);
                 printf(" done.\n");
                 handled = true;
             } else if (cmd == 'g') {
                 printf("tank fill animation...");
-                ledState = 0x00;
-                Sleep(150);
-                for (i = 0; i < fillStateCount; i++) {
-                    ledState = fillStates[i];
-                    ledSync();
-                    Sleep(150);
-                }
-                for (unsigned short j = 0; j < 10; j++) {
-                    for (i = 0; i < miss1StateCount; i++) {
-                        ledState = miss1States[i];
-                        ledSync();
-                        Sleep(50);
-                    }
-                }
-                ledState = 0x1f;
-                ledSync();
-                ledState = 0x00;
-                Sleep(500);
+                playEffect(EFFECT_TANK_FILL, G29_LED_NONE);
                 printf(" done.\n");
                 handled = true;
+            } else if (cmd == 'd') {
+                printf("\n");
+                ditherSweep();
+                break;
+            } else if (cmd == 'h' && MockDevice) {
+                printf("\n");
+                printMockLatency();
+                break;
             } else if (cmd == 'v') {
                 Verbose = !Verbose;
                 printf("Verbose output is now %s.\n", Verbose ? "enabled" : "disabled");
                 handled = true;
             } else if (cmd == 'e') {
                 printf("start truck electricity...");
-                InitFuelGaugeAnimation();
+                playEffect(EFFECT_ELECTRICITY_ON, ledState);
                 printf(" startup complete.");
                 break;
             } else if (cmd == 'r') {
                 printf("shutdown truck electricity...");
-                ShutdownFuelGaugeAnimation();
+                playEffect(EFFECT_ELECTRICITY_OFF, G29_LED_NONE);
                 printf(" shutdown complete.");
                 break;
             }
@@ -321,6 +208,116 @@ int main()
         
         if (cmd == 'q') break;
     }
+
+    if (MockDevice) {
+        printMockLatency();
+        delete MockDevice;
+    }
+}
+
+void findHID() {
+    GUID hidIdx;
+    HDEVINFO hidDevsHandle;
+    SP_DEVINFO_DATA device;
+    SP_DEVICE_INTERFACE_DATA devData;
+    devData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
+
+    PSP_DEVICE_INTERFACE_DETAIL_DATA devDetails;
+
+    DWORD memberIdx = 0, dwSize, dwType;
+    PBYTE buf;
+    hid_device_id_t found;
+    const wheel_model_t* model;
+
+    HidD_GetHidGuid(&hidIdx);
+    hidDevsHandle = SetupDiGetClassDevs(&hidIdx, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+
+    if (hidDevsHandle == INVALID_HANDLE_VALUE) {
+        detailedError(L"Unable to enumerate HID devices on system");
+        exit(1);
+    }
+
+    unsigned short cnnnttt = 0;
+    while (true) {
+        cnnnttt++;
+        if (cnnnttt > 200) {
+            printf("Error: Iterated 200 times without listing all HID devices?\n");
+            exit(1);
+        }
+
+        device.cbSize = sizeof(SP_DEVINFO_DATA);
+        if (!SetupDiEnumDeviceInfo(hidDevsHandle, memberIdx, &device)) {
+            printf("Error: Unable to locate a supported steering wheel plugged to the system.");
+            exit(1);
+        }
+
+        SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_HARDWAREID, &dwType, NULL, 0, &dwSize);
+        if (dwSize > 0 && dwSize < 16384) {
+            buf = (PBYTE)malloc(dwSize * sizeof(BYTE));
+
+            //printf("Allocated buf with %lu entries of %zi bytes.\n", dwSize, sizeof(BYTE));
+            // Each hardware ID is parsed once and looked up in the wheel table.
+            model = nullptr;
+            if (SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_HARDWAREID, &dwType, buf, dwSize, NULL) &&
+                ParseHardwareId((WCHAR*)buf, &found)) {
+                model = FindWheel(found);
+                if (model != nullptr && model->led_encoding == WHEEL_LEDS_NONE) {
+                    printf("Skipping a %s: driving its LEDs isn't supported.\n", model->name);
+                    model = nullptr;
+                }
+            }
+            if (model != nullptr) {
+                Wheel = model;
+                wprintf(L"Found: %s\n", (WCHAR*)buf);
+                printf("Wheel: %s\n", Wheel->name);
+
+                SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_DEVICEDESC, &dwType, NULL, 0, &dwSize);
+                if (dwSize <= 0 || dwSize > 16384) {
+                    printf("Error: Unable to fetch device description from: %ws\n", (WCHAR*)buf);
+                    exit(1);
+                }
+
+                free(buf);
+                buf = (PBYTE)malloc(dwSize * sizeof(BYTE));
+
+                if (!SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_DEVICEDESC, &dwType, buf, dwSize, NULL)) {
+                    printf("Error: Unable to fetch device description from: %ws\n", (WCHAR*)buf);
+                    exit(1);
+                }
+
+                wprintf(L"Device: %ws\n", (WCHAR*)buf);
+
+                SetupDiEnumDeviceInterfaces(hidDevsHandle, NULL, &hidIdx, memberIdx, &devData);
+                SetupDiGetDeviceInterfaceDetail(hidDevsHandle, &devData, NULL, 0, &dwSize, NULL);
+                if (dwSize < 1 || dwSize > 16384) {
+                    printf("Error: Unable to get device details.\n");
+                    exit(1);
+                }
+
+                devDetails = (PSP_INTERFACE_DEVICE_DETAIL_DATA)malloc(dwSize);
+                devDetails->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
+
+                if (!SetupDiGetDeviceInterfaceDetail(hidDevsHandle, &devData, devDetails, dwSize, &dwSize, NULL)) {
+                    printf("Error: Unable to get device details.\n");
+                    exit(1);
+                }
+
+                //wprintf(L"Device path: %s\n", devDetails->DevicePath);
+
+                dwSize = (lstrlen(devDetails->DevicePath) + 1) * sizeof(WCHAR);
+                HIDPath = (WCHAR *)malloc(dwSize);
+                memcpy_s(HIDPath, dwSize, devDetails->DevicePath, dwSize);
+                //wprintf(L"Device path (copy): %s\n", DevHIDPath);
+                free(devDetails);
+                //wprintf(L"Device path (copy safe): %s\n", DevHIDPath);
+                break;
+            }
+            free(buf);
+        }
+        memberIdx++;
+    }
+
+    wprintf(L"HID path: %s\n", HIDPath);
 }
 
 static unsigned __int64 rdtsc() {
@@ -342,6 +339,12 @@ void detailedError(const WCHAR* msg) {
 }
 
 void loadHID() {
+    if (MockDevice) {
+        HIDPayloadLen = HID_COMMAND_LEN + 1;
+        HIDReport.init(HIDPayloadLen);
+        return;
+    }
+
     HANDLE hidHandle = CreateFile(HIDPath, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
 
     if (hidHandle == INVALID_HANDLE_VALUE) {
@@ -373,28 +376,29 @@ void loadHID() {
 
     HIDPayloadLen = hCaps.OutputReportByteLength;
     printf("Joystick HID packet size: %u bytes.\n", HIDPayloadLen);
+
+    if (!HIDReport.init(HIDPayloadLen)) {
+        printf("HID device report packet size smaller than packets we need to send (%i/%i).\n", HIDPayloadLen, HID_COMMAND_LEN + 1);
+        exit(1);
+    }
 }
 
-HRESULT sendHIDPayload(byte cmd, byte arg1, byte arg2, byte arg3, byte arg4, byte arg5, byte arg6) {
-    if (HIDPayloadLen == 0) {
+HRESULT sendHIDPayload(const hid_command_t& command) {
+    if (!HIDReport.ready()) {
         printf("Tried to send HID command before initialization.\n");
         exit(1);
-    } else if (HIDPayloadLen < 8) {
-        printf("HID device report packet size smaller than packets we need to send (%i/%i).\n", HIDPayloadLen, 8);
-        exit(1);
     }
-    byte *payload = new byte[HIDPayloadLen + 1];
-
-    ZeroMemory(payload, HIDPayloadLen + 1);
-
-    unsigned short idx = 1;
-    payload[idx++] = cmd;
-    payload[idx++] = arg1;
-    payload[idx++] = arg2;
-    payload[idx++] = arg3;
-    payload[idx++] = arg4;
-    payload[idx++] = arg5;
-    payload[idx++] = arg6;
+    const byte* payload = HIDReport.build(command);
+
+    if (MockDevice) {
+        // Only the first report after a key press is timed; animation frames
+        // that follow are paced by Sleep() on purpose.
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        MockDevice->receive(payload, HIDReport.size(), now.QuadPart, keyPressedAt);
+        keyPressedAt = 0;
+        return S_OK;
+    }
 
     HANDLE hidHandle = CreateFile(HIDPath, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
 
@@ -404,9 +408,9 @@ HRESULT sendHIDPayload(byte cmd, byte arg1, byte arg2, byte arg3, byte arg4, byt
     }
     
     DWORD wrCnt;
-    if (!WriteFile(hidHandle, payload, HIDPayloadLen, &wrCnt, NULL)) {
+    if (!WriteFile(hidHandle, payload, HIDReport.size(), &wrCnt, NULL)) {
         printf("Tried to write: 0x00,0x%02x,0x%02x,0x%02x,0x%02x,0x%02x,0x%02x,0x%02x.\n",
-            cmd, arg1, arg2, arg3, arg4, arg5, arg6);
+            payload[1], payload[2], payload[3], payload[4], payload[5], payload[6], payload[7]);
         detailedError(L"Cannot write data to joystick");
         exit(1);
     }
@@ -424,103 +428,105 @@ HRESULT sendHIDPayload(byte cmd, byte arg1, byte arg2, byte arg3, byte arg4, byt
     return S_OK;
 }
 
+void printMockLatency() {
+    hid_mock_latency_t latency;
+    MockDevice->latency(&latency);
+    printf("Mock wheel received %llu reports, %llu LED changes (last 0x%02x).\n",
+        MockDevice->reports, MockDevice->led_reports, MockDevice->leds() & 0xff);
+    if (latency.samples == 0) return;
+
+    printf("Key press to LED latency over %llu reports: p50 %llu us, p99 %llu us, max %llu us.\n",
+        latency.samples, latency.p50_us, latency.p99_us, latency.max_us);
+    for (int i = 0; i < HID_MOCK_BUCKETS; i++) {
+        if (latency.buckets[i]) printf("  < %llu us: %llu\n", 1ULL << i, latency.buckets[i]);
+    }
+}
+
 void ledSync() {
     if (Verbose) printf("Syncing LEDs with value: 0x%02x\n", ledState);
-    sendHIDPayload(0xf8, 0x12, ledState, 0x00, 0x00, 0x00, 0x01);
+    sendHIDPayload(EncodeWheelLEDs(*Wheel, ledState));
 }
 
 static HRESULT updateLEDs(unsigned char new_state) {
     if (new_state != ledState) {
         ledState = new_state;
-        return sendHIDPayload(0xf8, 0x12, ledState, 0x00, 0x00, 0x00, 0x01);
+        return sendHIDPayload(EncodeWheelLEDs(*Wheel, ledState));
     } else return S_OK;
 }
 
-#define UpdateChk(x) update_state = updateLEDs(x); if (update_state != S_OK) return update_state;
-
-static HRESULT InitFuelGaugeAnimation() {
-    DWORD delay = 50;
-    size_t i;
+// Plays the effect to its end, leaving the LEDs at `live`.
+static HRESULT playEffect(const led_effect_t& effect, unsigned char live) {
+    led_animation_t animation;
+    unsigned int next_ms;
     HRESULT update_state;
-    unsigned char animation[] = {
-        G29_LED_00000,
-        G29_LED_00001,
-        G29_LED_00010,
-        G29_LED_00100,
-        G29_LED_01000,
-        G29_LED_10000,
-        G29_LED_11000,
-        G29_LED_11100,
-        G29_LED_11110,
-        G29_LED_11111
-    };
-    unsigned char down_animation[] = {
-        G29_LED_11111,
-        G29_LED_01111,
-        G29_LED_00111,
-        G29_LED_00011,
-        G29_LED_00001,
-        G29_LED_00000
-    };
-    size_t anim_len = sizeof(animation) / sizeof(unsigned char);
-    unsigned char target_led_state = ledState;
-
-    for (i = 0; i < anim_len; i++) {
-        UpdateChk(animation[i]);
-        Sleep(delay);
-    }
 
-    anim_len = sizeof(down_animation) / sizeof(unsigned char);
-    for (i = 0; i < anim_len; i++) {
-        UpdateChk(down_animation[i]);
-        if (down_animation[i] == target_led_state) break;
-        Sleep(delay);
-    }
+    if (!animation.play(effect, ledState, live, GetTickCount64())) return E_INVALIDARG;
+    do {
+        update_state = updateLEDs(animation.tick(GetTickCount64(), live, &next_ms));
+        if (update_state != S_OK) return update_state;
+        if (next_ms != LED_NO_DEADLINE) Sleep(next_ms);
+    } while (animation.active());
+    return S_OK;
+}
 
-    for (i = 0; i < 3; i++) {
-        Sleep(100);
-        UpdateChk(G29_LED_NONE);
-        Sleep(25);
-        UpdateChk(target_led_state);
-    }
+// The plugin spaces dithering frames LED_DITHER_MIN_FRAME_US apart, more if
+// the wheel takes longer to write to.
+#define DITHER_FRAME_US LED_DITHER_MIN_FRAME_US
+#define DITHER_STEP_MS 250
+
+// Sweeps the fill gauge through every step the plugin shows it in with
+// G29LEDPLUGIN_DITHER (4 levels if unset), then tells the frame and LED
+// report rates achieved against the wheel and what a frame costs.
+static void ditherSweep() {
+    char value[16];
+    DWORD len = GetEnvironmentVariableA("G29LEDPLUGIN_DITHER", value, sizeof(value));
+    unsigned int levels = len > 0 && len < sizeof(value) ? strtoul(value, nullptr, 10) : 4;
+    // Capped like the plugin does, so the pattern doesn't visibly blink.
+    led_dither_t dither(led_dither_t::fit_levels(levels, DITHER_FRAME_US));
+    const unsigned int stateCount = sizeof(fillStates) / sizeof(byte);
+    const unsigned int steps = (stateCount - 2) * dither.levels();
+    LARGE_INTEGER freq, start, now, before, after;
+    unsigned long long frames = 0, reports = 0;
+    long long ticks = 0;
+
+    QueryPerformanceFrequency(&freq);
+    long long interval = DITHER_FRAME_US * freq.QuadPart / 1000000;
+    long long perStep = DITHER_STEP_MS * freq.QuadPart / 1000;
+
+    timeBeginPeriod(1);
+    QueryPerformanceCounter(&start);
+    for (unsigned int step = 0; step <= steps; step++) {
+        unsigned int state = step / dither.levels() + 1;
+        dither.set(fillStates[state], state + 1 < stateCount ? fillStates[state + 1] : 0, step % dither.levels());
+        if (Verbose) printf("Step %u of %u: 0x%02x, %u/%u of 0x%02x.\n", step, steps, fillStates[state],
+            step % dither.levels(), dither.levels(), state + 1 < stateCount ? fillStates[state + 1] : 0);
+
+        long long stepEnd = start.QuadPart + (step + 1) * perStep;
+        for (;;) {
+            // Sleep is coarse even at 1 ms resolution; wait the bulk of the
+            // gap and spin the rest.
+            long long due = start.QuadPart + frames * interval;
+            if (due >= stepEnd) break;
+            for (;;) {
+                QueryPerformanceCounter(&now);
+                if (now.QuadPart >= due) break;
+                if ((due - now.QuadPart) * 1000 / freq.QuadPart > 2) Sleep((DWORD)((due - now.QuadPart) * 1000 / freq.QuadPart - 1));
+            }
 
-    if (target_led_state == G29_LED_00001) {
-        for (i = 0; i < 5; i++) {
-            Sleep(100);
-            UpdateChk(G29_LED_NONE);
-            Sleep(50);
-            UpdateChk(target_led_state);
+            byte shown = ledState;
+            QueryPerformanceCounter(&before);
+            updateLEDs(dither.frame());
+            QueryPerformanceCounter(&after);
+            ticks += after.QuadPart - before.QuadPart;
+            if (ledState != shown) reports++;
+            frames++;
         }
     }
+    QueryPerformanceCounter(&now);
+    timeEndPeriod(1);
 
-    return S_OK;
+    double seconds = (double)(now.QuadPart - start.QuadPart) / freq.QuadPart;
+    printf("Dithered %u steps at %u levels: %llu frames in %.2f s (%.1f/s, %.1f/s asked), %llu LED reports (%.1f/s), %.0f ns per frame.\n",
+        steps + 1, dither.levels(), frames, seconds, frames / seconds, 1e6 / DITHER_FRAME_US,
+        reports, reports / seconds, frames ? (double)ticks * 1e9 / freq.QuadPart / frames : 0.0);
 }
-
-static HRESULT ShutdownFuelGaugeAnimation() {
-    size_t i;
-    HRESULT update_state;
-    unsigned char current_led_state = ledState;
-
-    UpdateChk(G29_LED_NONE);
-    Sleep(25);
-    UpdateChk(current_led_state);
-    Sleep(200);
-    UpdateChk(G29_LED_NONE);
-    Sleep(30);
-    UpdateChk(current_led_state);
-    Sleep(10);
-    UpdateChk(G29_LED_NONE);
-    Sleep(45);
-    UpdateChk(current_led_state);
-    Sleep(160);
-    UpdateChk(G29_LED_NONE);
-    Sleep(50);
-    UpdateChk(current_led_state);
-    Sleep(25);
-    UpdateChk(G29_LED_NONE);
-    Sleep(70);
-    UpdateChk(current_led_state);
-    Sleep(10);
-    UpdateChk(G29_LED_NONE);
-    return S_OK;
-}
\ No newline at end of file
@@ -0,0 +1,547 @@
+// G29LedMemScan: runs the plugin's game memory pointer search outside the
+// game, to measure it, and its structure checks over memory dumps, to find
+// the structures again when a game update moves their fields.
+//
+// Usage: G29LedMemScan bench [--mib N] [--density N] [--rounds N] [--threads N]
+//        G29LedMemScan dump FILE --base ADDR [--adblue CAP] [--ref ADDR] [--threads N]
+//        G29LedMemScan correlate [--tolerance T] [--span BYTES] [--int] [--top N] [--threads N]
+//                      FILE BASE VALUE [FILE BASE VALUE ...]
+//
+// bench builds a synthetic heap image of N MiB around a reference address,
+// one word in `density` pointing into the read-write window the plugin
+// looks for, and times the search for a structure planted near the edge of
+// the window with the old word by word walk and each scanner implementation,
+// then with the best one on 1 to `threads` threads (8 by default).
+//
+// dump runs the truck and tank structure checks of truckstruct.h at every
+// word of a raw memory dump, as if it were mapped at ADDR, and lists the
+// structures passing them, how many words of the dump point to each, and
+// how often each stage of checks turned the rest down. Truck structures are
+// only looked for given telemetry's AdBlue capacity, which they hold too.
+//
+// correlate looks for a telemetry value (e.g. the fuel tank capacity) in
+// several dumps taken in one game session with the value differing between
+// them, and lists where it sits relative to the read-only pointers before
+// it, which start the game's structures: a field found at the same distance
+// from the same pointer in every dump is most likely the one holding it.
+//
+// Builds on Windows and Linux alike.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "memscan.h"
+#include "truckstruct.h"
+
+// Same window sizes as telemetry_configuration().
+#define POINTER_WINDOW 0x1000000000ULL
+#define IMAGE_BASE 0x0000021000000000ULL
+#define ROMEM_BASE 0x00007ff600000000ULL
+
+struct bench_target_t {
+    uintptr_t value; // what the planted word points to
+    std::atomic<unsigned long long> calls; // the scan validates from several threads
+};
+
+static bool validatePlanted(uintptr_t value, uintptr_t address, void* context) {
+    bench_target_t* target = (bench_target_t*)context;
+    target->calls.fetch_add(1, std::memory_order_relaxed);
+    return value == target->value;
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The search the plugin did before: one word below the reference, one
+// above, two below... checking each word's value against the window. It
+// also called IsBadReadPtr() on every word, which isn't counted here.
+static uintptr_t wordWalk(const mem_region_t& image, const mem_scan_t& scan, mem_scan_validator_t validate, void* context, unsigned long long* words) {
+    const uintptr_t* ref = (const uintptr_t*)(image.data + (scan.ref - image.base));
+    size_t below = (scan.ref - scan.from) / sizeof(uintptr_t);
+    size_t above = (scan.to - scan.ref) / sizeof(uintptr_t) - 1;
+
+    *words = 0;
+    for (size_t amplitude = 1; amplitude <= below || amplitude <= above; amplitude++) {
+        if (amplitude <= below) {
+            uintptr_t value = ref[-(ptrdiff_t)amplitude];
+            (*words)++;
+            if (value >= scan.low && value <= scan.high && validate(value, scan.ref - amplitude * sizeof(uintptr_t), context)) {
+                return scan.ref - amplitude * sizeof(uintptr_t);
+            }
+        }
+        if (amplitude <= above) {
+            uintptr_t value = ref[amplitude];
+            (*words)++;
+            if (value >= scan.low && value <= scan.high && validate(value, scan.ref + amplitude * sizeof(uintptr_t), context)) {
+                return scan.ref + amplitude * sizeof(uintptr_t);
+            }
+        }
+    }
+    return 0;
+}
+
+static void report(const char* name, double ms, unsigned long long words, unsigned long long candidates, unsigned long long calls, uintptr_t found, uintptr_t expected) {
+    printf("%-10s %9.3f ms %7.3f ns/word %8.0f MiB/s  candidates %llu, validated %llu%s\n",
+        name, ms, words ? ms * 1000000.0 / words : 0.0, words ? words * sizeof(uintptr_t) / 1048576.0 / (ms / 1000.0) : 0.0,
+        candidates, calls, found == expected ? "" : "  WRONG MATCH");
+}
+
+static int bench(int argc, char** argv) {
+    size_t mib = 64;
+    unsigned int density = 200;
+    int rounds = 5;
+    unsigned int threads = 8;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--mib") == 0 && i + 1 < argc) mib = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--density") == 0 && i + 1 < argc) density = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = strtoul(argv[++i], nullptr, 10);
+        else {
+            fprintf(stderr, "Unknown bench option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (mib == 0 || density == 0 || rounds <= 0 || threads == 0) {
+        fprintf(stderr, "--mib, --density, --rounds and --threads must be positive.\n");
+        return 1;
+    }
+
+    size_t count = mib * 1048576 / sizeof(uintptr_t);
+    std::vector<uintptr_t> words(count);
+    std::mt19937_64 random(29);
+    uintptr_t ref = IMAGE_BASE + count / 2 * sizeof(uintptr_t);
+    mem_region_t image = { IMAGE_BASE, count * sizeof(uintptr_t), (const unsigned char*)words.data() };
+    mem_scan_t scan = { ref, IMAGE_BASE, IMAGE_BASE + image.size, ref - POINTER_WINDOW, ref + POINTER_WINDOW, MEM_SCAN_AUTO, nullptr, 1 };
+
+    // Mostly small numbers, floats and pointers to read-only memory, like
+    // the game's heap, and a share of pointers into the window.
+    for (size_t i = 0; i < count; i++) {
+        unsigned long long r = random();
+        if (r % density == 0) words[i] = scan.low + (random() % (2 * POINTER_WINDOW)) / 8 * 8;
+        else if (r % 3 == 0) words[i] = r >> 48;
+        else if (r % 3 == 1) words[i] = ROMEM_BASE + ((r >> 8) & 0xffffffff8ULL);
+        else words[i] = r;
+    }
+
+    // The structure is found near the end of the window, after most of it
+    // was searched.
+    bench_target_t target;
+    target.value = scan.low + 0x1234560;
+    size_t planted = count - count / 16;
+    words[planted] = target.value;
+    uintptr_t expected = IMAGE_BASE + planted * sizeof(uintptr_t);
+
+    printf("Synthetic heap: %zu MiB, 1 in %u words points into the window, %d rounds each.\n", mib, density, rounds);
+
+    double best = 0;
+    unsigned long long walked = 0;
+    uintptr_t found = 0;
+    for (int r = 0; r < rounds; r++) {
+        target.calls = 0;
+        auto start = std::chrono::steady_clock::now();
+        found = wordWalk(image, scan, validatePlanted, &target, &walked);
+        double ms = msSince(start);
+        if (r == 0 || ms < best) best = ms;
+    }
+    report("word walk", best, walked, target.calls, target.calls, found, expected);
+
+    const mem_scan_impl_t impls[] = { MEM_SCAN_SCALAR, MEM_SCAN_SSE2, MEM_SCAN_AVX2 };
+    for (mem_scan_impl_t impl : impls) {
+        mem_scan_stats_t stats;
+        if (impl > BestScanImpl()) {
+            printf("%-10s not supported here\n", ScanImplName(impl));
+            continue;
+        }
+        scan.impl = impl;
+        for (int r = 0; r < rounds; r++) {
+            target.calls = 0;
+            auto start = std::chrono::steady_clock::now();
+            found = FindNearestPointer(&image, 1, scan, validatePlanted, &target, &stats);
+            double ms = msSince(start);
+            if (r == 0 || ms < best) best = ms;
+        }
+        report(ScanImplName(impl), best, stats.words, stats.candidates, stats.validated, found, expected);
+    }
+
+    // Scaling. With more threads, bands beyond the match may be scanned
+    // before it's confirmed, so more words are scanned and validated.
+    double single = 0;
+    scan.impl = MEM_SCAN_AUTO;
+    for (unsigned int n = 1; n <= threads; n++) {
+        mem_scan_stats_t stats;
+        char name[32];
+        scan.threads = n;
+        for (int r = 0; r < rounds; r++) {
+            target.calls = 0;
+            auto start = std::chrono::steady_clock::now();
+            found = FindNearestPointer(&image, 1, scan, validatePlanted, &target, &stats);
+            double ms = msSince(start);
+            if (r == 0 || ms < best) best = ms;
+        }
+        if (n == 1) single = best;
+        snprintf(name, sizeof(name), "%s x%u", ScanImplName(stats.impl), n);
+        printf("%-10s %9.3f ms %6.2fx speedup  words %llu, validated %llu%s\n",
+            name, best, single / best, stats.words, stats.validated, found == expected ? "" : "  WRONG MATCH");
+    }
+    return 0;
+}
+
+// Dumps are raw images of the game's memory from `base` on, as a debugger
+// saves them. The structures' pointers are absolute, so the checks only make
+// sense with the address the image had in the game; addresses are 64-bit
+// whatever the tool is built for.
+struct dump_t {
+    const char* path;
+    uint64_t base;
+    std::vector<unsigned char> bytes;
+};
+
+#define DUMP_CHUNK 65536 // words per work item
+
+static FILE* openRead(const char* path) {
+#ifdef _MSC_VER
+    FILE* file = nullptr;
+    return fopen_s(&file, path, "rb") == 0 ? file : nullptr;
+#else
+    return fopen(path, "rb");
+#endif
+}
+
+static bool loadDump(dump_t* dump) {
+    FILE* file = openRead(dump->path);
+    unsigned char buffer[65536];
+    size_t read;
+
+    if (file == nullptr) {
+        fprintf(stderr, "Unable to open %s\n", dump->path);
+        return false;
+    }
+    dump->bytes.clear();
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) dump->bytes.insert(dump->bytes.end(), buffer, buffer + read);
+    fclose(file);
+    if (dump->bytes.size() < sizeof(uint64_t)) {
+        fprintf(stderr, "%s is empty.\n", dump->path);
+        return false;
+    }
+    return true;
+}
+
+static uint64_t dumpWord(const dump_t& dump, size_t offset) {
+    uint64_t value;
+    memcpy(&value, dump.bytes.data() + offset, sizeof(value));
+    return value;
+}
+
+// Calls work(first, last) for chunks of [0, count) from `threads` threads,
+// the calling one included.
+template <typename Work>
+static void parallelChunks(size_t count, size_t chunk, unsigned int threads, Work work) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t first;
+        while ((first = next.fetch_add(chunk)) < count) work(first, std::min(count, first + chunk));
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; i++) workers.emplace_back(worker);
+    worker();
+    for (std::thread& thread : workers) thread.join();
+}
+
+struct dump_match_t {
+    uint64_t address;
+    size_t doubtful; // soft check failing, or no_check
+    unsigned int pointers; // words of the dump pointing to it
+};
+
+// Every word of the dump a structure of `size` bytes could start at, through
+// the validator.
+template <typename Validator>
+static std::vector<dump_match_t> findStructures(const dump_t& dump, size_t size, const struct_env_t& env, Validator& validator, unsigned int threads) {
+    std::vector<dump_match_t> matches;
+    std::mutex lock;
+    size_t starts = dump.bytes.size() < size ? 0 : (dump.bytes.size() - size) / sizeof(uint64_t) + 1;
+
+    parallelChunks(starts, DUMP_CHUNK, threads, [&](size_t first, size_t last) {
+        std::vector<dump_match_t> found;
+        for (size_t i = first; i < last; i++) {
+            const unsigned char* data = dump.bytes.data() + i * sizeof(uint64_t);
+            if (validator.validate(data, env) != Validator::no_check) continue;
+            dump_match_t match = { dump.base + i * sizeof(uint64_t), validator.doubtful(data, env), 0 };
+            found.push_back(match);
+        }
+        if (found.empty()) return;
+        std::lock_guard<std::mutex> guard(lock);
+        matches.insert(matches.end(), found.begin(), found.end());
+    });
+    std::sort(matches.begin(), matches.end(), [](const dump_match_t& a, const dump_match_t& b) { return a.address < b.address; });
+    if (matches.empty()) return matches;
+
+    // The plugin finds structures through pointers to them, so those
+    // nobody points to wouldn't be found in the game.
+    std::unique_ptr<std::atomic<unsigned int>[]> pointers(new std::atomic<unsigned int>[matches.size()]);
+    for (size_t i = 0; i < matches.size(); i++) pointers[i] = 0;
+    parallelChunks(dump.bytes.size() / sizeof(uint64_t), DUMP_CHUNK, threads, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            uint64_t value = dumpWord(dump, i * sizeof(uint64_t));
+            if (value < matches.front().address || value > matches.back().address) continue;
+            auto match = std::lower_bound(matches.begin(), matches.end(), value,
+                [](const dump_match_t& m, uint64_t address) { return m.address < address; });
+            if (match != matches.end() && match->address == value) pointers[match - matches.begin()]++;
+        }
+    });
+    for (size_t i = 0; i < matches.size(); i++) matches[i].pointers = pointers[i];
+    return matches;
+}
+
+template <typename Validator>
+static void reportStages(Validator& validator) {
+    const char* separator = "";
+    validator.reorder();
+    printf("  Stages by rejection rate:");
+    for (size_t i = 0; i < Validator::stages; i++) {
+        size_t stage = validator.stageAt(i);
+        if (validator.evaluations(stage) == 0) continue;
+        printf("%s %zu (%s) %.1f%%", separator, stage, Validator::check(validator.stageFirst(stage)).name, validator.rejectionRate(stage) * 100.0);
+        separator = ",";
+    }
+    printf("\n");
+}
+
+template <typename Validator>
+static void reportDoubtful(const dump_t& dump, const dump_match_t& match) {
+    char value[64];
+    if (match.doubtful == Validator::no_check) return;
+    const struct_check_t& check = Validator::check(match.doubtful);
+    structFormatValue(check, dump.bytes.data() + (match.address - dump.base), value, sizeof(value));
+    printf("      %s doesn't look right: %s\n", check.name, value);
+}
+
+static int dumpCommand(int argc, char** argv) {
+    dump_t dump = { nullptr, 0 };
+    uint64_t ref = 0;
+    float adblue_cap = NAN;
+    unsigned int threads = std::thread::hardware_concurrency();
+    bool has_base = false;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--base") == 0 && i + 1 < argc) {
+            dump.base = strtoull(argv[++i], nullptr, 0);
+            has_base = true;
+        }
+        else if (strcmp(argv[i], "--ref") == 0 && i + 1 < argc) ref = strtoull(argv[++i], nullptr, 0);
+        else if (strcmp(argv[i], "--adblue") == 0 && i + 1 < argc) adblue_cap = strtof(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = strtoul(argv[++i], nullptr, 10);
+        else if (argv[i][0] != '-' && dump.path == nullptr) dump.path = argv[i];
+        else {
+            fprintf(stderr, "Unknown dump option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (dump.path == nullptr || !has_base) {
+        fprintf(stderr, "dump needs a file and its --base address.\n");
+        return 1;
+    }
+    if (threads == 0) threads = 1;
+    if (!loadDump(&dump)) return 1;
+
+    // The plugin's window: read-write pointers within POINTER_WINDOW of the
+    // configuration's attributes, somewhere in the heap; the dump's middle
+    // unless told.
+    if (ref == 0) ref = dump.base + dump.bytes.size() / 2;
+    struct_env_t env = { ROMEM_MIN_ADDR, ROMEM_MAX_ADDR, ref > POINTER_WINDOW ? ref - POINTER_WINDOW : 0, ref + POINTER_WINDOW, adblue_cap };
+    printf("%s: %zu MiB at 0x%016llx, read-write window [0x%016llx:0x%016llx], %u threads.\n", dump.path,
+        dump.bytes.size() / 1048576, (unsigned long long)dump.base, (unsigned long long)env.rw_low, (unsigned long long)env.rw_high, threads);
+
+    if (!isnan(adblue_cap)) {
+        truck_struct_validator_t validator;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<dump_match_t> matches = findStructures(dump, sizeof(truck_info_with_capacity_t), env, validator, threads);
+        double ms = msSince(start);
+
+        printf("Truck structures (AdBlue capacity %.2f): %zu, in %.1f ms (%.0f MiB/s).\n", adblue_cap, matches.size(), ms, dump.bytes.size() / 1048576.0 / (ms / 1000.0));
+        for (const dump_match_t& match : matches) {
+            truck_info_with_capacity_t data;
+            memcpy(&data, dump.bytes.data() + (match.address - dump.base), sizeof(data));
+            printf("  0x%016llx %s, prefix %08x: tank %.2f, fill %.3f fuel %.3f AdBlue; %u pointers to it\n",
+                (unsigned long long)match.address, data.f01_04_addrs.addrs.rwmem ? "linked" : "unlinked", data.prefield02_nznum,
+                data.f42_tank_cap, data.f48_tank_fill, data.f49_adbl_fill, match.pointers);
+            reportDoubtful<truck_struct_validator_t>(dump, match);
+        }
+        reportStages(validator);
+    } else {
+        printf("Truck structures not looked for: no --adblue capacity given.\n");
+    }
+
+    // Its read-only pointers were told apart with an exclusive upper bound.
+    tank_struct_validator_t validator;
+    struct_env_t tank_env = env;
+    tank_env.ro_high = ROMEM_MAX_ADDR - 1;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<dump_match_t> matches = findStructures(dump, sizeof(tank_info_t), tank_env, validator, threads);
+    double ms = msSince(start);
+
+    printf("Tank structures: %zu, in %.1f ms.\n", matches.size(), ms);
+    for (const dump_match_t& match : matches) {
+        tank_info_t data;
+        memcpy(&data, dump.bytes.data() + (match.address - dump.base), sizeof(data));
+        printf("  0x%016llx tank %.2f; %u pointers to it\n", (unsigned long long)match.address, data.tank_cap, match.pointers);
+    }
+    reportStages(validator);
+    return 0;
+}
+
+// A place the value was found at: `distance` bytes after a word holding
+// `anchor`, a pointer to read-only memory (a structure's first field, most
+// often its virtual table).
+struct correlation_key_t {
+    uint64_t anchor;
+    uint32_t distance;
+
+    bool operator==(const correlation_key_t& other) const { return anchor == other.anchor && distance == other.distance; }
+};
+
+struct correlation_hash_t {
+    size_t operator()(const correlation_key_t& key) const {
+        return std::hash<uint64_t>()(key.anchor * 0x9e3779b97f4a7c15ULL ^ key.distance);
+    }
+};
+
+struct correlation_t {
+    unsigned int dumps; // it was found in
+    unsigned long long hits;
+};
+
+struct correlate_options_t {
+    double tolerance;
+    uint32_t span;
+    bool integer;
+};
+
+// Places the dump holds the value at, each counted once.
+static bool correlateDump(dump_t* dump, double value, const correlate_options_t& options,
+    std::unordered_set<correlation_key_t, correlation_hash_t>* keys, unsigned long long* hits) {
+    if (!loadDump(dump)) return false;
+
+    *hits = 0;
+    for (size_t offset = 0; offset + sizeof(uint32_t) <= dump->bytes.size(); offset += sizeof(uint32_t)) {
+        double field;
+        if (options.integer) {
+            uint32_t number;
+            memcpy(&number, dump->bytes.data() + offset, sizeof(number));
+            field = number;
+        } else {
+            float number;
+            memcpy(&number, dump->bytes.data() + offset, sizeof(number));
+            field = number;
+        }
+        if (!(fabs(field - value) <= options.tolerance)) continue;
+
+        (*hits)++;
+        size_t first = offset > options.span ? (offset - options.span + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t) : 0;
+        for (size_t word = first; word + sizeof(uint64_t) <= offset; word += sizeof(uint64_t)) {
+            uint64_t anchor = dumpWord(*dump, word);
+            if (anchor < ROMEM_MIN_ADDR || anchor > ROMEM_MAX_ADDR) continue;
+            correlation_key_t key = { anchor, (uint32_t)(offset - word) };
+            keys->insert(key);
+        }
+    }
+    dump->bytes.clear();
+    dump->bytes.shrink_to_fit();
+    return true;
+}
+
+static int correlateCommand(int argc, char** argv) {
+    correlate_options_t options = { 0.01, 0x400, false };
+    unsigned int threads = std::thread::hardware_concurrency();
+    size_t top = 20;
+    std::vector<dump_t> dumps;
+    std::vector<double> values;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) options.tolerance = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--span") == 0 && i + 1 < argc) options.span = strtoul(argv[++i], nullptr, 0);
+        else if (strcmp(argv[i], "--int") == 0) options.integer = true;
+        else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) top = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = strtoul(argv[++i], nullptr, 10);
+        else if (argv[i][0] != '-' && i + 2 < argc) {
+            dump_t dump = { argv[i], strtoull(argv[i + 1], nullptr, 0) };
+            dumps.push_back(dump);
+            values.push_back(strtod(argv[i + 2], nullptr));
+            i += 2;
+        } else {
+            fprintf(stderr, "Unknown correlate option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (dumps.size() < 2) {
+        fprintf(stderr, "correlate needs at least two dumps, each with its base address and the value it holds.\n");
+        return 1;
+    }
+    if (threads == 0) threads = 1;
+
+    // A dump per thread: they're read and searched whole, and only their
+    // matches are kept.
+    std::vector<std::unordered_set<correlation_key_t, correlation_hash_t>> keys(dumps.size());
+    std::vector<unsigned long long> hits(dumps.size());
+    std::atomic<bool> failed(false);
+    auto start = std::chrono::steady_clock::now();
+    parallelChunks(dumps.size(), 1, std::min<unsigned int>(threads, (unsigned int)dumps.size()), [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            if (!correlateDump(&dumps[i], values[i], options, &keys[i], &hits[i])) failed = true;
+        }
+    });
+    if (failed) return 1;
+
+    std::unordered_map<correlation_key_t, correlation_t, correlation_hash_t> places;
+    for (size_t i = 0; i < dumps.size(); i++) {
+        printf("%s: %.4f found %llu times.\n", dumps[i].path, values[i], hits[i]);
+        for (const correlation_key_t& key : keys[i]) {
+            correlation_t& place = places[key];
+            place.dumps++;
+            place.hits += hits[i];
+        }
+        keys[i].clear();
+    }
+
+    // Found in the most dumps first, then where the value is the rarest,
+    // then after the furthest pointer: the structure's start more likely
+    // than pointers among its fields.
+    std::vector<std::pair<correlation_key_t, correlation_t>> ranked(places.begin(), places.end());
+    std::sort(ranked.begin(), ranked.end(), [](const std::pair<correlation_key_t, correlation_t>& a, const std::pair<correlation_key_t, correlation_t>& b) {
+        if (a.second.dumps != b.second.dumps) return a.second.dumps > b.second.dumps;
+        if (a.second.hits != b.second.hits) return a.second.hits < b.second.hits;
+        return a.first.distance > b.first.distance;
+    });
+    printf("%zu places, searched in %.1f ms. Most consistent:\n", ranked.size(), msSince(start));
+    for (size_t i = 0; i < ranked.size() && i < top; i++) {
+        printf("  +0x%03x after 0x%016llx, in %u of %zu dumps\n", ranked[i].first.distance,
+            (unsigned long long)ranked[i].first.anchor, ranked[i].second.dumps, dumps.size());
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) return bench(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "dump") == 0) return dumpCommand(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "correlate") == 0) return correlateCommand(argc - 2, argv + 2);
+
+    fprintf(stderr, "Usage: %s bench [--mib N] [--density N] [--rounds N] [--threads N]\n"
+        "       %s dump FILE --base ADDR [--adblue CAP] [--ref ADDR] [--threads N]\n"
+        "       %s correlate [--tolerance T] [--span BYTES] [--int] [--top N] [--threads N] FILE BASE VALUE [FILE BASE VALUE ...]\n",
+        argv[0], argv[0], argv[0]);
+    return 1;
+}
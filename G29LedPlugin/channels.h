@@ -0,0 +1,37 @@
+#ifndef __CHANNELS_H_INCLUDED__
+#define __CHANNELS_H_INCLUDED__
+
+// Truck telemetry channels the plugin subscribes to. A line here is all it
+// takes for a channel to be registered with the game, stored in truck_data
+// and flagged in truck_data_dirty; read it with truck_info_t::get() or
+// truck_info_t::is_set() using its TRUCK_<id> name.
+//
+//   FLOAT(id, SCS truck channel, update policy, threshold)
+//   BOOL(id, SCS truck channel, update policy)
+//
+// Update policies:
+//   TRUCK_UPDATE_WAKE   the poller is woken up at the end of the frame; the
+//                       plugin doesn't load if the game won't provide it
+//   TRUCK_UPDATE_QUIET  only stored; read by whoever needs it, and left at
+//                       its default if the game won't provide it
+//
+// Float values are only stored once they move more than `threshold` away
+// from the value stored last (0 stores every change): a deadband, so noise
+// like fuel sloshing in the tank neither takes a seqlock write nor wakes the
+// poller up. Fuel is in litres and engine speed in rpm.
+#define TRUCK_CHANNELS(FLOAT, BOOL) \
+    BOOL(ELECTRICITY, electric_enabled, TRUCK_UPDATE_WAKE) \
+    FLOAT(FUEL, fuel, TRUCK_UPDATE_WAKE, 0.05f) \
+    FLOAT(ENGINE_RPM, engine_rpm, TRUCK_UPDATE_QUIET, 5.0f) \
+    FLOAT(SPEED, speed, TRUCK_UPDATE_QUIET, 0.01f) \
+    FLOAT(ADBLUE, adblue, TRUCK_UPDATE_QUIET, 0.01f) \
+    FLOAT(BRAKE_AIR_PRESSURE, brake_air_pressure, TRUCK_UPDATE_QUIET, 0.1f) \
+    BOOL(FUEL_WARNING, fuel_warning, TRUCK_UPDATE_QUIET) \
+    BOOL(ADBLUE_WARNING, adblue_warning, TRUCK_UPDATE_QUIET) \
+    BOOL(AIR_PRESSURE_WARNING, brake_air_pressure_warning, TRUCK_UPDATE_WAKE) \
+    BOOL(AIR_PRESSURE_EMERGENCY, brake_air_pressure_emergency, TRUCK_UPDATE_QUIET) \
+    BOOL(OIL_PRESSURE_WARNING, oil_pressure_warning, TRUCK_UPDATE_QUIET) \
+    BOOL(WATER_TEMPERATURE_WARNING, water_temperature_warning, TRUCK_UPDATE_QUIET) \
+    BOOL(BATTERY_VOLTAGE_WARNING, battery_voltage_warning, TRUCK_UPDATE_QUIET)
+
+#endif
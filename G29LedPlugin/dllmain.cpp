@@ -1,10 +1,16 @@
 #include "pch.h"
 #include <stdio.h>
 #include <share.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #include "log.h"
+#include "memscan.h"
 #include "poller.h"
 #include "scsutil.h"
+#include "sigcache.h"
+#include "truckstruct.h"
 #include "g29led.h"
 #include "truck.h"
 
@@ -19,217 +25,307 @@
 
 #ifdef x64
 
-// TODO: appropriately get the module addresses to determine de module address space
-#define ROMEM_MIN_ADDR 0x00007ff000000000
-#define ROMEM_MAX_ADDR 0x00007fff00000000
+// Read-write memory window of the search in progress; only the search
+// thread uses it. This may change every game run.
+static uintptr_t min_ptr = 0x00, max_ptr = 0x00;
 
-#define BETWEEN(x,low, hi) x >= low && x <= hi
-#define NOT_BETWEEN(x,low, hi) x < low || x > hi
+// Candidates that get far enough to be worth a debug dump can still come by
+// the thousand during a search.
+#define VALIDATE_LOG_RATE 10
 
-struct ptrpair_t {
-    uintptr_t romem;
-    uintptr_t rwmem;
-};
+// The checks are described in truckstruct.h. The validators count how often
+// each stage rejects a candidate, and the search thread puts the most
+// selective stages first in between searches.
+static truck_struct_validator_t truck_validator;
+static tank_struct_validator_t tank_validator;
 
-struct int_float_pair_t {
-    scs_s32_t intfld;
-    scs_float_t floatfld;
-};
+bool validate_main_struct(uintptr_t* pointer_to_truck_structure, float adblue_cap) {
+    if (IsBadReadPtr(pointer_to_truck_structure, sizeof(truck_info_with_capacity_t))) {
+        //log("Structure candidate unreadable. Address: 0x%p - size (bytes): %llu", pointer_to_truck_structure, sizeof(truck_info_with_capacity_t));
+        return false;
+    }
+
+    const unsigned char* data = (const unsigned char*)pointer_to_truck_structure;
+    struct_env_t env = { ROMEM_MIN_ADDR, ROMEM_MAX_ADDR, min_ptr, max_ptr, adblue_cap };
+    char value[64];
+    size_t failed = truck_validator.validate(data, env);
+    if (failed != truck_struct_validator_t::no_check) {
+        const struct_check_t& check = truck_struct_validator_t::check(failed);
+        if (check.flags & CHECK_REPORT) {
+            structFormatValue(check, data, value, sizeof(value));
+            logDebugEvery(VALIDATE_LOG_RATE, "[0x%p] Field %s (%s) didn't pass.", pointer_to_truck_structure, check.name, value);
+        }
+        return false;
+    }
 
-struct ptrp_lens_t {
-    ptrpair_t addrs;
-    scs_u64_t lens[2];
+    // Passing is rare enough to always tell which of the remaining fields
+    // didn't look right.
+    failed = truck_validator.doubtful(data, env);
+    if (failed != truck_struct_validator_t::no_check) {
+        const struct_check_t& check = truck_struct_validator_t::check(failed);
+        structFormatValue(check, data, value, sizeof(value));
+        logDebug("[0x%p] Field %s (%s) doesn't look right, but the structure matched.", pointer_to_truck_structure, check.name, value);
+    }
+    return true;
+}
+
+struct candidate_context_t {
+    float adblue_cap; // telemetry's figure, the structure must hold the same
+    const struct_signature_t* expect; // cached signature being checked, if any
+    // The match, read from the structure once the search is over.
+    truck_info_with_capacity_t* found;
+    float tank_cap;
+    scs_u32_t prefield;
 };
 
-struct truck_info_with_capacity_t {
-    // searching memory, many more pointers are set to an additional
-    // romem-uint-zero structure (16 bytes total), thus prepending this to
-    // the structure increases the odds on finding the structure faster.
-    // This applies for all 3 occurrences of this structure in game memory
-    // (as 1.47.x), being:
-    // struct #1: 14 pointers to -16-byte; 01 pointer to 0-byte
-    // structs #2 and #3: 2 pointers to -16-byte; 01 pointer to 0-byte
-    // the "uint" part of the structure seems to change from 00 00 00 04 to
-    // 06 00 00 a4, at least in the few checks performed. The latter usually
-    // has rw-pointers after ro-pointers where the former has zero-pointers
-    // where those rw-pointers would go.
-    uintptr_t prefield01_romem;
-    scs_u32_t prefield02_nznum;
-    scs_u32_t prefield03_znum;
-
-    ptrp_lens_t f01_04_addrs;
-    uintptr_t f05_rwmem;
-    // 06: e.g 89 ce 00 00
-    // 07: 0.0-1.0; e.g. 0.50
-    // 08: e.g 1007
-    // 09: 0.0-1.0
-    // 10: e.g. 1990
-    // 11: e.g. 72.15
-    // 12: e.g. 2350
-    // 13: 0.0-1.0, e.g. 0.54
-    int_float_pair_t f06_f13_pairs[4];
-    ptrpair_t f14_15_addrs;
-    scs_u32_t f16_17_num[2]; // e.g. 16:16; 17:32
-    int_float_pair_t f18_19_nums; // e.g. 18:inintelligible; 19: 38.44
-    // resp "lens", 3, 6, 6, 6
-    ptrp_lens_t f20_35_data[4];
-    scs_float_t f36_39_num[4]; // e.g.: -1.0, 0.01, -1.0, -1.0
-    scs_u64_t f40_data; // inintelligible (993454364 int at the time of writing)
-    scs_float_t f41_num; // e.g. 7856.00 (don't know where this came from)
-    scs_float_t f42_tank_cap; // e.g. 681.40 (our value!)
-    scs_float_t f43_adblue_cap; // e.g. 80.0 (can get from telemetry to double-check)
-    scs_float_t f44_num; // e.g. 0.0, 0.48, -25.95 (no idea)
-    scs_u32_t f45_46_num[2]; // inintelligible; both equal
-    scs_u32_t f47_num; // inintelligible (99
-    scs_float_t f48_tank_fill; // e.g. 0.21 (21%) fuel
-    scs_float_t f49_adbl_fill; // e.g. 0.23 (23%), usually higher than fuel fill unless both 100%
-    scs_float_t f50_num; // e.g. 2.10 (10x tank_fill?)
-    scs_float_t f51_num; // e.g. 0.75 -- no idea
-
-    // From this point on, the values are very unreliable between structures found
-    //scs_float_t f52_num; // e.g. 0.12? -- no idea, and might be int, depending where the structure is found
-    //ptrp_lens_t f53_56_data; // e.g. 7
-    //scs_s32_t f57_num; // inintelligible
-    //scs_float_t f58_64num[7]; // resp: 0.08, -0.10, -5.0, 0.15, -0.10, 5.0, -10.0
-    //uintptr_t f65_nulptr; // 0x00
+// Called from every search worker at once; only reads the context.
+static bool validate_candidate(uintptr_t value, uintptr_t address, void* context) {
+    const candidate_context_t* candidate = (const candidate_context_t*)context;
+    if (!validate_main_struct((uintptr_t*)value, candidate->adblue_cap)) return false;
+    if (candidate->expect != nullptr && ((truck_info_with_capacity_t*)value)->prefield02_nznum != candidate->expect->prefield) return false;
+    return true;
+}
+
+// The search runs on a thread of its own, so the game isn't held up by it.
+// Each truck configuration posts a request and bumps the generation; a
+// search still running for an older one is cancelled and starts over with
+// the latest request, and a result is only published if no newer request
+// came in meanwhile.
+struct capacity_search_t {
+    uintptr_t ref; // address of the configuration's attributes
+    float adblue_cap;
+    unsigned int generation;
 };
 
-static uintptr_t min_ptr = 0x00, max_ptr = 0x00; // this may change every game run
+static std::mutex search_lock; // guards search_request and publishing results
+static capacity_search_t search_request;
+static bool search_pending = false;
+static unsigned int search_generation = 0; // only changed by the game thread
+// The capacity found and the generation of the search that found it. The
+// game thread is truck_data's only writer, so it applies them itself, on the
+// next frame end.
+static std::atomic<float> found_fuel_max(0.0f);
+static std::atomic<unsigned int> found_generation(0);
+static unsigned int applied_generation = 0; // game thread only
+static std::atomic<bool> search_cancel(false);
+static std::atomic<bool> search_running(false);
+static std::thread* search_thread = nullptr;
+static HANDLE search_wakeup = NULL;
+
+// Threads searching at most, the search thread included. The game is busy
+// on the other cores, so only half of them are used.
+#define SEARCH_THREADS_MAX 4
+
+static unsigned int searchThreads() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores / 2 > SEARCH_THREADS_MAX ? SEARCH_THREADS_MAX : cores / 2 > 1 ? cores / 2 : 1;
+}
 
-bool validate_pointer_pair(ptrpair_t* pair, bool rwmem_zero = false) {
-    if (NOT_BETWEEN(pair->romem, ROMEM_MIN_ADDR, ROMEM_MAX_ADDR)) return false;
-    else if (rwmem_zero) {
-        if (pair->rwmem != 0) return false;
-    } else if (NOT_BETWEEN(pair->rwmem, min_ptr, max_ptr)) return false;
-    return true;
+// The game keeps changing its memory while we read it, and may release the
+// structure right after it was validated.
+static bool captureCandidate(uintptr_t address, candidate_context_t* candidate) {
+    __try {
+        candidate->found = *(truck_info_with_capacity_t**)address;
+        candidate->tank_cap = candidate->found->f42_tank_cap;
+        candidate->prefield = candidate->found->prefield02_nznum;
+        return true;
+    } __except (GetExceptionCode() == EXCEPTION_ACCESS_VIOLATION ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        return false;
+    }
 }
 
-bool validate_ptrplens(ptrp_lens_t* frame, bool rwmem_zero = false) {
-    if (!validate_pointer_pair(&(frame->addrs), rwmem_zero)) return false;
+static uintptr_t searchRegions(const std::vector<mem_region_t>& regions, const mem_scan_t& scan, candidate_context_t* candidate, mem_scan_stats_t* stats, bool* faulted) {
+    uintptr_t found = FindNearestPointer(regions.data(), regions.size(), scan, validate_candidate, candidate, stats);
+    if (found != 0 && !captureCandidate(found, candidate)) {
+        stats->faulted = true;
+        found = 0;
+    }
+    if (stats->faulted) *faulted = true;
+    return found;
+}
 
-    if (rwmem_zero) {
-        // When the read-write memory address is null, the first 8-byte length
-        // must be zero, but the second one may be zero or a number.
-        if (frame->lens[0] != 0 || frame->lens[1] > 10000) return false;
-    } else {
-        // When there's an address to read-write memory, then both lengths
-        // should be a non-zero and the same value.
-        if (frame->lens[0] != frame->lens[1] || frame->lens[0] == 0 || frame->lens[0] > 10000) return false;
+// Signatures tried before scanning.
+#define SIGNATURES_TRIED 4
+
+// Checks the locations where earlier sessions of this game build found the
+// structure, for a truck with the same AdBlue capacity. Returns the address
+// of the word pointing to it, 0 if none of them holds it anymore.
+static uintptr_t checkSignatures(const mem_scan_t& search, candidate_context_t* candidate, bool* tried, bool* faulted) {
+    struct_signature_t signatures[SIGNATURES_TRIED];
+    size_t count = FindSignatures(candidate->adblue_cap, signatures, SIGNATURES_TRIED);
+
+    *tried = count > 0;
+    for (size_t i = 0; i < count; i++) {
+        std::vector<mem_region_t> regions;
+        mem_scan_stats_t stats;
+        mem_scan_t scan = search;
+
+        // A search over the single word at the cached location.
+        scan.threads = 1;
+        scan.from = search.ref + (uintptr_t)signatures[i].offset;
+        scan.to = scan.from + sizeof(uintptr_t);
+        if (scan.from < search.from || scan.to > search.to) continue;
+        candidate->expect = &signatures[i];
+        CollectReadableRegions(scan.from, scan.to, &regions);
+        uintptr_t found = searchRegions(regions, scan, candidate, &stats, faulted);
+        candidate->expect = nullptr;
+        if (found != 0 || *faulted || stats.cancelled) return found;
     }
-    return true;
+    return 0;
 }
 
-bool validate_main_struct(uintptr_t* pointer_to_truck_structure, float adblue_cap) {
-    if (IsBadReadPtr(pointer_to_truck_structure, sizeof(truck_info_with_capacity_t))) {
-        //log("Structure candidate unreadable. Address: 0x%p - size (bytes): %llu", pointer_to_truck_structure, sizeof(truck_info_with_capacity_t));
-        return false;
+static void searchCapacity(capacity_search_t request) {
+    uintptr_t ref_ptr = request.ref;
+
+    // TODO: Different math needed for 32-bit builds!
+
+    // pointer has enough room for our validation, to tell whether a value
+    // is within our current memory address chunk.
+    min_ptr = ref_ptr - 0x1000000000;
+    max_ptr = ref_ptr + 0x1000000000;
+
+    // The search pointer limit is narrower so that it doesn't take too
+    // long to find the value.
+    uintptr_t min_search_ptr = ref_ptr - 0x2000000;
+    uintptr_t max_search_ptr = ref_ptr + 0x2000000;
+
+    log("Ref ptr: %p; address interval: [0x%016llx:0x%016llx]", ref_ptr, min_ptr, max_ptr);
+
+    // Only readable memory is scanned, and only words holding a pointer
+    // into the read-write window make it to the full validation, nearest
+    // to the reference address first. A few workers take 1 MiB bands of
+    // the window in order of distance, and stop once a match is confirmed
+    // nearer than the bands left.
+    LARGE_INTEGER search_start, search_end, qpc_freq;
+    std::vector<mem_region_t> regions;
+    mem_scan_stats_t stats;
+    mem_scan_t scan = { ref_ptr, min_search_ptr, max_search_ptr + sizeof(uintptr_t), min_ptr, max_ptr, MEM_SCAN_AUTO, &search_cancel, searchThreads() };
+    candidate_context_t candidate = { request.adblue_cap, nullptr, nullptr, 0.0f, 0 };
+    bool tried, cached, faulted = false;
+
+    log("Searching game memory for actual truck tank capacity info.");
+    QueryPerformanceCounter(&search_start);
+    memset(&stats, 0, sizeof(stats));
+    uintptr_t cur_ptr = checkSignatures(scan, &candidate, &tried, &faulted);
+    cached = cur_ptr != 0;
+    if (!cached && !faulted && !search_cancel) {
+        CollectReadableRegions(scan.from, scan.to, &regions);
+        cur_ptr = searchRegions(regions, scan, &candidate, &stats, &faulted);
+    }
+    QueryPerformanceCounter(&search_end);
+    QueryPerformanceFrequency(&qpc_freq);
+    double ms = (search_end.QuadPart - search_start.QuadPart) * 1000.0 / qpc_freq.QuadPart;
+
+    // The workers are done validating, so the next search can start with
+    // the checks that turned candidates down the most so far.
+    truck_validator.reorder();
+    size_t stage = truck_validator.stageAt(0);
+    logDebug("Truck structure checks: stage %zu first, turning down %.1f%% of %llu candidates.",
+        stage, truck_validator.rejectionRate(stage) * 100.0, truck_validator.evaluations(stage));
+
+    if (stats.cancelled || search_cancel) {
+        log("Search cancelled after %.2f ms: the truck configuration changed.", ms);
+        return;
+    } else if (faulted) {
+        logWarn("Search given up after %.2f ms: game memory was released while being scanned.", ms);
+        return;
     }
-    truck_info_with_capacity_t* data = (truck_info_with_capacity_t*)pointer_to_truck_structure;
-    bool zero_rw_pointers = data->f01_04_addrs.addrs.rwmem == 0;
 
-    // Validate the target value at once, and then check if the rest of the structure is sane
-    if (NOT_BETWEEN(data->f42_tank_cap, 30.0f, 5000.0f)) {
-        //log("Structure doesn't hold a sane tank capacity value.");
-        return false;
-    } else if (data->f43_adblue_cap != adblue_cap) {
-        //log("AdBlue capacity field doesn't match what was provided by telemetry (provided: %1.2f / 0x%08llx; checked: 0x%08llx).", adblue_cap, adblue_cap, data->f43_adblue_cap);
-        return false;
-    } else if (NOT_BETWEEN(data->prefield01_romem, ROMEM_MIN_ADDR, ROMEM_MAX_ADDR) || data->prefield02_nznum == 0 || data->prefield03_znum != 0) {
-        //log("Pre-Fields 1 & 2 don't match pattern: [ r/o mem addr : non-zero uint : zero uint ] pattern: [ 0x%08llx : 0x%04x : 0x%04x ]",
-        //    data->prefield01_romem, data->prefield02_nznum, data->prefield03_znum);
-        return false;
-    } else if (!validate_ptrplens(&(data->f01_04_addrs), zero_rw_pointers)) {
-        //log("Fields 1 thru 4 didn't pass.");
-        return false;
-    } else if (NOT_BETWEEN(data->f05_rwmem, min_ptr, max_ptr)) {
-        // From this point on, it already matched a lot and should be correct,
-        // so if it doesn't, log.
-        log("Field 5 didn't pass.");
-        return false;
-    } else if (NOT_BETWEEN(data->f06_f13_pairs[0].intfld, 0, 100000) ||
-               NOT_BETWEEN(data->f06_f13_pairs[0].floatfld, 0.0f, 1.0f) ||
-               NOT_BETWEEN(data->f06_f13_pairs[1].intfld, 0, 10000) ||
-               NOT_BETWEEN(data->f06_f13_pairs[1].floatfld, 0.0f, 10.0f) ||
-               NOT_BETWEEN(data->f06_f13_pairs[2].intfld, 0, 20000) ||
-               NOT_BETWEEN(data->f06_f13_pairs[2].floatfld, 0.0f, 10000.0f) ||
-               NOT_BETWEEN(data->f06_f13_pairs[3].intfld, 0, 20000) ||
-               NOT_BETWEEN(data->f06_f13_pairs[3].floatfld, 0.0f, 1.0f)) {
-        log("One or more fields between 6 and 13 didn't pass.\n  "
-            "0i[0:100k=%i] 0f[0:1=%1.4f]\n  "
-            "1i[0:10k=%i] 1f[0:10=%1.4f]\n  "
-            "2i[0:20k=%i] 2f[0:10k=%1.4f]\n  "
-            "3i[0:20k=%i] 3f[0:1=%1.4f]",
-            data->f06_f13_pairs[0].intfld, data->f06_f13_pairs[0].floatfld,
-            data->f06_f13_pairs[1].intfld, data->f06_f13_pairs[1].floatfld,
-            data->f06_f13_pairs[2].intfld, data->f06_f13_pairs[2].floatfld,
-            data->f06_f13_pairs[3].intfld, data->f06_f13_pairs[3].floatfld);
-        return false;
-    } else if (!validate_pointer_pair(&(data->f14_15_addrs), zero_rw_pointers)) {
-        log("[0x%p] Fields 14 (0x%p) and/or 15 (0x%p) didn't pass.", pointer_to_truck_structure, data->f14_15_addrs.romem, data->f14_15_addrs.rwmem);
-        return false;
-    } else if (data->f16_17_num[0] > 10000 || data->f16_17_num[1] > 10000) {
-        log("[0x%p] Fields 16 (%lu) and/or 17 (%lu) didn't pass.", pointer_to_truck_structure, data->f16_17_num[0], data->f16_17_num[1]);
-        return false;
-    } else if (NOT_BETWEEN(data->f18_19_nums.floatfld, 0.0f, 10000.0f)) {
-        log("[0x%p] Field 19 didn't pass.", pointer_to_truck_structure);
-        return false;
-    } else if (!validate_ptrplens(&(data->f20_35_data[0]), zero_rw_pointers) ||
-               !validate_ptrplens(&(data->f20_35_data[1]), zero_rw_pointers) ||
-               !validate_ptrplens(&(data->f20_35_data[2]), zero_rw_pointers) ||
-               !validate_ptrplens(&(data->f20_35_data[3]), zero_rw_pointers)) {
-        log("[0x%p] Fields 20 to 35 didn't pass.", pointer_to_truck_structure);
-        log("[20ro:0x%p; 21rw:0x%p; 22u:%llu; 23u:%llu] %s",
-            data->f20_35_data[0].addrs.romem, data->f20_35_data[0].addrs.rwmem, data->f20_35_data[0].lens[0], data->f20_35_data[0].lens[1],
-            validate_ptrplens(&(data->f20_35_data[0]), zero_rw_pointers) ? "v" : "x");
-        log("[24ro:0x%p; 25rw:0x%p; 26u:%llu; 27u:%llu] %s",
-            data->f20_35_data[1].addrs.romem, data->f20_35_data[1].addrs.rwmem, data->f20_35_data[1].lens[0], data->f20_35_data[1].lens[1],
-            validate_ptrplens(&(data->f20_35_data[1]), zero_rw_pointers) ? "v" : "x");
-        log("[28ro:0x%p; 29rw:0x%p; 30u:%llu; 31u:%llu] %s",
-            data->f20_35_data[2].addrs.romem, data->f20_35_data[2].addrs.rwmem, data->f20_35_data[2].lens[0], data->f20_35_data[2].lens[1],
-            validate_ptrplens(&(data->f20_35_data[2]), zero_rw_pointers) ? "v" : "x");
-        log("[32ro:0x%p; 33rw:0x%p; 34u:%llu; 35u:%llu] %s",
-            data->f20_35_data[3].addrs.romem, data->f20_35_data[3].addrs.rwmem, data->f20_35_data[3].lens[0], data->f20_35_data[3].lens[1],
-            validate_ptrplens(&(data->f20_35_data[3]), zero_rw_pointers) ? "v" : "x");
-        return false;
-    } else if (NOT_BETWEEN(data->f36_39_num[0], -1.0f, 1.0f) || NOT_BETWEEN(data->f36_39_num[1], -1.0f, 1.0f) || NOT_BETWEEN(data->f36_39_num[2], -1.0f, 1.0f) || NOT_BETWEEN(data->f36_39_num[3], -1.0f, 1.0f)) {
-        log("[0x%p] Fields 36 to 39 didn't pass.", pointer_to_truck_structure);
-        return false;
-    } else if (NOT_BETWEEN(data->f41_num, 0.0f, 100000.0f)) {
-        log("[0x%p] Field 41 didn't pass.", pointer_to_truck_structure);
-        return false;
-    } else if (NOT_BETWEEN(data->f48_tank_fill, 0.0f, 1.0f)) {
-        log("[0x%p] Field 48, tank fill, is not a number between 0.0 and 1.0.", pointer_to_truck_structure);
-        return false;
-    } else if (NOT_BETWEEN(data->f49_adbl_fill, 0.0f, 1.0f)) {
-        log("[0x%p] Field 49, AdBlue fill, is not a number between 0.0 and 1.0.", pointer_to_truck_structure);
-        return false;
+    CountSignatureLookup(tried, cached);
+    if (cur_ptr != 0) {
+        float tank_cap = candidate.tank_cap;
+        struct_signature_t signature = { (long long)(cur_ptr - ref_ptr), candidate.prefield, request.adblue_cap };
+        bool current;
+        {
+            std::lock_guard<std::mutex> guard(search_lock);
+            current = request.generation == search_generation;
+            if (current) {
+                found_fuel_max.store(tank_cap, std::memory_order_relaxed);
+                found_generation.store(request.generation, std::memory_order_release);
+            }
+        }
+        log("Found truck structure address at 0x%08llx (pointer at 0x%08llx, actual value at 0x%08llx). Value: %1.4f%s",
+            candidate.found, cur_ptr, &(candidate.found->f42_tank_cap), tank_cap, current ? "" : " (superseded, not used)");
+        // A superseded search may have raced a configuration change; its
+        // match isn't trusted enough to be looked up first next time.
+        if (current) RememberSignature(signature);
     }
-    // fields #42 & #43 checked first thing. From this point on, it's not very
-    // meaningful to check every member left, but the tests will be left here
-    // just in case:
-    return true;
+    if (cached) {
+        log("Search finished in %.2f ms: found at the location cached for this game build, %+lld bytes from the reference address [0x%08llx].",
+            ms, (long long)(cur_ptr - ref_ptr), ref_ptr);
+        return;
+    }
+    log("Search finished in %.2f ms (%s, %u threads). Scanned %llu words in %zu readable regions around the reference address [0x%08llx]; %llu pointed to read-write memory, %llu were validated.",
+        ms, ScanImplName(stats.impl), stats.threads, stats.words, stats.regions, ref_ptr, stats.candidates, stats.validated);
+}
 
-    if (NOT_BETWEEN(data->f44_num, -1000.0f, 1000.0f)) {
-        log("Field 44 didn't pass.");
-    } else if (data->f45_46_num[0] != data->f45_46_num[1]) {
-        log("Fields 45 and 46 don't hold the same value.");
-        return false;
-        // Field 47 is not known
-    } else if (NOT_BETWEEN(data->f48_tank_fill, 0.0f, 1.0f)) {
-        log("Field 48, tank fill, is not a number between 0.0 and 1.0.");
-        return false;
-    } else if (NOT_BETWEEN(data->f49_adbl_fill, 0.0f, 1.0f)) {
-        log("Field 49, AdBlue fill, is not a number between 0.0 and 1.0.");
-        return false;
-    } else if (NOT_BETWEEN(data->f50_num, 0.0f, 1000.0f)) {
-        log("Field 50, didn't pass.");
-        return false;
-    } else if (NOT_BETWEEN(data->f51_num, 0.0f, 1.0f)) {
-        log("Field 51, didn't pass.");
-        return false;
+static void searchLoop() {
+    while (search_running) {
+        capacity_search_t request;
+        bool pending;
+
+        WaitForSingleObject(search_wakeup, INFINITE);
+        {
+            std::lock_guard<std::mutex> guard(search_lock);
+            pending = search_pending;
+            request = search_request;
+            search_pending = false;
+            search_cancel = false;
+        }
+        if (pending && search_running) searchCapacity(request);
     }
+}
 
-    return true;
+// Posts a search for the configuration whose attributes are at `ref`, to
+// be found by its AdBlue capacity. Callers hold search_lock. Only takes
+// the lock and sets an event, so it's fine to call from the game thread.
+static void RequestCapacitySearch(uintptr_t ref, float adblue_cap) {
+    if (search_thread == nullptr) return;
+
+    search_request.ref = ref;
+    search_request.adblue_cap = adblue_cap;
+    search_request.generation = ++search_generation;
+    search_pending = true;
+    search_cancel = true; // if one is running, it's for an older configuration
+    SetEvent(search_wakeup);
+}
+
+// Called from the game thread: writes the capacity the search found over
+// the game's figure, unless the configuration changed since it was asked for.
+static void ApplyFoundCapacity() {
+    unsigned int generation = found_generation.load(std::memory_order_acquire);
+    if (generation == applied_generation) return;
+    applied_generation = generation;
+    if (generation != search_generation) return;
+
+    truck_data.begin_write()->fuel_max = found_fuel_max.load(std::memory_order_relaxed);
+    truck_data.end_write();
+    MarkTruckDataDirty(TRUCK_FIELD_FUEL_MAX);
+}
+
+static HRESULT StartCapacitySearch() {
+    if (search_thread != nullptr) return S_OK;
+
+    search_wakeup = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (search_wakeup == NULL) return HRESULT_FROM_WIN32(GetLastError());
+
+    search_running = true;
+    search_thread = new std::thread(searchLoop);
+    return S_OK;
+}
+
+// Cancels any search in progress and waits for the thread to exit.
+static void StopCapacitySearch() {
+    if (search_thread == nullptr) return;
+
+    search_running = false;
+    search_cancel = true;
+    SetEvent(search_wakeup);
+    search_thread->join();
+    delete search_thread;
+    search_thread = nullptr;
+    CloseHandle(search_wakeup);
+    search_wakeup = NULL;
 }
 
 // There are many fewer pointers pointing to this structure, and only one copy of it
@@ -238,71 +334,62 @@ bool validate_main_struct(uintptr_t* pointer_to_truck_structure, float adblue_ca
 // become unreliable across binary changes or versions.
 bool validate_alt_struct(uintptr_t* pointer_to_tank_structure) {
     uintptr_t ptr_to_tank_cap_val = (uintptr_t)*pointer_to_tank_structure;
-    if (IsBadReadPtr((void*)ptr_to_tank_cap_val, 53 * sizeof(uintptr_t))) {
+    if (IsBadReadPtr((void*)ptr_to_tank_cap_val, sizeof(tank_info_t))) {
         log("Pointer to possible actual tank capacity structure is not readable. Aborting search.");
-        log("Structure address: %p - size (bytes): %llu", ptr_to_tank_cap_val, 53 * sizeof(uintptr_t));
+        log("Structure address: %p - size (bytes): %llu", ptr_to_tank_cap_val, sizeof(tank_info_t));
         return false;
     }
 
-    // This is a potential pointer to the structure.
-    uintptr_t* tank_cap_struct = (uintptr_t*)ptr_to_tank_cap_val;
-    float tank_cap = *(float*)(tank_cap_struct + 53);
-    if (tank_cap > 200.0f && tank_cap < 5000.0f) {
-        log("pointer candidate: %p => %p (cap: %1.4f)", (uintptr_t)pointer_to_tank_structure, ptr_to_tank_cap_val, tank_cap);
-        bool match = true;
-        unsigned short i;
-        unsigned short zeroOffsets[] = { 9, 10, 11, 19, 20, 21, 27, 28, 29, 31, 32, 33, 40, 43, 46, 52 };
-        unsigned short len = sizeof(zeroOffsets) / sizeof(unsigned short);
-        unsigned short offset;
-        for (i = 0; i < len; i++) {
-            offset = zeroOffsets[i];
-            if (*(tank_cap_struct + offset) != 0) {
-                log("skipping, tank_cap_struct+%u is not zero: %p => 0x%016llx", offset, tank_cap_struct + offset, *(tank_cap_struct + offset));
-                return false;
-            }
-        }
-
-        // Commented ones proved to be unreliable.
-        unsigned short rwPointerOffsets[] = { /*3, 6,*/ 15, 23, 36, 48 };
-        len = sizeof(rwPointerOffsets) / sizeof(unsigned short);
-        for (i = 0; i < len; i++) {
-            offset = rwPointerOffsets[i];
-            if (*(tank_cap_struct + offset) < min_ptr || *(tank_cap_struct + offset) > max_ptr) {
-                log("skipping, tank_cap_struct+%u not a pointer to read-write memory space: %p => 0x%016llx", offset, tank_cap_struct + offset, *(tank_cap_struct + offset));
-                return false;
-            }
-        }
-
-        unsigned short roPointerOffsets[] = { 0, 2, 5, 8, 14, 18, 22, 26, 30, 35, 38, 39, 41, 42, 44, 45, 47 };
-        len = sizeof(roPointerOffsets) / sizeof(unsigned short);
-        for (i = 0; i < len; i++) {
-            offset = roPointerOffsets[i];
-            if (*(tank_cap_struct + offset) < 0x00007ff000000000 || *(tank_cap_struct + offset) >= 0x00007fff00000000) {
-                log("skipping, tank_cap_struct+%u not a pointer to read-only memory space: %p => 0x%016llx", offset, tank_cap_struct + offset, *(tank_cap_struct + offset));
-                return false;
-            }
-        }
-
+    // This is a potential pointer to the structure. Its read-only pointers
+    // were told apart with an exclusive upper bound.
+    const unsigned char* data = (const unsigned char*)ptr_to_tank_cap_val;
+    struct_env_t env = { ROMEM_MIN_ADDR, ROMEM_MAX_ADDR - 1, min_ptr, max_ptr, 0.0f };
+    float tank_cap = ((const tank_info_t*)data)->tank_cap;
+    size_t failed = tank_validator.validate(data, env);
+    if (failed == tank_struct_validator_t::no_check) {
         log("Looks like the structure was found. Tank cap found: %1.4f.", tank_cap);
         return true;
-    } else return false;
+    } else if (tank_struct_validator_t::check(failed).stage != 0) {
+        const struct_check_t& check = tank_struct_validator_t::check(failed);
+        char value[64];
+        structFormatValue(check, data, value, sizeof(value));
+        log("pointer candidate: %p => %p (cap: %1.4f)", (uintptr_t)pointer_to_tank_structure, ptr_to_tank_cap_val, tank_cap);
+        log("skipping, %s didn't pass: %s", check.name, value);
+    }
+    return false;
 }
 #endif // x64
 
-SCSAPI_VOID telemetry_pause(const scs_event_t event, const void* const UNUSED(event_info), const scs_context_t UNUSED(context)) {
-    truck_data.paused = (event == SCS_TELEMETRY_EVENT_paused);
-    if (truck_data.paused) {
+SCSAPI_VOID telemetry_pause(const scs_event_t event, const void* const event_info, const scs_context_t UNUSED(context)) {
+    if (telemetry_recorder.recording()) telemetry_recorder.event(event, event_info);
+    bool paused = (event == SCS_TELEMETRY_EVENT_paused);
+    truck_data.begin_write()->paused = paused;
+    truck_data.end_write();
+    MarkTruckDataDirty(TRUCK_FIELD_PAUSED);
+    SignalPoller();
+    if (paused) {
         log("Realtime data resumed.");
     } else {
         log("Realtime data interrupted.");
     }
 }
 
+// All channel values for the frame were delivered by now, so this is where
+// the poller is told to pick any changes up.
+SCSAPI_VOID telemetry_frame_end(const scs_event_t event, const void* const event_info, const scs_context_t UNUSED(context)) {
+    if (telemetry_recorder.recording()) telemetry_recorder.event(event, event_info);
+#ifdef x64
+    ApplyFoundCapacity();
+#endif
+    if (truck_data_dirty.load(std::memory_order_relaxed) != 0) SignalPoller();
+}
+
 SCSAPI_VOID telemetry_configuration(const scs_event_t event, const void* const event_info, const scs_context_t UNUSED(context))
 {
     // We currently only care for the truck telemetry info.
 
     const struct scs_telemetry_configuration_t* const info = static_cast<const scs_telemetry_configuration_t*>(event_info);
+    if (telemetry_recorder.recording()) telemetry_recorder.event(event, event_info);
 #ifdef _DEBUGx
     scs_value_dvector_t dpos;
     scs_value_fvector_t pos;
@@ -370,94 +457,32 @@ SCSAPI_VOID telemetry_configuration(const scs_event_t event, const void* const e
         return;
     }
 
-    const scs_named_value_t* const fuel_capacity_cfg = find_attribute(*info, SCS_TELEMETRY_CONFIG_ATTRIBUTE_fuel_capacity, SCS_U32_NIL, SCS_VALUE_TYPE_float);
-
-    truck_data_access.lock();
-    if (fuel_capacity_cfg) {
-        truck_data.fuel_max = fuel_capacity_cfg->value.value_float.value;
-    } else {
-        truck_data.fuel_max = 200.0f;
-    }
-    truck_data_access.unlock();
-
 #ifdef x64
-    uintptr_t ref_ptr = (uintptr_t)info->attributes;
-
+    // The game's figure of the fuel capacity is often wrong, so the actual
+    // one is looked for in its memory. That search runs in the background,
+    // superseding any still running for an earlier configuration, and
+    // replaces the capacity below if it finds it. The lock is held until
+    // that's written, so a search for the previous truck can't publish its
+    // result after it.
+    std::lock_guard<std::mutex> search_guard(search_lock);
     const scs_named_value_t* const adblue_cap_cfg = find_attribute(*info, SCS_TELEMETRY_CONFIG_ATTRIBUTE_adblue_capacity, SCS_U32_NIL, SCS_VALUE_TYPE_float);
+    RequestCapacitySearch((uintptr_t)info->attributes, adblue_cap_cfg ? adblue_cap_cfg->value.value_float.value : 80.0f);
+#endif // x64
 
-    float adblue_cap = adblue_cap_cfg ? adblue_cap_cfg->value.value_float.value : 80.0f;
-
-    // TODO: Different math needed for 32-bit builds!
-
-    // pointer has enough room for our validation, to tell whether a value
-    // is within our current memory address chunk.
-    min_ptr = ref_ptr - 0x1000000000;
-    max_ptr = ref_ptr + 0x1000000000;
-
-    // The search pointer limit should be narrower so that the game doesn't
-    // hang for too long searching for the value.
-    uintptr_t min_search_ptr = ref_ptr - 0x2000000;
-    uintptr_t max_search_ptr = ref_ptr + 0x2000000;
-
-    log("Ref ptr: %p; address interval: [0x%016llx:0x%016llx]", ref_ptr, min_ptr, max_ptr);
-
-    bool search_up = true;
-    unsigned long long amplitude = 1, checkcnt = 0;
-    uintptr_t* cur_ptr = (uintptr_t*)ref_ptr;
-    uintptr_t cur_addr = 0; // = (uintptr_t)cur_ptr;
-    uintptr_t cur_val = 0; // = (uintptr_t)*cur_ptr;
-    unsigned int guard = 0;
+    const scs_named_value_t* const fuel_capacity_cfg = find_attribute(*info, SCS_TELEMETRY_CONFIG_ATTRIBUTE_fuel_capacity, SCS_U32_NIL, SCS_VALUE_TYPE_float);
 
-    log("Searching game memory for actual truck tank capacity info.");
-    while (guard++ < 0x1fffffff) {
-        if (search_up) {
-            cur_ptr = (uintptr_t*)ref_ptr - amplitude;
-            search_up = false;
-            if ((uintptr_t)cur_ptr < min_search_ptr) {
-                log("Reached upper search memory boundary space (0x%p). Aborting search.", min_search_ptr);
-                break;
-            }
-        } else {
-            cur_ptr = (uintptr_t*)ref_ptr + amplitude;
-            amplitude++;
-            search_up = true;
-            if ((uintptr_t)cur_ptr > max_search_ptr) {
-                log("Reached lower search memory boundary space (0x%p). Aborting search.", max_search_ptr);
-                break;
-            }
-        }
+    const scs_named_value_t* const rpm_limit_cfg = find_attribute(*info, SCS_TELEMETRY_CONFIG_ATTRIBUTE_rpm_limit, SCS_U32_NIL, SCS_VALUE_TYPE_float);
 
-        if (IsBadReadPtr(cur_ptr, sizeof(uintptr_t))) continue;
-
-        cur_addr = (uintptr_t)cur_ptr;
-        cur_val = (uintptr_t)*cur_ptr;
-
-        // If the "pointer" has an address pointing within our read-write memory space
-        if (BETWEEN(cur_val, min_ptr, max_ptr)) {
-            checkcnt++;
-            //log("cur_ptr:0x%08llx(%p), cur_addr:0x%08llx(%p), cur_val:0x%08llx(%p)", cur_ptr, cur_ptr, cur_addr, cur_addr, cur_val, cur_val);
-            if (validate_main_struct((uintptr_t*)cur_val, adblue_cap)) {
-                truck_info_with_capacity_t* truck_info = (truck_info_with_capacity_t*)cur_val;
-                log("Found truck structure address at 0x%08llx (pointer at 0x%08llx, actual value at 0x%08llx). Value: %1.4f",
-                    cur_val, cur_ptr, &(truck_info->f42_tank_cap), truck_info->f42_tank_cap);
-                truck_data_access.lock();
-                truck_data.fuel_max = truck_info->f42_tank_cap;
-                truck_data_access.unlock();
-                break;
-            }
-            /*if (validate_alt_struct((uintptr_t*)cur_val)) {
-                truck_data_access.lock();
-                truck_data.fuel_max = *(float*)((uintptr_t*)cur_val + 53);
-                truck_data_access.unlock();
-                break;
-            }*/
-        }
-    };
-    log("Search finished. Searched %llu potential pointers, over a distance of %llu 8-byte segments %s from the reference address [0x%08llx].",
-        checkcnt, amplitude, search_up ? "down" : "up", ref_ptr);
-#endif // x64
+    float fuel_max = fuel_capacity_cfg ? fuel_capacity_cfg->value.value_float.value : 200.0f;
+    float rpm_limit = rpm_limit_cfg ? rpm_limit_cfg->value.value_float.value : 2500.0f;
+    truck_info_t* data = truck_data.begin_write();
+    data->fuel_max = fuel_max;
+    data->rpm_limit = rpm_limit;
+    truck_data.end_write();
+    MarkTruckDataDirty(TRUCK_FIELD_FUEL_MAX | TRUCK_FIELD_RPM_LIMIT);
 
-    log("Received new truck configuration: fuel capacity: %1.2f", truck_data.fuel_max);
+    log("Received new truck configuration: fuel capacity: %1.2f", fuel_max);
+    SignalPoller();
 }
 
 /**
@@ -511,6 +536,17 @@ SCSAPI_RESULT scs_telemetry_init(const scs_u32_t version, const scs_telemetry_in
     log("Game session: %s (%s) v%u.%u", game_name, common->game_id,
         SCS_GET_MAJOR_VERSION(common->game_version), SCS_GET_MINOR_VERSION(common->game_version));
 
+    // G29LEDPLUGIN_RECORD=<file> records the session for G29LedReplay.
+    char record_path[MAX_PATH];
+    DWORD record_path_len = GetEnvironmentVariableA("G29LEDPLUGIN_RECORD", record_path, MAX_PATH);
+    if (record_path_len > 0 && record_path_len < MAX_PATH) {
+        if (telemetry_recorder.open(record_path, common->game_id, common->game_version) == S_OK) {
+            log("Recording telemetry to: %s", record_path);
+        } else {
+            logWarn("Unable to record telemetry to: %s", record_path);
+        }
+    }
+
     // Register for events. Note that failure to register those basic events
     // likely indicates invalid usage of the api or some critical problem. As the
     // example requires all of them, we can not continue if the registration fails.
@@ -518,7 +554,8 @@ SCSAPI_RESULT scs_telemetry_init(const scs_u32_t version, const scs_telemetry_in
     const bool events_registered =
         (version_params->register_for_event(SCS_TELEMETRY_EVENT_paused, telemetry_pause, NULL) == SCS_RESULT_ok) &&
         (version_params->register_for_event(SCS_TELEMETRY_EVENT_started, telemetry_pause, NULL) == SCS_RESULT_ok) &&
-        (version_params->register_for_event(SCS_TELEMETRY_EVENT_configuration, telemetry_configuration, NULL) == SCS_RESULT_ok)
+        (version_params->register_for_event(SCS_TELEMETRY_EVENT_configuration, telemetry_configuration, NULL) == SCS_RESULT_ok) &&
+        (version_params->register_for_event(SCS_TELEMETRY_EVENT_frame_end, telemetry_frame_end, NULL) == SCS_RESULT_ok)
         ;
     if (!events_registered) {
         // Registrations created by unsuccessfull initialization are
@@ -545,24 +582,30 @@ SCSAPI_RESULT scs_telemetry_init(const scs_u32_t version, const scs_telemetry_in
     retstat == SCS_RESULT_unsupported_type ? "unsupported type" : \
     retstat == SCS_RESULT_generic_error ? "generic error" : "unknown error"
 
-#define HANDLE_NOK(what) if(retstat != SCS_RESULT_ok) { \
-        logErr("Unable to register function to fetch " what ": %s", SCS_EtoS); \
-        return SCS_RESULT_generic_error; \
+    for (size_t i = 0; i < truck_channel_count; i++) {
+        const truck_channel_t& channel = truck_channels[i];
+        retstat = version_params->register_for_channel(
+            channel.name, SCS_U32_NIL, channel.type, SCS_TELEMETRY_CHANNEL_FLAG_none,
+            channel.type == SCS_VALUE_TYPE_bool ? update_bool_value : update_float_value,
+            const_cast<truck_channel_t*>(&channel));
+        if (retstat == SCS_RESULT_ok) continue;
+        // The gauge and the warnings it wakes up for can't go without their
+        // channels; the rest just stay at their defaults.
+        if (channel.policy == TRUCK_UPDATE_WAKE) {
+            logErr("Unable to register function to fetch channel %s: %s", channel.name, SCS_EtoS);
+            return SCS_RESULT_generic_error;
+        }
+        logWarn("Unable to register function to fetch channel %s: %s; going without it.", channel.name, SCS_EtoS);
     }
 
-#define REGISTER_TELEMETRY(channel, type, tdMember, desc) \
-    retstat = version_params->register_for_channel( \
-        SCS_TELEMETRY_TRUCK_CHANNEL_ ## channel, SCS_U32_NIL, \
-        SCS_VALUE_TYPE_ ## type, SCS_TELEMETRY_CHANNEL_FLAG_none, \
-        update_ ## type ## _value, &truck_data. ## tdMember); \
-    HANDLE_NOK(desc);
-
-    REGISTER_TELEMETRY(electric_enabled, bool, electricity, "truck electricity switched on");
-    REGISTER_TELEMETRY(fuel, float, fuel, "current fuel quantity in liters");
-
+    StartLogging();
     LoadController();
     InitTruckData();
     StartPolling();
+#ifdef x64
+    if (FAILED(OpenSignatureCache(common->game_id, common->game_version))) logWarn("Unable to locate the signature cache; every search will scan.");
+    if (StartCapacitySearch() != S_OK) logWarn("Unable to start the fuel capacity search thread; the game's figure will be used.");
+#endif
 
     log("G29LedPlugin: Initialization complete");
 
@@ -571,10 +614,20 @@ SCSAPI_RESULT scs_telemetry_init(const scs_u32_t version, const scs_telemetry_in
 
 SCSAPI_VOID scs_telemetry_shutdown() {
     log("G29LedPlugin: Shutting down.");
-    game_log = nullptr;
 
+#ifdef x64
+    StopCapacitySearch();
+    StopPointerSearchThreads();
+    CloseSignatureCache();
+#endif
     StopPolling();
     UnloadController();
+    LogTruckChannelStats();
+    telemetry_recorder.close();
+    StopLogging();
+
+    // The game's log is still usable until we return from here.
+    game_log = nullptr;
 }
 
 BOOL APIENTRY DllMain( HMODULE hModule,
@@ -1,61 +1,94 @@
 #include "pch.h"
 #include "g29led.h"
 #include "truck.h"
+#include "hidtransport.h"
+#include "hidwriter.h"
+#include "leddither.h"
+#include "ledcompositor.h"
+#include "ledeffects.h"
+#include "poller.h"
+#include "quantizer.h"
+
+#include <atomic>
+#include <mmsystem.h>
+
+#pragma comment(lib, "winmm.lib")
+
+// Any wheel of wheels.h we can drive the LEDs of. Called for each device
+// enumerated, and from a system thread for arrivals; wheels we know but
+// can't drive are noted to tell why they're left alone.
+static std::atomic<const wheel_model_t*> unsupportedWheel(nullptr);
+static const wheel_model_t* unsupportedLogged = nullptr;
+
+static bool matchWheel(const hid_device_id_t& found, void* context) {
+    const wheel_model_t* model = FindWheel(found);
+
+    if (model == nullptr) return false;
+    if (model->led_encoding == WHEEL_LEDS_NONE) {
+        unsupportedWheel = model;
+        return false;
+    }
+    return true;
+}
 
-#include <hidsdi.h>
-#include <SetupAPI.h>
-#include <time.h>
-
-#define G29_LED_00000 0x00
-#define G29_LED_10000 0x01
-#define G29_LED_01000 0x02
-#define G29_LED_11000 0x03
-#define G29_LED_00100 0x04
-#define G29_LED_10100 0x05
-#define G29_LED_01100 0x06
-#define G29_LED_11100 0x07
-#define G29_LED_00010 0x08
-#define G29_LED_10010 0x09
-#define G29_LED_01010 0x0a
-#define G29_LED_11010 0x0b
-#define G29_LED_00110 0x0c
-#define G29_LED_10110 0x0d
-#define G29_LED_01110 0x0e
-#define G29_LED_11110 0x0f
-#define G29_LED_00001 0x10
-#define G29_LED_10001 0x11
-#define G29_LED_01001 0x12
-#define G29_LED_11001 0x13
-#define G29_LED_00101 0x14
-#define G29_LED_10101 0x15
-#define G29_LED_01101 0x16
-#define G29_LED_11101 0x17
-#define G29_LED_00011 0x18
-#define G29_LED_10011 0x19
-#define G29_LED_01011 0x1a
-#define G29_LED_11011 0x1b
-#define G29_LED_00111 0x1c
-#define G29_LED_10111 0x1d
-#define G29_LED_01111 0x1e
-#define G29_LED_11111 0x1f
-
-#define G29_LED_NONE G29_LED_00000
-#define G29_LED_ALL G29_LED_11111
-
-// FIXME: Use Regexp to match the device.
-#define G29_sVPID L"VID_046D&PID_C24F&"
-#define G29_sMI L"&MI_00"
-
-static bool initialized = false;
+static const hid_device_filter_t WHEEL_FILTER = { matchWheel, nullptr };
+
+// absent -> opening -> ready, and back to absent if it can't be found or
+// failed if it can't be set up. A ready controller that fails a write is
+// closed and becomes failed; either way it is reopened with the discovery
+// backoff below, right away if it is plugged back in, and the LEDs are
+// sent again as soon as it is ready.
+enum controller_state_t {
+    CONTROLLER_ABSENT,
+    CONTROLLER_OPENING,
+    CONTROLLER_READY,
+    CONTROLLER_FAILED
+};
+static const char* controllerStateNames[] = { "absent", "opening", "ready", "failed" };
+static controller_state_t controllerState = CONTROLLER_ABSENT;
 static USHORT HIDPayloadLen = 0;
-static WCHAR* HIDPath;
-static HANDLE HIDHandle;
+static hid_transport_t* HIDTransport = nullptr;
+static hid_report_t HIDReport; // kept while the plugin is loaded, across controllers
+static const wheel_model_t* wheel = nullptr; // the one opened, set while ready
+
+// Whatever the wheel may be showing when that isn't known: after opening it
+// or failing to send it an update.
+#define LED_STATE_UNKNOWN 0xff
+
+static unsigned char ledState = LED_STATE_UNKNOWN;
+static unsigned char liveState = G29_LED_NONE; // what the gauge shows when no effect plays
+static led_animation_t animation; // timed on PollerClock(), like the timers that drive it
+
+// What each user of the LEDs wants shown, added up by presentLEDs(): the
+// gauge (or its dithering frames) at the bottom, warnings blinking over it
+// and effects on top of everything.
+static led_layer_t gaugeLayer("gauge", 0, LED_BLEND_REPLACE, G29_LED_ALL);
+static led_layer_t warningLayer("warning", 10, LED_BLEND_INVERT, G29_LED_10001);
+static led_layer_t effectLayer("effect", 20, LED_BLEND_REPLACE, G29_LED_ALL);
+static led_layer_t* const ledLayers[] = { &gaugeLayer, &warningLayer, &effectLayer };
+static led_compositor_t compositor(ledLayers, sizeof(ledLayers) / sizeof(ledLayers[0]));
+
+struct compositor_stats_t {
+    unsigned long long compositions;
+    unsigned long long reports; // compositions that changed the LEDs
+};
+static compositor_stats_t compositorStats;
 
-static unsigned char ledState = G29_LED_NONE;
+// The outer LEDs flip for half of each period while the brake air pressure
+// is low.
+#define WARNING_BLINK_MS 500
+static bool airPressureWarning = false;
 static unsigned char prevLedState = ledState;
 static float current_fuel;
 static float max_fuel;
 
+// Fill ratios splitting the gauge's states. A level is only left once the
+// ratio gets this far past its bounds, so fuel sloshing around a threshold
+// doesn't toggle the LEDs.
+static const float fillThresholds[] = { 0.15f, 0.25f, 0.50f, 0.75f };
+#define FILL_HYSTERESIS 0.01f
+static level_quantizer_t fillLevel(fillThresholds, sizeof(fillThresholds) / sizeof(float), FILL_HYSTERESIS);
+
 static const unsigned char fillStates[] = {
     G29_LED_00000,
     G29_LED_00001,
@@ -65,344 +98,735 @@ static const unsigned char fillStates[] = {
     G29_LED_11111
 };
 
-static time_t lastInit = time(0);
-
-static void detailedError(const WCHAR* msg) {
-    LPVOID lpMsgBuf;
-    DWORD leid = GetLastError();
-    FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-        NULL,
-        leid,
-        0,
-        (LPWSTR)&lpMsgBuf,
-        0, NULL);
-
-    logErr(L"Error: %s: %s (0x%x)", msg, (LPWSTR)lpMsgBuf, leid);
-    LocalFree(lpMsgBuf);
+// Shift lights: LEDs light up from the left as the engine nears rpm_limit,
+// at these fractions of it unless G29LEDPLUGIN_RPM_THRESHOLDS says otherwise.
+static const unsigned char rpmStates[] = {
+    G29_LED_00000,
+    G29_LED_10000,
+    G29_LED_11000,
+    G29_LED_11100,
+    G29_LED_11110,
+    G29_LED_11111
+};
+#define RPM_THRESHOLD_COUNT (sizeof(rpmStates) / sizeof(unsigned char) - 1)
+static float rpmThresholds[RPM_THRESHOLD_COUNT] = { 0.60f, 0.70f, 0.80f, 0.88f, 0.95f };
+#define RPM_HYSTERESIS 0.01f
+static level_quantizer_t rpmLevel(rpmThresholds, RPM_THRESHOLD_COUNT, RPM_HYSTERESIS);
+
+// RPM changes every frame, faster than the wheel takes LED reports. Updates
+// are spaced at least this much, or twice the average write time if the
+// wheel is slower; states held back meanwhile are replaced by newer ones.
+#define RPM_MIN_INTERVAL_US 8000
+
+static bool rpmGauge = false;
+static bool gaugePending = false;
+static long long gaugePendingOrigin = 0;
+static LARGE_INTEGER lastGaugeWrite;
+static LARGE_INTEGER qpcFreq;
+
+struct gauge_stats_t {
+    unsigned long long frames; // changes of the gauge's channels handled
+    unsigned long long updates; // LED updates made for them
+    unsigned long long skipped; // changes that left the gauge's level alone
+    unsigned long long held; // of those, changes the hysteresis alone held back
+    unsigned long long dropped; // states replaced before they could be sent
+    long long first_frame;
+    long long last_frame;
+};
+static gauge_stats_t gaugeStats;
+
+// G29LEDPLUGIN_DITHER=<levels> shows the fuel gauge in between its states:
+// the LED after the ones lit brightens from a threshold to the next, in that
+// many steps, by blinking it faster than the eye follows. Frames are
+// LED_DITHER_MIN_FRAME_US apart or what the wheel sustains, and the levels
+// are cut to what repeats within LED_DITHER_MAX_PERIOD_US at that pace.
+static unsigned int ditherLevels = 0; // 0: off
+static led_dither_t fillDither;
+static unsigned int fillStep = 0; // gauge state * ditherLevels + duty level
+static bool dithering = false; // frames are due
+static long long ditherOrigin = 0;
+
+struct dither_stats_t {
+    unsigned long long frames;
+    unsigned long long reports; // frames that changed the LEDs
+    long long ticks; // spent computing and queueing frames
+    long long first_frame;
+    long long last_frame;
+};
+static dither_stats_t ditherStats;
+
+// Every deadline of the LEDs is a timer on the poller's wheel, which sleeps
+// until the first one. Any number of them run at once, and stopping one
+// costs nothing; they all run on the poller thread.
+static void onAnimationFrame(timer_entry_t* timer, void* context);
+static void onGaugeDue(timer_entry_t* timer, void* context);
+static void onDitherFrame(timer_entry_t* timer, void* context);
+static void onDiscoveryDue(timer_entry_t* timer, void* context);
+static void onLayerExpiry(timer_entry_t* timer, void* context);
+static void onWarningBlink(timer_entry_t* timer, void* context);
+static timer_entry_t animationTimer(onAnimationFrame);
+static timer_entry_t gaugeTimer(onGaugeDue); // the state the rate limit held back
+static timer_entry_t ditherTimer(onDitherFrame);
+static timer_entry_t discoveryTimer(onDiscoveryDue);
+static timer_entry_t layerTimer(onLayerExpiry); // the first layer lifetime to end
+static timer_entry_t warningTimer(onWarningBlink);
+static HRESULT timerResult = S_OK; // the first failure of the timers run
+
+// While the wheel can't be found, every LED update would look for it again.
+// Lookups are spaced out instead, doubling the wait after each failure up to
+// the maximum; a hotplug notification for the wheel cuts the wait short.
+#define DISCOVERY_BACKOFF_MIN_MS 250
+#define DISCOVERY_BACKOFF_MAX_MS 30000
+#define DISCOVERY_RATE_WINDOW_MS 60000
+
+static DWORD discoveryBackoff = 0;
+static ULONGLONG nextDiscovery = 0;
+static std::atomic<bool> deviceArrived(false);
+static bool watchingArrivals = false;
+static ULONGLONG discoveryWindowStart = 0;
+static unsigned long long discoveryWindowEnumerations = 0;
+
+// G29LEDPLUGIN_DEVICE=mock swaps the wheel for a fake device.
+static bool useMockDevice() {
+    char value[16];
+    DWORD len = GetEnvironmentVariableA("G29LEDPLUGIN_DEVICE", value, sizeof(value));
+    return len > 0 && len < sizeof(value) && _stricmp(value, "mock") == 0;
 }
 
 static HRESULT loadHID() {
-    HANDLE hidHandle = CreateFile(HIDPath, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    HIDPayloadLen = HIDTransport->output_report_size();
 
-    if (hidHandle == INVALID_HANDLE_VALUE) {
-        detailedError(L"Cannot open joystick for reading its HID parameters");
-        return GetLastError();
+    // Every report is built in this buffer from now on; reopening the wheel
+    // reuses it.
+    if (!HIDReport.init(HIDPayloadLen)) {
+        logErr("HID device report packet size smaller than packets we need to send (%i/%i).\n", HIDPayloadLen, HID_COMMAND_LEN + 1);
+        return ERROR_DEVICE_ENUMERATION_ERROR;
     }
 
-    PHIDP_PREPARSED_DATA data;
-    if (!HidD_GetPreparsedData(hidHandle, &data)) {
-        detailedError(L"Unable to fetch joystick's HID pre-parsed data");
-        return GetLastError();
+    return StartHIDWriter(HIDTransport, &HIDReport);
+}
+
+static void setControllerState(controller_state_t state) {
+    if (state == controllerState) return;
+    log("Controller %s -> %s.", controllerStateNames[controllerState], controllerStateNames[state]);
+    controllerState = state;
+}
+
+static bool controllerReady() {
+    return controllerState == CONTROLLER_READY || LoadController() == S_OK;
+}
+
+// A write failed: the wheel was most likely unplugged. Drops it so the next
+// update (or TickLEDs()) opens it again.
+static void controllerLost(HRESULT error) {
+    if (controllerState != CONTROLLER_READY) return;
+
+    logErr("Lost the controller (error 0x%x).", error);
+    StopHIDWriter(false);
+    HIDTransport->close();
+    ledState = LED_STATE_UNKNOWN;
+    discoveryBackoff = 0;
+    nextDiscovery = 0;
+    setControllerState(CONTROLLER_FAILED);
+}
+
+// Hands the command over to the HID writer thread. When `coalesce` is set,
+// the command replaces any previous coalescing command not yet written.
+static HRESULT sendHIDPayload(const hid_command_t& command, bool coalesce = false, long long origin = 0) {
+    HRESULT result;
+
+    if (!controllerReady()) return ERROR_DEVICE_NOT_AVAILABLE;
+
+    if (!HIDReport.ready()) {
+        logErr("Tried to send HID command before complete initialization.\n");
+        return ERROR_DEVICE_NOT_AVAILABLE;
     }
 
-    HIDP_CAPS hCaps;
-    if (HidP_GetCaps(data, &hCaps) != HIDP_STATUS_SUCCESS) {
-        HidD_FreePreparsedData(data);
-        detailedError(L"Unable to fetch joystick's HID capabilities");
-        return GetLastError();
+    if (HIDTransport == nullptr || !HIDTransport->is_open()) {
+        logErr("Error: Joystick access handle not available while trying to change LEDs.");
+        return ERROR_INVALID_HANDLE;
     }
-    HidD_FreePreparsedData(data);
 
-    HIDPayloadLen = hCaps.OutputReportByteLength;
-    log("Joystick HID packet size: %u bytes.\n", HIDPayloadLen);
+    result = QueueHIDCommand(command, coalesce, origin);
+    if (result != S_OK && result != HRESULT_FROM_WIN32(ERROR_BUSY)) controllerLost(result);
+    return result;
+}
+
+static HRESULT updateLEDs(unsigned char new_state, long long origin = 0) {
+    HRESULT result;
 
-    CloseHandle(hidHandle);
+    if (new_state == ledState) return S_OK;
+    ledState = new_state;
+    // The encoding depends on the wheel, only known once it's ready.
+    result = controllerReady() ? sendHIDPayload(EncodeWheelLEDs(*wheel, ledState), true, origin) : ERROR_DEVICE_NOT_AVAILABLE;
+    // Send it again next time, rather than assume it got there.
+    if (result != S_OK) ledState = LED_STATE_UNKNOWN;
+    return result;
+}
 
-    HIDHandle = CreateFile(HIDPath, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+static float fillState(const truck_info_t& current) {
+    return current.get(TRUCK_FUEL) / current.fuel_max;
+}
 
-    if (HIDHandle == INVALID_HANDLE_VALUE) {
-        detailedError(L"Cannot open the joystick for sending HID data");
-        return GetLastError();
-    }
+// Shows what the layers add up to, only sending a report if the wheel isn't
+// showing that already.
+static HRESULT presentLEDs(long long origin = 0) {
+    unsigned long long now = PollerClock();
+    unsigned char composite = compositor.compose(now);
+    unsigned long long expiry = compositor.next_expiry();
 
-    return S_OK;
+    if (expiry == LED_LAYER_FOREVER) CancelPollTimer(&layerTimer);
+    else SchedulePollTimer(&layerTimer, expiry > now ? expiry - now : 0);
+
+    compositorStats.compositions++;
+    if (composite == ledState) return S_OK;
+    compositorStats.reports++;
+    return updateLEDs(composite, origin);
 }
 
-static HRESULT sendHIDPayload(unsigned char cmd, unsigned char arg1 = 0x00, unsigned char arg2 = 0x00, unsigned char arg3 = 0x00, unsigned char arg4 = 0x00, unsigned char arg5 = 0x00, unsigned char arg6 = 0x00) {
-    unsigned char* payload;
-    unsigned short idx;
-    DWORD wrCnt;
+// Where the fill ratio sits in dither steps: step k * ditherLevels lights
+// fillStates[k + 1], the steps after it the next LED increasingly.
+static unsigned int fillDitherStep(float fill_state) {
+    const unsigned int count = sizeof(fillThresholds) / sizeof(float);
+    float low = 0;
 
-    if (!initialized && !(LoadController() == S_OK)) return ERROR_DEVICE_NOT_AVAILABLE;
+    for (unsigned int k = 0; k < count; k++) {
+        if (fill_state < fillThresholds[k]) {
+            return k * ditherLevels + fillDither.step((fill_state - low) / (fillThresholds[k] - low));
+        }
+        low = fillThresholds[k];
+    }
+    return count * ditherLevels; // NaN too
+}
 
-    if (HIDPayloadLen == 0) {
-        logErr("Tried to send HID command before complete initialization.\n");
-        return ERROR_DEVICE_NOT_AVAILABLE;
-    } else if (HIDPayloadLen < 8) {
-        logErr("HID device report packet size smaller than packets we need to send (%i/%i).\n", HIDPayloadLen, 8);
-        return ERROR_DEVICE_ENUMERATION_ERROR;
+static unsigned char ledStateFromFillState() {
+    float fill_state;
+    truck_info_t current = truck_data.read();
+    // TODO: make blink effect (so never return early)
+    if (current.get(TRUCK_FUEL) != current_fuel || current.fuel_max != max_fuel) {
+        current_fuel = current.get(TRUCK_FUEL);
+        max_fuel = current.fuel_max;
     }
 
-    payload = new unsigned char[HIDPayloadLen + 1];
+    fill_state = fillState(current);
+    logDebugEvery(2, "Fuel: %1.2f / %1.2f (%1.2f)", current_fuel, max_fuel, fill_state);
+    if (ditherLevels) {
+        unsigned int state = (fillStep = fillDitherStep(fill_state)) / ditherLevels + 1;
+        fillDither.set(fillStates[state], state + 1 < sizeof(fillStates) ? fillStates[state + 1] : 0, fillStep % ditherLevels);
+    }
+    // Even an empty tank leaves the first LED lit.
+    return fillStates[fillLevel.quantize(fill_state) + 1];
+}
 
-    ZeroMemory(payload, HIDPayloadLen + 1);
+static unsigned char ledStateFromRPM() {
+    truck_info_t current = truck_data.read();
+    float limit = current.rpm_limit > 0 ? current.rpm_limit : 2500.0f;
+    float ratio = current.get(TRUCK_ENGINE_RPM) / limit;
 
-    idx = 1;
-    payload[idx++] = cmd;
-    payload[idx++] = arg1;
-    payload[idx++] = arg2;
-    payload[idx++] = arg3;
-    payload[idx++] = arg4;
-    payload[idx++] = arg5;
-    payload[idx++] = arg6;
+    if (rpmLevel.holds(ratio)) gaugeStats.held++;
+    return rpmStates[rpmLevel.quantize(ratio)];
+}
 
-    if (HIDHandle == INVALID_HANDLE_VALUE) {
-        SetLastError(ERROR_INVALID_HANDLE);
-        logErr("Error: Joystick access handle not available while trying to change LEDs.");
-        return GetLastError();
+// Reads "0.6,0.7,0.8,0.88,0.95" like lists of increasing fractions of the
+// rpm limit. Keeps the defaults if it doesn't hold one per LED.
+static void loadRPMThresholds() {
+    char value[128];
+    float thresholds[RPM_THRESHOLD_COUNT];
+    DWORD len = GetEnvironmentVariableA("G29LEDPLUGIN_RPM_THRESHOLDS", value, sizeof(value));
+    if (len == 0 || len >= sizeof(value)) return;
+
+    char* next = value;
+    for (size_t i = 0; i < RPM_THRESHOLD_COUNT; i++) {
+        char* end;
+        thresholds[i] = strtof(next, &end);
+        if (end == next || (i > 0 && thresholds[i] < thresholds[i - 1]) || (*end != ',' && i + 1 < RPM_THRESHOLD_COUNT)) {
+            logWarn("Ignoring G29LEDPLUGIN_RPM_THRESHOLDS=%s: expected %u increasing fractions of the rpm limit.", value, (unsigned)RPM_THRESHOLD_COUNT);
+            return;
+        }
+        next = end + 1;
     }
+    memcpy(rpmThresholds, thresholds, sizeof(rpmThresholds));
+}
 
-    if (!WriteFile(HIDHandle, payload, HIDPayloadLen, &wrCnt, NULL)) {
-        logErr("Tried to write: 0x00,0x%02x,0x%02x,0x%02x,0x%02x,0x%02x,0x%02x,0x%02x.\n",
-            cmd, arg1, arg2, arg3, arg4, arg5, arg6);
-        detailedError(L"Cannot write data to joystick");
-        return GetLastError();
+static void loadDitherLevels() {
+    char value[16];
+    DWORD len = GetEnvironmentVariableA("G29LEDPLUGIN_DITHER", value, sizeof(value));
+    ditherLevels = 0;
+    if (len == 0 || len >= sizeof(value)) return;
+
+    unsigned long levels = strtoul(value, nullptr, 10);
+    if (levels < 2 || levels > LED_DITHER_MAX_LEVELS) {
+        logWarn("Ignoring G29LEDPLUGIN_DITHER=%s: expected 2 to %u levels.", value, (unsigned)LED_DITHER_MAX_LEVELS);
+        return;
+    }
+    ditherLevels = led_dither_t::fit_levels((unsigned int)levels, LED_DITHER_MIN_FRAME_US);
+    if (ditherLevels < levels) {
+        logWarn("G29LEDPLUGIN_DITHER=%s: using %u levels, as more would blink visibly.", value, ditherLevels);
     }
+    fillDither.set_levels(ditherLevels);
+}
 
-    return S_OK;
+// G29LEDPLUGIN_MODE=rpm shows shift lights instead of the fuel gauge. Must
+// be called before the poller starts.
+void SelectGauge() {
+    char value[16];
+    DWORD len = GetEnvironmentVariableA("G29LEDPLUGIN_MODE", value, sizeof(value));
+
+    QueryPerformanceFrequency(&qpcFreq);
+    rpmGauge = len > 0 && len < sizeof(value) && _stricmp(value, "rpm") == 0;
+    memset(&gaugeStats, 0, sizeof(gaugeStats));
+    memset(&ditherStats, 0, sizeof(ditherStats));
+    memset(&compositorStats, 0, sizeof(compositorStats));
+    fillLevel.reset();
+    rpmLevel.reset();
+    fillStep = 0;
+    if (rpmGauge) {
+        loadRPMThresholds();
+        log("Showing shift lights at %.2f, %.2f, %.2f, %.2f and %.2f of the rpm limit.",
+            rpmThresholds[0], rpmThresholds[1], rpmThresholds[2], rpmThresholds[3], rpmThresholds[4]);
+    } else {
+        loadDitherLevels();
+        if (ditherLevels) log("Showing the fuel gauge, dithered in %u levels between states.", ditherLevels);
+        else log("Showing the fuel gauge.");
+    }
+    WakeOnTruckData(TRUCK_FIELD_ENGINE_RPM, rpmGauge);
 }
 
-static HRESULT updateLEDs(unsigned char new_state) {
-    if (new_state != ledState) {
-        ledState = new_state;
-        return sendHIDPayload(0xf8, 0x12, ledState, 0x00, 0x00, 0x00, 0x01);
-    } else return S_OK;
+// Whether the changes the poller just took move the gauge shown. The fuel
+// gauge only moves when its quantized level does; engine speed is left to
+// UpdateRPMLevel(), which keeps its own rate limit.
+bool GaugeChanged(const truck_info_t& current, const truck_info_t& last, unsigned int dirty) {
+    if (rpmGauge) return (dirty & (TRUCK_FIELD_ENGINE_RPM | TRUCK_FIELD_RPM_LIMIT)) != 0;
+    if ((dirty & (TRUCK_FIELD_FUEL | TRUCK_FIELD_FUEL_MAX)) == 0) return false;
+
+    LARGE_INTEGER now;
+    float fill_state = fillState(current);
+    QueryPerformanceCounter(&now);
+    if (gaugeStats.frames++ == 0) gaugeStats.first_frame = now.QuadPart;
+    gaugeStats.last_frame = now.QuadPart;
+    if (fillLevel.changes(fill_state)) return true;
+    if (ditherLevels && fillDitherStep(fill_state) != fillStep) return true;
+
+    gaugeStats.skipped++;
+    if (fillLevel.holds(fill_state)) gaugeStats.held++;
+    return false;
 }
 
-static unsigned char ledStateFromFillState() {
-    float fill_state;
-    truck_data_access.lock();
-    // TODO: make blink effect (so never return early)
-    if (truck_data.fuel != current_fuel || truck_data.fuel_max != max_fuel) {
-        current_fuel = truck_data.fuel;
-        max_fuel = truck_data.fuel_max;
+// At least `min_us`, or twice the average write time if the wheel is slower.
+static unsigned long long writeIntervalUs(unsigned long long min_us) {
+    hid_writer_stats_t stats;
+    unsigned long long interval_us = min_us;
+
+    GetHIDWriterStats(&stats);
+    if (stats.written && 2 * stats.write_us_total / stats.written > interval_us) {
+        interval_us = 2 * stats.write_us_total / stats.written;
     }
-    truck_data_access.unlock();
+    return interval_us;
+}
 
-    fill_state = current_fuel / max_fuel;
-    log("Fuel: %1.2f / %1.2f (%1.2f)", current_fuel, max_fuel, fill_state);
-    if (fill_state < 0.15)      return G29_LED_00001;
-    else if (fill_state < 0.25) return G29_LED_00011;
-    else if (fill_state < 0.50) return G29_LED_00111;
-    else if (fill_state < 0.75) return G29_LED_01111;
-    else                        return G29_LED_11111;
+static long long gaugeIntervalTicks() {
+    return (long long)(writeIntervalUs(RPM_MIN_INTERVAL_US) * qpcFreq.QuadPart / 1000000);
 }
 
-HRESULT LoadController() {
-    log("Loading controller.");
+// Timer delays are in milliseconds, rounded up.
+static unsigned long long ticksToMs(long long ticks) {
+    return ticks > 0 ? (unsigned long long)((ticks * 1000 + qpcFreq.QuadPart - 1) / qpcFreq.QuadPart) : 0;
+}
+
+static HRESULT sendGauge(long long origin) {
+    QueryPerformanceCounter(&lastGaugeWrite);
+    gaugePending = false;
+    CancelPollTimer(&gaugeTimer);
+    gaugeStats.updates++;
+    compositor.show(&gaugeLayer, liveState);
+    return presentLEDs(origin);
+}
 
-    GUID hidIdx;
-    HDEVINFO hidDevsHandle;
-    SP_DEVINFO_DATA device;
-    SP_DEVICE_INTERFACE_DATA devData;
-    devData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
+// Frames are due while an LED is partly lit. The timer resolution is raised
+// meanwhile, or the poller's waits would round frames up to 15.6 ms.
+static void setDithering(bool on) {
+    if (on == dithering) return;
+    dithering = on;
+    if (on) {
+        timeBeginPeriod(1);
+        SchedulePollTimer(&ditherTimer, 0);
+    } else {
+        timeEndPeriod(1);
+        CancelPollTimer(&ditherTimer);
+        ditherOrigin = 0;
+    }
+}
 
-    PSP_DEVICE_INTERFACE_DETAIL_DATA devDetails;
+// The wheel got slower to write to than the levels allow for: fewer of them,
+// or none, and the gauge starts over from the fuel level.
+static HRESULT refitDitherLevels(unsigned int levels) {
+    if (levels) logWarn("Dithering the fuel gauge in %u levels instead of %u: the wheel takes longer to write to.", levels, ditherLevels);
+    else logWarn("Stopped dithering the fuel gauge: the wheel takes too long to write to.");
+    ditherLevels = levels;
+    if (levels) fillDither.set_levels(levels);
+    liveState = ledStateFromFillState();
+    setDithering(levels != 0 && !fillDither.steady());
+    if (dithering) {
+        SchedulePollTimer(&ditherTimer, 0);
+        return S_OK;
+    }
+    compositor.show(&gaugeLayer, liveState);
+    return presentLEDs();
+}
 
-    DWORD memberIdx = 0, dwSize, dwType;
-    PBYTE buf;
+static HRESULT sendDitherFrame() {
+    LARGE_INTEGER start, end;
+    unsigned char before = ledState;
+    unsigned long long interval_us = writeIntervalUs(LED_DITHER_MIN_FRAME_US);
+    unsigned int levels = led_dither_t::fit_levels(ditherLevels, interval_us);
+
+    if (levels != ditherLevels) return refitDitherLevels(levels);
+
+    QueryPerformanceCounter(&start);
+    compositor.show(&gaugeLayer, fillDither.frame());
+    HRESULT result = presentLEDs(ditherOrigin);
+    QueryPerformanceCounter(&end);
+
+    ditherOrigin = 0;
+    SchedulePollTimer(&ditherTimer, (interval_us + 999) / 1000);
+    if (ditherStats.frames++ == 0) ditherStats.first_frame = start.QuadPart;
+    ditherStats.last_frame = start.QuadPart;
+    if (ledState != before) ditherStats.reports++;
+    ditherStats.ticks += end.QuadPart - start.QuadPart;
+    return result;
+}
 
-    unsigned short loopguard;
+// Runs on a system thread.
+static void onDeviceArrival(void* context) {
+    deviceArrived = true;
+    SignalPoller();
+}
 
-    // TODO: Check last init attempt time to avoid init attempt flooding
+// Logs how many full device enumerations ran in each minute they did.
+static void logDiscoveryRate(ULONGLONG now) {
+    hid_discovery_stats_t stats;
 
-    HidD_GetHidGuid(&hidIdx);
-    hidDevsHandle = SetupDiGetClassDevs(&hidIdx, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+    if (now - discoveryWindowStart < DISCOVERY_RATE_WINDOW_MS) return;
+    HIDTransport->discovery_stats(&stats);
+    if (stats.enumerations != discoveryWindowEnumerations) {
+        log("HID discovery: %llu device enumerations in the last %llu s.",
+            stats.enumerations - discoveryWindowEnumerations, (now - discoveryWindowStart) / 1000);
+    }
+    discoveryWindowStart = now;
+    discoveryWindowEnumerations = stats.enumerations;
+}
 
-    if (hidDevsHandle == INVALID_HANDLE_VALUE) {
-        detailedError(L"Unable to enumerate HID devices on system");
-        return ERROR_DEVICE_ENUMERATION_ERROR;
+HRESULT LoadController() {
+    HRESULT result;
+    ULONGLONG now = GetTickCount64();
+
+    if (HIDTransport == nullptr) {
+        HIDTransport = useMockDevice() ? CreateMockHIDTransport() : CreateHIDTransport();
+        watchingArrivals = HIDTransport->watch_arrivals(WHEEL_FILTER, onDeviceArrival, nullptr);
+        discoveryWindowStart = now;
+        discoveryWindowEnumerations = 0;
     }
+    logDiscoveryRate(now);
 
-    loopguard = 0;
-    while (true) {
-        if (loopguard++ > 200) {
-            logErr("Error: Iterated 200 times without listing all HID devices?\n");
-            return ERROR_INFLOOP_IN_RELOC_CHAIN;
-        }
+    if (controllerState == CONTROLLER_READY) return S_OK;
+    if (deviceArrived.exchange(false)) nextDiscovery = 0;
+    if (now < nextDiscovery) return ERROR_DEVICE_NOT_AVAILABLE;
 
-        device.cbSize = sizeof(SP_DEVINFO_DATA);
-        if (!SetupDiEnumDeviceInfo(hidDevsHandle, memberIdx, &device)) {
-            detailedError(L"Unable to locate a Logitech G29 steering wheel plugged to the system.");
-            return GetLastError();
+    log("Loading controller.");
+    setControllerState(CONTROLLER_OPENING);
+
+    result = HIDTransport->open(WHEEL_FILTER);
+    if (result != S_OK) {
+        const wheel_model_t* unsupported = unsupportedWheel.exchange(nullptr);
+        if (unsupported != nullptr && unsupported != unsupportedLogged) {
+            logWarn("Found a %s, but driving its LEDs isn't supported.", unsupported->name);
+            unsupportedLogged = unsupported;
         }
-
-        SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_HARDWAREID, &dwType, NULL, 0, &dwSize);
-        if (dwSize > 0 && dwSize < 16384) {
-            buf = (PBYTE)malloc(dwSize * sizeof(BYTE));
-
-            //printf("Allocated buf with %lu entries of %zi bytes.\n", dwSize, sizeof(BYTE));
-            if (SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_HARDWAREID, &dwType, buf, dwSize, NULL) &&
-                wcsstr((WCHAR*)buf, (WCHAR*)&G29_sVPID) && wcsstr((WCHAR*)buf, (WCHAR*)&G29_sMI)) {
-
-                log(L"Found: %s\n", (WCHAR*)buf);
-
-                SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_DEVICEDESC, &dwType, NULL, 0, &dwSize);
-                if (dwSize <= 0 || dwSize > 16384) {
-                    logErr(L"Error: Unable to fetch device description from: %ws\n", (WCHAR*)buf);
-                    return ERROR_INVALID_DEVICE_OBJECT_PARAMETER;
-                }
-
-                free(buf);
-                buf = (PBYTE)malloc(dwSize * sizeof(BYTE));
-
-                if (!SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_DEVICEDESC, &dwType, buf, dwSize, NULL)) {
-                    logErr(L"Error: Unable to fetch device description from: %ws\n", (WCHAR*)buf);
-                    detailedError(L"Unable to fetch device description");
-                    return GetLastError();
-                }
-
-                log(L"Device: %ws\n", (WCHAR*)buf);
-
-                SetupDiEnumDeviceInterfaces(hidDevsHandle, NULL, &hidIdx, memberIdx, &devData);
-                SetupDiGetDeviceInterfaceDetail(hidDevsHandle, &devData, NULL, 0, &dwSize, NULL);
-                if (dwSize < 1 || dwSize > 16384) {
-                    logErr("Error: Unable to get device details.\n");
-                    return ERROR_INVALID_DEVICE_OBJECT_PARAMETER;
-                }
-
-                devDetails = (PSP_INTERFACE_DEVICE_DETAIL_DATA)malloc(dwSize);
-                if (!devDetails) {
-                    SetLastError(ERROR_OUTOFMEMORY);
-                    detailedError(L"Unable to allocate memory to store device information");
-                    return GetLastError();
-                }
-                devDetails->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
-
-                if (!SetupDiGetDeviceInterfaceDetail(hidDevsHandle, &devData, devDetails, dwSize, &dwSize, NULL)) {
-                    detailedError(L"Unable to get device details.\n");
-                    return GetLastError();
-                }
-
-                dwSize = (lstrlen(devDetails->DevicePath) + 1) * sizeof(WCHAR);
-                HIDPath = (WCHAR*)malloc(dwSize);
-                memcpy_s(HIDPath, dwSize, devDetails->DevicePath, dwSize);
-                free(devDetails);
-                break;
-            }
-            free(buf);
+        setControllerState(CONTROLLER_ABSENT);
+    } else {
+        wheel = FindWheel(HIDTransport->device_id());
+        log("Controller: %s.", wheel->name);
+        result = loadHID();
+        if (result != S_OK) {
+            HIDTransport->close();
+            setControllerState(CONTROLLER_FAILED);
         }
-        memberIdx++;
+    }
+    if (result != S_OK) {
+        discoveryBackoff = discoveryBackoff == 0 ? DISCOVERY_BACKOFF_MIN_MS : discoveryBackoff * 2;
+        if (discoveryBackoff > DISCOVERY_BACKOFF_MAX_MS) discoveryBackoff = DISCOVERY_BACKOFF_MAX_MS;
+        nextDiscovery = now + discoveryBackoff;
+        log("Controller not available, next attempt in %u ms%s.", discoveryBackoff,
+            watchingArrivals ? " or once it is plugged in" : "");
+        return result;
     }
 
-    log(L"HID path: %s\n", HIDPath);
-
-    loadHID();
-    initialized = true;
+    discoveryBackoff = 0;
+    nextDiscovery = 0;
+    ledState = LED_STATE_UNKNOWN;
+    setControllerState(CONTROLLER_READY);
     return S_OK;
 }
 
 HRESULT UnloadController() {
-    CloseHandle(HIDHandle);
-    HIDHandle = INVALID_HANDLE_VALUE;
+    StopHIDWriter();
+    LogHIDWriterStats();
+    LogGaugeStats();
+    if (HIDTransport != nullptr) {
+        hid_discovery_stats_t stats;
+        HIDTransport->discovery_stats(&stats);
+        if (stats.enumerations || stats.cache_hits) {
+            log("HID discovery: %llu device enumerations, %llu cached device paths reused.", stats.enumerations, stats.cache_hits);
+        }
+        HIDTransport->unwatch_arrivals();
+        HIDTransport->close();
+        delete HIDTransport;
+        HIDTransport = nullptr;
+    }
     HIDPayloadLen = 0;
-    free(HIDPath);
-    HIDPath = NULL;
-    initialized = false;
+    setDithering(false);
+    wheel = nullptr;
+    unsupportedLogged = nullptr;
+    animation.cancel(PollerClock());
+    CancelPollTimer(&animationTimer);
+    compositor.hide(&effectLayer);
+    compositor.hide(&warningLayer);
+    airPressureWarning = false;
+    ledState = LED_STATE_UNKNOWN;
+    setControllerState(CONTROLLER_ABSENT);
+    watchingArrivals = false;
+    deviceArrived = false;
+    discoveryBackoff = 0;
+    nextDiscovery = 0;
 
     return S_OK;
 }
 
 HRESULT ClearLEDs() {
-    if (!initialized && !(LoadController() == S_OK)) return ERROR_DEVICE_NOT_AVAILABLE;
-
     log("Turning all LEDs off.");
-    return updateLEDs(G29_LED_NONE);
+    liveState = G29_LED_NONE;
+    animation.cancel(PollerClock());
+    CancelPollTimer(&animationTimer);
+    setDithering(false);
+    airPressureWarning = false;
+    CancelPollTimer(&warningTimer);
+    compositor.hide(&effectLayer);
+    compositor.hide(&warningLayer);
+    compositor.show(&gaugeLayer, G29_LED_NONE);
+    return presentLEDs();
 }
 
-HRESULT UpdateFuelLevel() {
-    if (!initialized && (LoadController() != S_OK)) return ERROR_DEVICE_NOT_AVAILABLE;
-    return updateLEDs(ledStateFromFillState());
+// `changed_at` is when the telemetry this update reflects arrived, if known.
+HRESULT UpdateFuelLevel(long long changed_at) {
+    // An effect playing picks the new gauge up on its next frame, and a
+    // reconnected wheel the latest one.
+    liveState = ledStateFromFillState();
+    gaugeStats.updates++;
+    if (ditherLevels) {
+        // The dithering timer sends the frames, from the next one on.
+        setDithering(!fillDither.steady());
+        if (dithering) {
+            if (ditherOrigin == 0) ditherOrigin = changed_at;
+            return S_OK;
+        }
+    }
+    compositor.show(&gaugeLayer, liveState);
+    return presentLEDs(changed_at);
 }
 
-#define UpdateChk(x) update_state = updateLEDs(x); if (update_state != S_OK) return update_state;
+// Effects only ever run from the poller thread: they are started here and
+// advanced by their timer, due whenever the LEDs change next.
+static HRESULT playEffect(const led_effect_t& effect) {
+    if (!controllerReady()) return ERROR_DEVICE_NOT_AVAILABLE;
 
-HRESULT InitFuelGaugeAnimation() {
-    DWORD delay = 50;
-    size_t i;
-    HRESULT update_state;
-    unsigned char animation[] = {
-        G29_LED_00000,
-        G29_LED_00001,
-        G29_LED_00010,
-        G29_LED_00100,
-        G29_LED_01000,
-        G29_LED_10000,
-        G29_LED_11000,
-        G29_LED_11100,
-        G29_LED_11110,
-        G29_LED_11111
-    };
-    unsigned char down_animation[] = {
-        G29_LED_11111,
-        G29_LED_01111,
-        G29_LED_00111,
-        G29_LED_00011,
-        G29_LED_00001,
-        G29_LED_00000
-    };
-
-    log("Playing \"truck electricity on\" animation.");
-    size_t anim_len = sizeof(animation) / sizeof(unsigned char);
-    unsigned char target_led_state = ledStateFromFillState();
-
-    for (i = 0; i < anim_len; i++) {
-        UpdateChk(animation[i]);
-        Sleep(delay);
+    log("Playing \"%s\" animation.", effect.name);
+    if (!animation.play(effect, ledState == LED_STATE_UNKNOWN ? G29_LED_NONE : ledState, liveState, PollerClock())) {
+        logErr("Animation \"%s\" is too long to play.", effect.name);
+        return E_INVALIDARG;
     }
+    SchedulePollTimer(&animationTimer, 0);
+    return S_OK;
+}
 
-    anim_len = sizeof(down_animation) / sizeof(unsigned char);
-    for (i = 0; i < anim_len; i++) {
-        UpdateChk(down_animation[i]);
-        if (down_animation[i] == target_led_state) break;
-        Sleep(delay);
-    }
+HRESULT UpdateRPMLevel(long long changed_at) {
+    LARGE_INTEGER now;
 
-    for (i = 0; i < 3; i++) {
-        Sleep(100);
-        UpdateChk(G29_LED_NONE);
-        Sleep(25);
-        UpdateChk(target_led_state);
-    }
+    QueryPerformanceCounter(&now);
+    if (gaugeStats.frames++ == 0) gaugeStats.first_frame = now.QuadPart;
+    gaugeStats.last_frame = now.QuadPart;
 
-    if (target_led_state == G29_LED_00001) {
-        for (i = 0; i < 5; i++) {
-            Sleep(100);
-            UpdateChk(G29_LED_NONE);
-            Sleep(50);
-            UpdateChk(target_led_state);
+    unsigned char state = ledStateFromRPM();
+    if (gaugePending && state != liveState) gaugeStats.dropped++;
+    liveState = state;
+    if (animation.active() || liveState == gaugeLayer.lit()) {
+        gaugePending = false;
+        CancelPollTimer(&gaugeTimer);
+        return S_OK;
+    }
+    if (!controllerReady()) return ERROR_DEVICE_NOT_AVAILABLE;
+
+    long long wait = lastGaugeWrite.QuadPart + gaugeIntervalTicks() - now.QuadPart;
+    if (wait > 0) {
+        // Its timer sends it once the interval is over.
+        if (!gaugePending) {
+            gaugePendingOrigin = changed_at;
+            SchedulePollTimer(&gaugeTimer, ticksToMs(wait));
         }
+        gaugePending = true;
+        return S_OK;
     }
+    return sendGauge(changed_at);
+}
 
-    return S_OK;
+HRESULT UpdateGauge(long long changed_at) {
+    return rpmGauge ? UpdateRPMLevel(changed_at) : UpdateFuelLevel(changed_at);
+}
+
+void LogGaugeStats() {
+    if (compositorStats.compositions) {
+        log("LED layers: %llu compositions, %llu changed the LEDs, %llu left them as they were.", compositorStats.compositions,
+            compositorStats.reports, compositorStats.compositions - compositorStats.reports);
+    }
+    if (gaugeStats.frames == 0) return;
+
+    double seconds = (double)(gaugeStats.last_frame - gaugeStats.first_frame) / qpcFreq.QuadPart;
+    if (rpmGauge) {
+        log("RPM gauge: %llu changes over %.1f s, %llu LED updates (%.1f/s), %llu dropped by the rate limit, %llu held by the hysteresis.",
+            gaugeStats.frames, seconds, gaugeStats.updates, seconds > 0 ? gaugeStats.updates / seconds : 0.0,
+            gaugeStats.dropped, gaugeStats.held);
+    } else {
+        log("Fuel gauge: %llu changes over %.1f s, %llu gauge updates, %llu skipped as the level stayed (%llu held by the hysteresis).",
+            gaugeStats.frames, seconds, gaugeStats.updates, gaugeStats.skipped, gaugeStats.held);
+    }
+    if (ditherStats.frames == 0) return;
+
+    seconds = (double)(ditherStats.last_frame - ditherStats.first_frame) / qpcFreq.QuadPart;
+    log("Dithering: %llu frames in %.1f s of dithering (%.1f/s), %llu LED reports (%.1f/s), %.0f ns per frame.",
+        ditherStats.frames, seconds, seconds > 0 ? ditherStats.frames / seconds : 0.0,
+        ditherStats.reports, seconds > 0 ? ditherStats.reports / seconds : 0.0,
+        (double)ditherStats.ticks * 1e9 / qpcFreq.QuadPart / ditherStats.frames);
+}
+
+HRESULT InitFuelGaugeAnimation() {
+    liveState = rpmGauge ? ledStateFromRPM() : ledStateFromFillState();
+    return playEffect(EFFECT_ELECTRICITY_ON);
+}
+
+// The game paused: dithering frames stop, and the timer resolution goes back
+// to normal, until the next gauge update. The gauge stays at its state.
+HRESULT PauseGauge() {
+    if (!dithering) return S_OK;
+    setDithering(false);
+    if (animation.active()) return S_OK;
+    compositor.show(&gaugeLayer, liveState);
+    return presentLEDs();
 }
 
 HRESULT ShutdownFuelGaugeAnimation() {
-    HRESULT update_state;
-    unsigned char current_led_state = ledState;
-
-    log("Playing \"truck electricity off\" animation.");
-
-    UpdateChk(G29_LED_NONE);
-    Sleep(25);
-    UpdateChk(current_led_state);
-    Sleep(200);
-    UpdateChk(G29_LED_NONE);
-    Sleep(30);
-    UpdateChk(current_led_state);
-    Sleep(10);
-    UpdateChk(G29_LED_NONE);
-    Sleep(45);
-    UpdateChk(current_led_state);
-    Sleep(160);
-    UpdateChk(G29_LED_NONE);
-    Sleep(50);
-    UpdateChk(current_led_state);
-    Sleep(25);
-    UpdateChk(G29_LED_NONE);
-    Sleep(70);
-    UpdateChk(current_led_state);
-    Sleep(10);
-    UpdateChk(G29_LED_NONE);
-    return S_OK;
-}
\ No newline at end of file
+    liveState = G29_LED_NONE;
+    setDithering(false);
+    return playEffect(EFFECT_ELECTRICITY_OFF);
+}
+
+// Stops the effect playing, if any. With a crossfade the LEDs still need
+// ticking for `crossfade_ms` until they settle on the gauge.
+void CancelAnimation(unsigned int crossfade_ms) {
+    if (!animation.active()) return;
+    log("Cancelling \"%s\" animation.", animation.name());
+    animation.cancel(PollerClock(), crossfade_ms);
+    SchedulePollTimer(&animationTimer, 0);
+}
+
+static void noteTimerResult(HRESULT result) {
+    if (timerResult == S_OK) timerResult = result;
+}
+
+// Shows the frame of the effect due, and once it's over the gauge again.
+static void onAnimationFrame(timer_entry_t* timer, void* context) {
+    unsigned int next;
+    unsigned char mask = animation.tick(PollerClock(), liveState, &next);
+
+    if (next != LED_NO_DEADLINE) SchedulePollTimer(timer, next);
+    if (animation.active()) {
+        compositor.show(&effectLayer, mask);
+    } else {
+        compositor.hide(&effectLayer);
+        // Dithering waits for effects to end; the gauge shows `mask` now.
+        if (dithering) SchedulePollTimer(&ditherTimer, 0);
+        else compositor.show(&gaugeLayer, mask);
+    }
+    noteTimerResult(presentLEDs());
+}
+
+static void onGaugeDue(timer_entry_t* timer, void* context) {
+    if (!gaugePending) return;
+    noteTimerResult(sendGauge(gaugePendingOrigin));
+}
+
+static void onDitherFrame(timer_entry_t* timer, void* context) {
+    if (animation.active()) return;
+    noteTimerResult(sendDitherFrame());
+}
+
+// Nothing to do but wake the poller up, for TickLEDs() to open the wheel.
+static void onDiscoveryDue(timer_entry_t* timer, void* context) {}
+
+static void onLayerExpiry(timer_entry_t* timer, void* context) {
+    noteTimerResult(presentLEDs());
+}
+
+// Lights the warning layer for half the period; its lifetime ends the rest.
+static void onWarningBlink(timer_entry_t* timer, void* context) {
+    compositor.show(&warningLayer, G29_LED_10001, PollerClock(), WARNING_BLINK_MS / 2);
+    SchedulePollTimer(timer, WARNING_BLINK_MS);
+    noteTimerResult(presentLEDs());
+}
+
+// Blinks a warning over whatever the LEDs show while `air_pressure` is set:
+// the poller tells whether the truck, powered and running, warns of low
+// brake air pressure.
+HRESULT UpdateWarnings(bool air_pressure) {
+    if (air_pressure == airPressureWarning) return S_OK;
+    airPressureWarning = air_pressure;
+    if (air_pressure) {
+        log("Brake air pressure warning on.");
+        SchedulePollTimer(&warningTimer, 0);
+        return S_OK;
+    }
+    log("Brake air pressure warning off.");
+    CancelPollTimer(&warningTimer);
+    compositor.hide(&warningLayer);
+    return presentLEDs();
+}
+
+// Called whenever the poller wakes up: keeps the wheel open and runs the
+// LED timers due. Once an effect ends, the LEDs are left showing the gauge.
+HRESULT TickLEDs() {
+    HRESULT result = TakeHIDWriteError();
+
+    if (result != S_OK) controllerLost(result);
+    result = S_OK;
+    if (controllerState != CONTROLLER_READY && HIDTransport != nullptr) {
+        if (LoadController() != S_OK) {
+            // Try again once the backoff is over; an arrival wakes us sooner.
+            // Timers still run meanwhile, failing quietly.
+            ULONGLONG now = GetTickCount64();
+            SchedulePollTimer(&discoveryTimer, nextDiscovery > now ? nextDiscovery - now : 0);
+            RunPollTimers();
+            return S_OK;
+        }
+        CancelPollTimer(&discoveryTimer);
+        // Reopened: show the wheel what it should have been showing, with
+        // the gauge state held back if any.
+        if (!dithering && !animation.active()) {
+            gaugePending = false;
+            CancelPollTimer(&gaugeTimer);
+            compositor.show(&gaugeLayer, liveState);
+        }
+        result = presentLEDs();
+    }
+
+    timerResult = S_OK;
+    RunPollTimers();
+    return result != S_OK ? result : timerResult;
+}
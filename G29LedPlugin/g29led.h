@@ -2,12 +2,22 @@
 #define __G29LED_H_INCLUDED__
 #include "pch.h"
 #include "log.h"
+#include "truck.h"
 
 HRESULT LoadController();
 HRESULT UnloadController();
 HRESULT ClearLEDs();
-HRESULT UpdateFuelLevel();
+HRESULT UpdateFuelLevel(long long changed_at = 0);
+HRESULT UpdateRPMLevel(long long changed_at = 0);
+void SelectGauge();
+bool GaugeChanged(const truck_info_t& current, const truck_info_t& last, unsigned int dirty);
+HRESULT UpdateGauge(long long changed_at = 0);
+HRESULT UpdateWarnings(bool air_pressure);
+HRESULT PauseGauge();
+void LogGaugeStats();
 HRESULT InitFuelGaugeAnimation();
 HRESULT ShutdownFuelGaugeAnimation();
+void CancelAnimation(unsigned int crossfade_ms = 0);
+HRESULT TickLEDs();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef __HIDMOCK_H_INCLUDED__
+#define __HIDMOCK_H_INCLUDED__
+#include <algorithm>
+#include "hidreport.h"
+
+// Fake G29 endpoint. It decodes the output reports it receives like the wheel
+// would, keeps the last LED states with the time they arrived, and measures
+// how long each took from the input that caused it (a telemetry update, a
+// key press) to reaching the "wheel".
+//
+// Shared by the plugin and the CLI, so it doesn't depend on the plugin's
+// precompiled header. Times are in caller supplied ticks (QueryPerformance-
+// Counter); it is not thread safe, so only the writing thread may use it
+// until writes stop.
+
+#define HID_MOCK_HISTORY 1024 // must be a power of two
+#define HID_MOCK_BUCKETS 32 // bucket i: latency below 2^i us
+
+struct hid_mock_led_t {
+    long long received; // ticks
+    long long origin; // ticks; 0 if the input wasn't timestamped
+    unsigned char mask;
+};
+
+struct hid_mock_latency_t {
+    unsigned long long samples;
+    unsigned long long buckets[HID_MOCK_BUCKETS];
+    unsigned long long p50_us; // upper bound of the bucket holding the percentile
+    unsigned long long p99_us;
+    unsigned long long max_us; // exact
+};
+
+class hid_mock_device_t {
+public:
+    explicit hid_mock_device_t(long long ticks_per_second = 1000000) :
+        reports(0), led_reports(0), frequency(ticks_per_second), max_us(0) {
+        memset(buckets, 0, sizeof(buckets));
+    }
+
+    unsigned long long reports; // every output report received
+    unsigned long long led_reports;
+
+    // Takes an output report (report ID first). Returns true if it was a
+    // well formed LED report.
+    bool receive(const unsigned char* report, size_t length, long long received, long long origin) {
+        reports++;
+        if (length < HID_COMMAND_LEN + 1 || report[1] != G29_CMD_EXTENDED || report[2] != G29_EXT_SET_LEDS) return false;
+
+        hid_mock_led_t& entry = history[led_reports & (HID_MOCK_HISTORY - 1)];
+        entry.received = received;
+        entry.origin = origin;
+        entry.mask = report[3] & 0x1f;
+        led_reports++;
+
+        if (origin != 0 && received >= origin) {
+            unsigned long long us = (unsigned long long)((received - origin) * 1000000 / frequency);
+            int bucket = 0;
+            while (bucket < HID_MOCK_BUCKETS - 1 && (1ULL << bucket) <= us) bucket++;
+            buckets[bucket]++;
+            if (us > max_us) max_us = us;
+        }
+        return true;
+    }
+
+    // Last LED state received, or -1 if none was.
+    int leds() const {
+        return led_reports ? history[(led_reports - 1) & (HID_MOCK_HISTORY - 1)].mask : -1;
+    }
+
+    // Copies up to `count` of the newest LED reports, oldest first. Returns
+    // how many were copied.
+    size_t recent(hid_mock_led_t* out, size_t count) const {
+        size_t kept = (size_t)std::min<unsigned long long>(led_reports, HID_MOCK_HISTORY);
+        if (count > kept) count = kept;
+        for (size_t i = 0; i < count; i++) {
+            out[i] = history[(led_reports - count + i) & (HID_MOCK_HISTORY - 1)];
+        }
+        return count;
+    }
+
+    void latency(hid_mock_latency_t* stats) const {
+        memcpy(stats->buckets, buckets, sizeof(buckets));
+        stats->samples = 0;
+        for (int i = 0; i < HID_MOCK_BUCKETS; i++) stats->samples += buckets[i];
+        stats->p50_us = percentile(stats->samples, 50);
+        stats->p99_us = percentile(stats->samples, 99);
+        stats->max_us = max_us;
+    }
+
+private:
+    long long frequency;
+    hid_mock_led_t history[HID_MOCK_HISTORY];
+    unsigned long long buckets[HID_MOCK_BUCKETS];
+    unsigned long long max_us;
+
+    unsigned long long percentile(unsigned long long samples, unsigned int pct) const {
+        unsigned long long rank = (samples * pct + 99) / 100, seen = 0;
+        if (samples == 0) return 0;
+        for (int i = 0; i < HID_MOCK_BUCKETS; i++) {
+            seen += buckets[i];
+            if (seen >= rank) return std::min(1ULL << i, max_us);
+        }
+        return max_us;
+    }
+};
+
+#endif
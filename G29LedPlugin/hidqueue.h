@@ -0,0 +1,120 @@
+#ifndef __HIDQUEUE_H_INCLUDED__
+#define __HIDQUEUE_H_INCLUDED__
+#include <atomic>
+#include "hidreport.h"
+
+// Shared by the plugin and the bench, so it doesn't depend on the plugin's
+// precompiled header.
+//
+// Commands on their way from the poller thread to the HID writer thread: a
+// bounded single-producer/single-consumer ring, so only one thread may
+// queue() and one other take next(). Commands queued with `coalesce` (LED
+// states) don't carry their payload in the ring; they leave a token and
+// store the payload in a mailbox instead. If the mailbox still holds a state
+// the writer didn't pick up yet, the new state just replaces it, so only the
+// newest LED state is ever written.
+
+#define HID_QUEUE_LEN 32 // must be a power of two
+
+// Commands are packed in the low 56 bits of a 64-bit word.
+#define HID_PENDING (1ULL << 63)
+#define HID_MAILBOX_TOKEN (1ULL << 62)
+
+enum hid_queue_result_t {
+    HID_QUEUED,
+    HID_QUEUE_COALESCED, // replaced a state still in the mailbox
+    HID_QUEUE_FULL
+};
+
+class hid_command_queue_t {
+public:
+    hid_command_queue_t() : head(0), tail(0), mailbox(0), mailbox_origin(0) {}
+
+    // Empties the queue. Neither thread may be using it meanwhile.
+    void reset() {
+        head = 0;
+        tail = 0;
+        mailbox = 0;
+        mailbox_origin = 0;
+    }
+
+    // `origin` is when the input that led to this command arrived, if known.
+    hid_queue_result_t queue(const hid_command_t& command, bool coalesce, long long origin) {
+        unsigned long long packed = pack(command) | HID_PENDING;
+
+        if (!coalesce) return push(packed, origin) ? HID_QUEUED : HID_QUEUE_FULL;
+
+        mailbox_origin = origin;
+        // The writer didn't pick the previous state up yet; its token is
+        // still queued and will now send this one instead.
+        if (mailbox.exchange(packed) & HID_PENDING) return HID_QUEUE_COALESCED;
+        if (push(HID_MAILBOX_TOKEN, 0)) return HID_QUEUED;
+        mailbox = 0;
+        return HID_QUEUE_FULL;
+    }
+
+    // Takes the next command to write, with its origin. Returns false once
+    // there's none left.
+    bool next(hid_command_t* command, long long* origin) {
+        unsigned long long entry;
+
+        while (pop(&entry, origin)) {
+            if (entry & HID_MAILBOX_TOKEN) {
+                entry = mailbox.exchange(0);
+                if (!(entry & HID_PENDING)) continue;
+                // May already belong to a newer state; close enough to time it.
+                *origin = mailbox_origin.load();
+            }
+            *command = unpack(entry);
+            return true;
+        }
+        return false;
+    }
+
+    hid_command_queue_t(const hid_command_queue_t&) = delete;
+    hid_command_queue_t& operator=(const hid_command_queue_t&) = delete;
+
+private:
+    unsigned long long entries[HID_QUEUE_LEN];
+    long long origins[HID_QUEUE_LEN]; // see hid_transport_t::set_report_origin()
+    std::atomic<unsigned int> head; // next slot the writer reads
+    std::atomic<unsigned int> tail; // next slot the poller fills
+    std::atomic<unsigned long long> mailbox;
+    std::atomic<long long> mailbox_origin;
+
+    static unsigned long long pack(const hid_command_t& command) {
+        unsigned long long packed = 0;
+        for (int i = 0; i < HID_COMMAND_LEN; i++) {
+            packed |= (unsigned long long)command.bytes[i] << (8 * i);
+        }
+        return packed;
+    }
+
+    static hid_command_t unpack(unsigned long long packed) {
+        hid_command_t command;
+        for (int i = 0; i < HID_COMMAND_LEN; i++) {
+            command.bytes[i] = (unsigned char)(packed >> (8 * i));
+        }
+        return command;
+    }
+
+    bool push(unsigned long long entry, long long origin) {
+        unsigned int slot = tail.load(std::memory_order_relaxed);
+        if (slot - head.load(std::memory_order_acquire) >= HID_QUEUE_LEN) return false;
+        entries[slot & (HID_QUEUE_LEN - 1)] = entry;
+        origins[slot & (HID_QUEUE_LEN - 1)] = origin;
+        tail.store(slot + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(unsigned long long* entry, long long* origin) {
+        unsigned int slot = head.load(std::memory_order_relaxed);
+        if (slot == tail.load(std::memory_order_acquire)) return false;
+        *entry = entries[slot & (HID_QUEUE_LEN - 1)];
+        *origin = origins[slot & (HID_QUEUE_LEN - 1)];
+        head.store(slot + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif
\ No newline at end of file
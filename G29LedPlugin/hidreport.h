@@ -0,0 +1,138 @@
+#ifndef __HIDREPORT_H_INCLUDED__
+#define __HIDREPORT_H_INCLUDED__
+#include <stdlib.h>
+#include <string.h>
+
+// Shared by the plugin and the CLI, so it doesn't depend on the plugin's
+// precompiled header.
+
+// Bytes following the report ID in every command we send to the wheel.
+#define HID_COMMAND_LEN 7
+
+// Logitech extended commands. All of them start with 0xf8.
+#define G29_CMD_EXTENDED 0xf8
+#define G29_EXT_REVERT_MODE 0x0a // revert identity on USB reset
+#define G29_EXT_SWITCH_MODE 0x09
+#define G29_EXT_SET_LEDS 0x12
+#define G29_EXT_SET_RANGE 0x81
+
+#define G29_MODE_G29 0x05
+
+// LED masks for EncodeLEDs(). The digits are the LEDs on the wheel from
+// left to right.
+#define G29_LED_00000 0x00
+#define G29_LED_10000 0x01
+#define G29_LED_01000 0x02
+#define G29_LED_11000 0x03
+#define G29_LED_00100 0x04
+#define G29_LED_10100 0x05
+#define G29_LED_01100 0x06
+#define G29_LED_11100 0x07
+#define G29_LED_00010 0x08
+#define G29_LED_10010 0x09
+#define G29_LED_01010 0x0a
+#define G29_LED_11010 0x0b
+#define G29_LED_00110 0x0c
+#define G29_LED_10110 0x0d
+#define G29_LED_01110 0x0e
+#define G29_LED_11110 0x0f
+#define G29_LED_00001 0x10
+#define G29_LED_10001 0x11
+#define G29_LED_01001 0x12
+#define G29_LED_11001 0x13
+#define G29_LED_00101 0x14
+#define G29_LED_10101 0x15
+#define G29_LED_01101 0x16
+#define G29_LED_11101 0x17
+#define G29_LED_00011 0x18
+#define G29_LED_10011 0x19
+#define G29_LED_01011 0x1a
+#define G29_LED_11011 0x1b
+#define G29_LED_00111 0x1c
+#define G29_LED_10111 0x1d
+#define G29_LED_01111 0x1e
+#define G29_LED_11111 0x1f
+
+#define G29_LED_NONE G29_LED_00000
+#define G29_LED_ALL G29_LED_11111
+
+struct hid_command_t {
+    unsigned char bytes[HID_COMMAND_LEN];
+};
+
+// Typed encoders for the commands we know. They only fill a fixed size
+// command, so they never allocate.
+inline hid_command_t EncodeHIDCommand(unsigned char cmd, unsigned char arg1 = 0x00, unsigned char arg2 = 0x00, unsigned char arg3 = 0x00, unsigned char arg4 = 0x00, unsigned char arg5 = 0x00, unsigned char arg6 = 0x00) {
+    hid_command_t command = { { cmd, arg1, arg2, arg3, arg4, arg5, arg6 } };
+    return command;
+}
+
+inline hid_command_t EncodeLEDs(unsigned char led_mask) {
+    return EncodeHIDCommand(G29_CMD_EXTENDED, G29_EXT_SET_LEDS, led_mask, 0x00, 0x00, 0x00, 0x01);
+}
+
+inline hid_command_t EncodeRevertMode() {
+    return EncodeHIDCommand(G29_CMD_EXTENDED, G29_EXT_REVERT_MODE);
+}
+
+inline hid_command_t EncodeSwitchMode(unsigned char mode, bool detach = true) {
+    return EncodeHIDCommand(G29_CMD_EXTENDED, G29_EXT_SWITCH_MODE, mode, 0x01, detach ? 0x01 : 0x00);
+}
+
+// Wheel rotation range, in degrees.
+inline hid_command_t EncodeRange(unsigned short degrees) {
+    return EncodeHIDCommand(G29_CMD_EXTENDED, G29_EXT_SET_RANGE, degrees & 0xff, (degrees >> 8) & 0xff);
+}
+
+// Output report buffer, allocated once and reused for every command written
+// afterwards, across devices too: it only grows if a device's reports are
+// longer than any seen before.
+class hid_report_t {
+public:
+    hid_report_t() : buffer(nullptr), length(0), capacity(0) {}
+    ~hid_report_t() { release(); }
+
+    // Sizes the report for the device's OutputReportByteLength. Returns
+    // false if it can't hold a command or the allocation fails.
+    bool init(unsigned short report_len) {
+        length = 0;
+        if (report_len < HID_COMMAND_LEN + 1) return false;
+        if (report_len > capacity) {
+            release();
+            buffer = (unsigned char*)malloc(report_len);
+            if (!buffer) return false;
+            capacity = report_len;
+        }
+        memset(buffer, 0, report_len);
+        length = report_len;
+        return true;
+    }
+
+    void release() {
+        free(buffer);
+        buffer = nullptr;
+        length = 0;
+        capacity = 0;
+    }
+
+    // Writes the command after the (zero) report ID and returns the report,
+    // `size()` bytes long. Bytes past the command always stay zero.
+    const unsigned char* build(const hid_command_t& command) {
+        memcpy(&buffer[1], command.bytes, HID_COMMAND_LEN);
+        return buffer;
+    }
+
+    const unsigned char* data() const { return buffer; }
+    unsigned short size() const { return length; }
+    bool ready() const { return length != 0; }
+
+    hid_report_t(const hid_report_t&) = delete;
+    hid_report_t& operator=(const hid_report_t&) = delete;
+
+private:
+    unsigned char* buffer;
+    unsigned short length;
+    unsigned short capacity;
+};
+
+#endif
\ No newline at end of file
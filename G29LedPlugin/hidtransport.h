@@ -0,0 +1,115 @@
+#ifndef __HIDTRANSPORT_H_INCLUDED__
+#define __HIDTRANSPORT_H_INCLUDED__
+
+#ifdef _WIN32
+#include "pch.h"
+#else
+// Just enough of the Windows result codes for the backends built elsewhere.
+#include <errno.h>
+#include <stddef.h>
+typedef long HRESULT;
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+#define HRESULT_FROM_ERRNO(e) ((HRESULT)(0x80070000L | ((e) & 0xffff)))
+#endif
+
+#include "wheels.h"
+
+// Which devices open() and watch_arrivals() are after. Each device found is
+// parsed into an id once, in the enumeration pass, and handed to `match`;
+// it may be called from a system thread.
+struct hid_device_filter_t {
+    bool (*match)(const hid_device_id_t& found, void* context);
+    void* context;
+
+    bool matches(const hid_device_id_t& found) const { return match(found, context); }
+};
+
+struct hid_discovery_stats_t {
+    unsigned long long enumerations; // full scans of the system's HID devices
+    unsigned long long cache_hits; // opens that reused a path found earlier
+};
+
+// Called from a system thread when a device matching the watched id shows
+// up; it should only take note and wake whoever opens the device.
+typedef void (*hid_arrival_callback_t)(void* context);
+
+// Access to a single HID device. Reports passed to write() and filled by
+// read() start with the report ID (zero when the device doesn't number its
+// reports), the same layout Windows and hidraw use.
+class hid_transport_t {
+public:
+    virtual ~hid_transport_t() {}
+
+    // Locates the first device the filter takes and opens it for writing.
+    virtual HRESULT open(const hid_device_filter_t& filter) = 0;
+    virtual void close() = 0;
+    virtual bool is_open() const = 0;
+    // Of the device opened.
+    virtual hid_device_id_t device_id() const = 0;
+
+    // Output report length, report ID included. Zero until opened.
+    virtual unsigned short output_report_size() const = 0;
+
+    virtual HRESULT write(const unsigned char* report, unsigned short length, unsigned int timeout_ms) = 0;
+    virtual HRESULT read(unsigned char* buffer, unsigned short length, unsigned short* read_len, unsigned int timeout_ms) = 0;
+
+    // QueryPerformanceCounter ticks of the input that caused the next report
+    // written, 0 if unknown. Only the mock device measures latency with it.
+    virtual void set_report_origin(long long) {}
+
+    // Backends able to tell when devices are plugged in call `arrived` for
+    // each device the filter takes until unwatch_arrivals(). Returns false if
+    // the backend can't, and the owner has to keep polling open().
+    virtual bool watch_arrivals(const hid_device_filter_t& filter, hid_arrival_callback_t arrived, void* context) { return false; }
+    virtual void unwatch_arrivals() {}
+
+    virtual void discovery_stats(hid_discovery_stats_t* stats) const {
+        stats->enumerations = 0;
+        stats->cache_hits = 0;
+    }
+};
+
+// Backend for the platform we are built for.
+hid_transport_t* CreateHIDTransport();
+// Fake device that needs no hardware.
+hid_transport_t* CreateMockHIDTransport();
+
+#ifdef __linux__
+// Linux hidraw backend. Devices are looked up through sysfs; both the sysfs
+// class directory and the device node directory can be pointed elsewhere,
+// so a fake device (a pipe or a plain file) can stand in for the wheel.
+class hidraw_transport_t : public hid_transport_t {
+public:
+    hidraw_transport_t(const char* sysfs_root = "/sys/class/hidraw", const char* dev_root = "/dev");
+    ~hidraw_transport_t();
+
+    HRESULT open(const hid_device_filter_t& filter);
+    // Opens a device node directly, skipping sysfs discovery.
+    HRESULT open_node(const char* node, unsigned short report_size);
+    void close();
+    bool is_open() const;
+    hid_device_id_t device_id() const;
+    unsigned short output_report_size() const;
+    HRESULT write(const unsigned char* report, unsigned short length, unsigned int timeout_ms);
+    HRESULT read(unsigned char* buffer, unsigned short length, unsigned short* read_len, unsigned int timeout_ms);
+    void discovery_stats(hid_discovery_stats_t* stats) const;
+
+    // Output report length, report ID included, described by a raw HID
+    // report descriptor. Zero if the device has no output reports.
+    static unsigned short ParseOutputReportSize(const unsigned char* descriptor, size_t length);
+
+private:
+    char sysfs[256];
+    char devdir[256];
+    int fd;
+    unsigned short report_size;
+    hid_device_id_t opened;
+    unsigned long long scans;
+};
+#endif
+
+#endif
\ No newline at end of file
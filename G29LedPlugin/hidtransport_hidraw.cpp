@@ -0,0 +1,243 @@
+// Built without the precompiled header: this backend only exists on Linux.
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hidtransport.h"
+
+#define HID_MAX_REPORT_IDS 256
+#define HID_MAX_PUSHES 8 // Push items nested at most, like the kernel's parser allows
+
+hidraw_transport_t::hidraw_transport_t(const char* sysfs_root, const char* dev_root) : fd(-1), report_size(0), scans(0) {
+    memset(&opened, 0, sizeof(opened));
+    snprintf(sysfs, sizeof(sysfs), "%s", sysfs_root);
+    snprintf(devdir, sizeof(devdir), "%s", dev_root);
+}
+
+hidraw_transport_t::~hidraw_transport_t() {
+    close();
+}
+
+// Reads a whole (small) sysfs file. Returns the number of bytes read, or -1.
+static ssize_t readFile(const char* path, unsigned char* buffer, size_t length) {
+    int file = ::open(path, O_RDONLY);
+    ssize_t total = 0, count;
+
+    if (file < 0) return -1;
+    while ((size_t)total < length && (count = ::read(file, buffer + total, length - total)) > 0) {
+        total += count;
+    }
+    ::close(file);
+    return total;
+}
+
+// The uevent file of a hidraw node's parent device has lines like:
+//   HID_ID=0003:0000046D:0000C24F
+//   HID_PHYS=usb-0000:00:14.0-2/input0
+// The interface number is -1 if the physical path doesn't give one.
+static bool parseUevent(const char* uevent, hid_device_id_t* id) {
+    unsigned int bus, vendor, product;
+    const char* line = strstr(uevent, "HID_ID=");
+    const char* phys;
+    const char* input;
+
+    if (!line || sscanf(line, "HID_ID=%x:%x:%x", &bus, &vendor, &product) != 3) return false;
+    id->vendor_id = (unsigned short)vendor;
+    id->product_id = (unsigned short)product;
+    id->interface_number = -1;
+
+    phys = strstr(uevent, "HID_PHYS=");
+    input = phys ? strstr(phys, "/input") : NULL;
+    if (input) id->interface_number = atoi(input + 6);
+    return true;
+}
+
+HRESULT hidraw_transport_t::open(const hid_device_filter_t& filter) {
+    char path[1024];
+    char uevent[4096];
+    unsigned char descriptor[4096];
+    hid_device_id_t id;
+    HRESULT result;
+    ssize_t len;
+    struct dirent* entry;
+    DIR* dir;
+
+    close();
+    dir = opendir(sysfs);
+    if (!dir) return HRESULT_FROM_ERRNO(errno);
+    scans++;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "hidraw", 6) != 0) continue;
+
+        snprintf(path, sizeof(path), "%s/%s/device/uevent", sysfs, entry->d_name);
+        len = readFile(path, (unsigned char*)uevent, sizeof(uevent) - 1);
+        if (len <= 0) continue;
+        uevent[len] = '\0';
+        if (!parseUevent(uevent, &id) || !filter.matches(id)) continue;
+
+        snprintf(path, sizeof(path), "%s/%s/device/report_descriptor", sysfs, entry->d_name);
+        len = readFile(path, descriptor, sizeof(descriptor));
+        if (len <= 0) continue;
+
+        snprintf(path, sizeof(path), "%s/%s", devdir, entry->d_name);
+        closedir(dir);
+        result = open_node(path, ParseOutputReportSize(descriptor, (size_t)len));
+        if (result == S_OK) opened = id;
+        return result;
+    }
+
+    closedir(dir);
+    return HRESULT_FROM_ERRNO(ENODEV);
+}
+
+HRESULT hidraw_transport_t::open_node(const char* node, unsigned short size) {
+    close();
+    if (size == 0) return E_INVALIDARG;
+
+    // O_RDWR on a FIFO never blocks waiting for the other end, which is
+    // handy for fake devices; hidraw nodes don't care.
+    fd = ::open(node, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return HRESULT_FROM_ERRNO(errno);
+    report_size = size;
+    return S_OK;
+}
+
+void hidraw_transport_t::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    report_size = 0;
+    memset(&opened, 0, sizeof(opened));
+}
+
+bool hidraw_transport_t::is_open() const {
+    return fd >= 0;
+}
+
+// Zero when opened with open_node().
+hid_device_id_t hidraw_transport_t::device_id() const {
+    return opened;
+}
+
+unsigned short hidraw_transport_t::output_report_size() const {
+    return report_size;
+}
+
+void hidraw_transport_t::discovery_stats(hid_discovery_stats_t* stats) const {
+    stats->enumerations = scans;
+    stats->cache_hits = 0;
+}
+
+static HRESULT waitFor(int fd, short events, unsigned int timeout_ms) {
+    struct pollfd pfd;
+    int ready;
+
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    do {
+        ready = poll(&pfd, 1, (int)timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready < 0) return HRESULT_FROM_ERRNO(errno);
+    if (ready == 0) return HRESULT_FROM_ERRNO(ETIMEDOUT);
+    if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) return HRESULT_FROM_ERRNO(ENODEV);
+    return S_OK;
+}
+
+HRESULT hidraw_transport_t::write(const unsigned char* report, unsigned short length, unsigned int timeout_ms) {
+    HRESULT result;
+    ssize_t written;
+
+    if (fd < 0) return HRESULT_FROM_ERRNO(EBADF);
+    result = waitFor(fd, POLLOUT, timeout_ms);
+    if (result != S_OK) return result;
+
+    written = ::write(fd, report, length);
+    if (written < 0) return HRESULT_FROM_ERRNO(errno);
+    if (written != length) return HRESULT_FROM_ERRNO(EIO);
+    return S_OK;
+}
+
+HRESULT hidraw_transport_t::read(unsigned char* buffer, unsigned short length, unsigned short* read_len, unsigned int timeout_ms) {
+    HRESULT result;
+    ssize_t count;
+
+    if (read_len) *read_len = 0;
+    if (fd < 0) return HRESULT_FROM_ERRNO(EBADF);
+    result = waitFor(fd, POLLIN, timeout_ms);
+    if (result != S_OK) return result;
+
+    count = ::read(fd, buffer, length);
+    if (count < 0) return HRESULT_FROM_ERRNO(errno);
+    if (read_len) *read_len = (unsigned short)count;
+    return S_OK;
+}
+
+// Walks the short items of the descriptor adding up the bits of every Output
+// main item per report ID, the same way Windows computes
+// OutputReportByteLength: the largest report plus the report ID byte. Push
+// and Pop save and restore the global items; a descriptor nesting them too
+// deep, or popping more than it pushed, is malformed and described as
+// having no output report.
+unsigned short hidraw_transport_t::ParseOutputReportSize(const unsigned char* descriptor, size_t length) {
+    struct globals_t {
+        unsigned int report_bits;
+        unsigned int report_count;
+        unsigned int report_id;
+    };
+    unsigned int bits[HID_MAX_REPORT_IDS];
+    globals_t state = { 0, 0, 0 };
+    globals_t stack[HID_MAX_PUSHES];
+    unsigned int depth = 0, largest = 0;
+    size_t i = 0, size;
+    unsigned char prefix;
+    unsigned int value;
+
+    memset(bits, 0, sizeof(bits));
+    while (i < length) {
+        prefix = descriptor[i++];
+        if (prefix == 0xfe) {
+            // Long item: skip it.
+            if (i + 1 >= length) break;
+            i += 2 + descriptor[i];
+            continue;
+        }
+
+        size = prefix & 0x03;
+        if (size == 3) size = 4;
+        if (i + size > length) break;
+        value = 0;
+        for (size_t b = 0; b < size; b++) value |= (unsigned int)descriptor[i + b] << (8 * b);
+        i += size;
+
+        switch (prefix & 0xfc) {
+        case 0x74: state.report_bits = value; break; // Report Size
+        case 0x94: state.report_count = value; break; // Report Count
+        case 0x84: state.report_id = value & 0xff; break; // Report ID
+        case 0x90: bits[state.report_id] += state.report_bits * state.report_count; break; // Output
+        case 0xa4: // Push
+            if (depth == HID_MAX_PUSHES) return 0;
+            stack[depth++] = state;
+            break;
+        case 0xb4: // Pop
+            if (depth == 0) return 0;
+            state = stack[--depth];
+            break;
+        }
+    }
+
+    for (i = 0; i < HID_MAX_REPORT_IDS; i++) {
+        if (bits[i] > largest) largest = bits[i];
+    }
+    return largest == 0 ? 0 : (unsigned short)((largest + 7) / 8 + 1);
+}
+
+hid_transport_t* CreateHIDTransport() {
+    return new hidraw_transport_t();
+}
+#endif // __linux__
\ No newline at end of file
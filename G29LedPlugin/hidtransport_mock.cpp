@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "log.h"
+#include "hidmock.h"
+#include "hidtransport.h"
+
+static const hid_device_id_t MOCK_DEVICE = { LOGITECH_VID, 0xc24f, 0 };
+
+// Stand-in for the wheel, selected by setting G29LEDPLUGIN_DEVICE=mock. It
+// accepts every report, so the whole pipeline runs without hardware, and
+// logs how long LED updates took to get from the telemetry to the "wheel"
+// when closed.
+class mock_hid_transport_t : public hid_transport_t {
+public:
+    mock_hid_transport_t() : opened(false), origin(0), device(nullptr) {
+        QueryPerformanceFrequency(&qpc_freq);
+    }
+
+    ~mock_hid_transport_t() {
+        close();
+    }
+
+    // It poses as the wheel the mock decodes the reports of, a G29.
+    HRESULT open(const hid_device_filter_t& filter) {
+        if (!filter.matches(MOCK_DEVICE)) return HRESULT_FROM_WIN32(ERROR_DEVICE_NOT_CONNECTED);
+        log("Using a mock device in place of %04x:%04x.", MOCK_DEVICE.vendor_id, MOCK_DEVICE.product_id);
+        delete device;
+        device = new hid_mock_device_t(qpc_freq.QuadPart);
+        opened = true;
+        return S_OK;
+    }
+
+    void close() {
+        if (opened) logLatency();
+        opened = false;
+        delete device;
+        device = nullptr;
+    }
+
+    bool is_open() const {
+        return opened;
+    }
+
+    hid_device_id_t device_id() const {
+        return MOCK_DEVICE;
+    }
+
+    unsigned short output_report_size() const {
+        return opened ? HID_COMMAND_LEN + 1 : 0;
+    }
+
+    HRESULT write(const unsigned char* report, unsigned short length, unsigned int timeout_ms) {
+        LARGE_INTEGER now;
+        if (!opened) return HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE);
+        QueryPerformanceCounter(&now);
+        device->receive(report, length, now.QuadPart, origin);
+        origin = 0;
+        return S_OK;
+    }
+
+    HRESULT read(unsigned char* buffer, unsigned short length, unsigned short* read_len, unsigned int timeout_ms) {
+        if (read_len) *read_len = 0;
+        Sleep(timeout_ms);
+        return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+    }
+
+    void set_report_origin(long long ticks) {
+        origin = ticks;
+    }
+
+private:
+    bool opened;
+    long long origin;
+    LARGE_INTEGER qpc_freq;
+    hid_mock_device_t* device;
+
+    void logLatency() {
+        hid_mock_latency_t latency;
+        device->latency(&latency);
+        log("Mock device received %llu reports, %llu LED changes (last 0x%02x).",
+            device->reports, device->led_reports, device->leds() & 0xff);
+        if (latency.samples == 0) return;
+
+        log("Telemetry to LED latency over %llu reports: p50 %llu us, p99 %llu us, max %llu us.",
+            latency.samples, latency.p50_us, latency.p99_us, latency.max_us);
+        for (int i = 0; i < HID_MOCK_BUCKETS; i++) {
+            if (latency.buckets[i]) log("  < %llu us: %llu", 1ULL << i, latency.buckets[i]);
+        }
+    }
+};
+
+hid_transport_t* CreateMockHIDTransport() {
+    return new mock_hid_transport_t();
+}
\ No newline at end of file
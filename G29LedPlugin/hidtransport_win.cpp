@@ -0,0 +1,390 @@
+#include "pch.h"
+#include "log.h"
+#include "hidtransport.h"
+
+#include <hidsdi.h>
+#include <SetupAPI.h>
+#include <cfgmgr32.h>
+
+// Device paths found so far, by id. Opening the wheel again after a write
+// error or a replug tries the path it had last time before enumerating.
+#define HID_DISCOVERY_CACHE 4
+
+// SetupAPI/HidD backend. Writes and reads use overlapped I/O so they can
+// give up after a timeout instead of blocking on a stalled endpoint.
+class win_hid_transport_t : public hid_transport_t {
+public:
+    win_hid_transport_t() : path(NULL), handle(INVALID_HANDLE_VALUE), report_size(0), notification(NULL), arrived(NULL), arrived_context(NULL) {
+        ZeroMemory(&write_ov, sizeof(write_ov));
+        ZeroMemory(&read_ov, sizeof(read_ov));
+        ZeroMemory(cache, sizeof(cache));
+        ZeroMemory(&stats, sizeof(stats));
+        ZeroMemory(&opened, sizeof(opened));
+    }
+
+    ~win_hid_transport_t() {
+        unwatch_arrivals();
+        close();
+        for (int i = 0; i < HID_DISCOVERY_CACHE; i++) free(cache[i].path);
+    }
+
+    HRESULT open(const hid_device_filter_t& filter) {
+        HRESULT result;
+        bool cached;
+
+        close();
+        while (true) {
+            cached = lookup(filter);
+            if (!cached) {
+                result = enumerate(filter);
+                if (result != S_OK) return result;
+                remember(opened);
+                log(L"HID path: %s\n", path);
+            }
+
+            result = loadCaps(cached);
+            if (result == S_OK) {
+                if (cached) stats.cache_hits++;
+                break;
+            }
+
+            // The device went away or moved since we cached it: look again.
+            if (cached) logWarnEvery(1, "Cached joystick path no longer opens (error 0x%x); looking for the joystick again.", result);
+            forget(opened);
+            free(path);
+            path = NULL;
+            if (!cached) return result;
+        }
+
+        handle = CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+        if (handle == INVALID_HANDLE_VALUE) {
+            // We only really need to write, so don't insist on reading.
+            handle = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+        }
+        if (handle == INVALID_HANDLE_VALUE) {
+            detailedError(L"Cannot open the joystick for sending HID data");
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        write_ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        read_ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (write_ov.hEvent == NULL || read_ov.hEvent == NULL) {
+            detailedError(L"Unable to create HID I/O events");
+            result = HRESULT_FROM_WIN32(GetLastError());
+            close();
+            return result;
+        }
+
+        return S_OK;
+    }
+
+    void close() {
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+        if (write_ov.hEvent != NULL) CloseHandle(write_ov.hEvent);
+        if (read_ov.hEvent != NULL) CloseHandle(read_ov.hEvent);
+        ZeroMemory(&write_ov, sizeof(write_ov));
+        ZeroMemory(&read_ov, sizeof(read_ov));
+        handle = INVALID_HANDLE_VALUE;
+        report_size = 0;
+        free(path);
+        path = NULL;
+        ZeroMemory(&opened, sizeof(opened));
+    }
+
+    bool is_open() const {
+        return handle != INVALID_HANDLE_VALUE;
+    }
+
+    hid_device_id_t device_id() const {
+        return opened;
+    }
+
+    unsigned short output_report_size() const {
+        return report_size;
+    }
+
+    HRESULT write(const unsigned char* report, unsigned short length, unsigned int timeout_ms) {
+        DWORD count = 0;
+        return overlappedIO(&write_ov, true, (unsigned char*)report, length, &count, timeout_ms);
+    }
+
+    HRESULT read(unsigned char* buffer, unsigned short length, unsigned short* read_len, unsigned int timeout_ms) {
+        DWORD count = 0;
+        HRESULT result = overlappedIO(&read_ov, false, buffer, length, &count, timeout_ms);
+        if (read_len) *read_len = (unsigned short)count;
+        return result;
+    }
+
+    bool watch_arrivals(const hid_device_filter_t& devices, hid_arrival_callback_t callback, void* context) {
+        CM_NOTIFY_FILTER filter;
+
+        unwatch_arrivals();
+        watched = devices;
+        arrived = callback;
+        arrived_context = context;
+
+        ZeroMemory(&filter, sizeof(filter));
+        filter.cbSize = sizeof(filter);
+        filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+        HidD_GetHidGuid(&filter.u.DeviceInterface.ClassGuid);
+        if (CM_Register_Notification(&filter, this, onDeviceChange, &notification) != CR_SUCCESS) {
+            notification = NULL;
+            return false;
+        }
+        return true;
+    }
+
+    void unwatch_arrivals() {
+        // Waits for callbacks in progress, so none runs past this point.
+        if (notification != NULL) CM_Unregister_Notification(notification);
+        notification = NULL;
+    }
+
+    void discovery_stats(hid_discovery_stats_t* out) const {
+        *out = stats;
+    }
+
+private:
+    WCHAR* path;
+    hid_device_id_t opened; // parsed from the hardware ID the path was found by
+    HANDLE handle;
+    USHORT report_size;
+    OVERLAPPED write_ov;
+    OVERLAPPED read_ov;
+
+    struct cached_path_t {
+        hid_device_id_t id;
+        WCHAR* path; // NULL if the slot is free
+    };
+    cached_path_t cache[HID_DISCOVERY_CACHE];
+    hid_discovery_stats_t stats;
+
+    HCMNOTIFICATION notification;
+    hid_device_filter_t watched;
+    hid_arrival_callback_t arrived;
+    void* arrived_context;
+
+    HRESULT overlappedIO(OVERLAPPED* ov, bool writing, unsigned char* buffer, unsigned short length, DWORD* count, unsigned int timeout_ms) {
+        DWORD error = 0;
+        BOOL done;
+
+        if (handle == INVALID_HANDLE_VALUE) return HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE);
+
+        ResetEvent(ov->hEvent);
+        done = writing ? WriteFile(handle, buffer, length, NULL, ov) : ReadFile(handle, buffer, length, NULL, ov);
+        if (!done) {
+            error = GetLastError();
+            if (error == ERROR_IO_PENDING) {
+                error = 0;
+                if (WaitForSingleObject(ov->hEvent, timeout_ms) != WAIT_OBJECT_0) {
+                    CancelIo(handle);
+                    error = ERROR_TIMEOUT;
+                }
+            }
+        }
+        if (!GetOverlappedResult(handle, ov, count, TRUE) && error == 0) {
+            error = GetLastError();
+        }
+
+        return error == 0 ? S_OK : HRESULT_FROM_WIN32(error);
+    }
+
+    // Walks the system's HID devices for the first one the filter takes,
+    // parsing each hardware ID once, and keeps its device path and id.
+    HRESULT enumerate(const hid_device_filter_t& filter) {
+        GUID hidIdx;
+        HDEVINFO hidDevsHandle;
+        SP_DEVINFO_DATA device;
+        SP_DEVICE_INTERFACE_DATA devData;
+        devData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
+
+        PSP_DEVICE_INTERFACE_DETAIL_DATA devDetails = NULL;
+
+        DWORD memberIdx = 0, dwSize, dwType;
+        PBYTE buf = NULL;
+        HRESULT result = S_OK;
+        hid_device_id_t found;
+
+        unsigned short loopguard;
+
+        stats.enumerations++;
+        HidD_GetHidGuid(&hidIdx);
+        hidDevsHandle = SetupDiGetClassDevs(&hidIdx, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+
+        if (hidDevsHandle == INVALID_HANDLE_VALUE) {
+            detailedError(L"Unable to enumerate HID devices on system");
+            return ERROR_DEVICE_ENUMERATION_ERROR;
+        }
+
+        // Every way out of the loop goes through the cleanup below, so the
+        // device list and buffers are never leaked.
+        loopguard = 0;
+        while (path == NULL) {
+            if (loopguard++ > 200) {
+                logErr("Error: Iterated 200 times without listing all HID devices?\n");
+                result = ERROR_INFLOOP_IN_RELOC_CHAIN;
+                break;
+            }
+
+            device.cbSize = sizeof(SP_DEVINFO_DATA);
+            if (!SetupDiEnumDeviceInfo(hidDevsHandle, memberIdx, &device)) {
+                // Only log it the first time; retries are expected to fail the same way.
+                if (stats.enumerations == 1) detailedError(L"Unable to locate a supported steering wheel plugged to the system.");
+                result = GetLastError();
+                break;
+            }
+
+            SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_HARDWAREID, &dwType, NULL, 0, &dwSize);
+            if (dwSize > 0 && dwSize < 16384) {
+                buf = (PBYTE)malloc(dwSize * sizeof(BYTE));
+
+                if (buf && SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_HARDWAREID, &dwType, buf, dwSize, NULL) &&
+                    ParseHardwareId((WCHAR*)buf, &found) && filter.matches(found)) {
+
+                    log(L"Found: %s\n", (WCHAR*)buf);
+
+                    SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_DEVICEDESC, &dwType, NULL, 0, &dwSize);
+                    if (dwSize <= 0 || dwSize > 16384) {
+                        logErr(L"Error: Unable to fetch device description from: %ws\n", (WCHAR*)buf);
+                        result = ERROR_INVALID_DEVICE_OBJECT_PARAMETER;
+                        break;
+                    }
+
+                    free(buf);
+                    buf = (PBYTE)malloc(dwSize * sizeof(BYTE));
+
+                    if (!buf || !SetupDiGetDeviceRegistryProperty(hidDevsHandle, &device, SPDRP_DEVICEDESC, &dwType, buf, dwSize, NULL)) {
+                        detailedError(L"Unable to fetch device description");
+                        result = GetLastError();
+                        break;
+                    }
+
+                    log(L"Device: %ws\n", (WCHAR*)buf);
+
+                    SetupDiEnumDeviceInterfaces(hidDevsHandle, NULL, &hidIdx, memberIdx, &devData);
+                    SetupDiGetDeviceInterfaceDetail(hidDevsHandle, &devData, NULL, 0, &dwSize, NULL);
+                    if (dwSize < 1 || dwSize > 16384) {
+                        logErr("Error: Unable to get device details.\n");
+                        result = ERROR_INVALID_DEVICE_OBJECT_PARAMETER;
+                        break;
+                    }
+
+                    devDetails = (PSP_INTERFACE_DEVICE_DETAIL_DATA)malloc(dwSize);
+                    if (!devDetails) {
+                        SetLastError(ERROR_OUTOFMEMORY);
+                        detailedError(L"Unable to allocate memory to store device information");
+                        result = GetLastError();
+                        break;
+                    }
+                    devDetails->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
+
+                    if (!SetupDiGetDeviceInterfaceDetail(hidDevsHandle, &devData, devDetails, dwSize, &dwSize, NULL)) {
+                        detailedError(L"Unable to get device details.\n");
+                        result = GetLastError();
+                        break;
+                    }
+
+                    path = _wcsdup(devDetails->DevicePath);
+                    opened = found;
+                }
+                free(buf);
+                buf = NULL;
+            }
+            memberIdx++;
+        }
+
+        free(buf);
+        free(devDetails);
+        SetupDiDestroyDeviceInfoList(hidDevsHandle);
+        return result;
+    }
+
+    static bool sameId(const hid_device_id_t& a, const hid_device_id_t& b) {
+        return a.vendor_id == b.vendor_id && a.product_id == b.product_id && a.interface_number == b.interface_number;
+    }
+
+    // Takes the device path from the cache if we found a device the filter
+    // takes before. It's only a hit once it opens.
+    bool lookup(const hid_device_filter_t& filter) {
+        for (int i = 0; i < HID_DISCOVERY_CACHE; i++) {
+            if (cache[i].path != NULL && filter.matches(cache[i].id)) {
+                path = _wcsdup(cache[i].path);
+                opened = cache[i].id;
+                return path != NULL;
+            }
+        }
+        return false;
+    }
+
+    void remember(const hid_device_id_t& id) {
+        int slot = 0;
+
+        forget(id);
+        for (int i = 0; i < HID_DISCOVERY_CACHE; i++) {
+            if (cache[i].path == NULL) {
+                slot = i;
+                break;
+            }
+        }
+        free(cache[slot].path);
+        cache[slot].id = id;
+        cache[slot].path = _wcsdup(path);
+    }
+
+    void forget(const hid_device_id_t& id) {
+        for (int i = 0; i < HID_DISCOVERY_CACHE; i++) {
+            if (cache[i].path != NULL && sameId(cache[i].id, id)) {
+                free(cache[i].path);
+                cache[i].path = NULL;
+            }
+        }
+    }
+
+    static DWORD CALLBACK onDeviceChange(HCMNOTIFICATION notification, PVOID context, CM_NOTIFY_ACTION action, PCM_NOTIFY_EVENT_DATA data, DWORD size) {
+        win_hid_transport_t* transport = (win_hid_transport_t*)context;
+        hid_device_id_t found;
+
+        if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL &&
+            ParseHardwareId(data->u.DeviceInterface.SymbolicLink, &found) && transport->watched.matches(found)) {
+            transport->arrived(transport->arrived_context);
+        }
+        return ERROR_SUCCESS;
+    }
+
+    // A `cached` path that fails is stale rather than broken, and open()
+    // says so itself.
+    HRESULT loadCaps(bool cached) {
+        HANDLE hidHandle = CreateFile(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+
+        if (hidHandle == INVALID_HANDLE_VALUE) {
+            if (!cached) detailedError(L"Cannot open joystick for reading its HID parameters");
+            return GetLastError();
+        }
+
+        PHIDP_PREPARSED_DATA data;
+        if (!HidD_GetPreparsedData(hidHandle, &data)) {
+            detailedError(L"Unable to fetch joystick's HID pre-parsed data");
+            CloseHandle(hidHandle);
+            return GetLastError();
+        }
+
+        HIDP_CAPS hCaps;
+        if (HidP_GetCaps(data, &hCaps) != HIDP_STATUS_SUCCESS) {
+            HidD_FreePreparsedData(data);
+            detailedError(L"Unable to fetch joystick's HID capabilities");
+            CloseHandle(hidHandle);
+            return GetLastError();
+        }
+        HidD_FreePreparsedData(data);
+        CloseHandle(hidHandle);
+
+        report_size = hCaps.OutputReportByteLength;
+        log("Joystick HID packet size: %u bytes.\n", report_size);
+
+        return S_OK;
+    }
+};
+
+hid_transport_t* CreateHIDTransport() {
+    return new win_hid_transport_t();
+}
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "pch.h"
+#include <atomic>
+#include <thread>
+#include "log.h"
+#include "hidqueue.h"
+#include "hidwriter.h"
+#include "poller.h"
+
+// Commands are handed over from the poller thread to a dedicated writer
+// thread, so a slow or stalled USB endpoint never holds the poller up. Only
+// the poller thread may call QueueHIDCommand(); see hid_command_queue_t for
+// how LED states are coalesced on the way.
+
+#define HID_WRITE_TIMEOUT 500
+
+static hid_command_queue_t queue;
+
+static std::atomic<bool> writing(false);
+static std::atomic<bool> discarding(false); // stopping without draining
+static std::atomic<HRESULT> last_write_error(S_OK);
+static std::thread* writer_thread = nullptr;
+static HANDLE writer_wakeup = NULL;
+
+static hid_transport_t* device = nullptr;
+static hid_report_t* report = nullptr;
+static LARGE_INTEGER qpc_freq;
+
+static std::atomic<unsigned long long> stat_enqueued(0);
+static std::atomic<unsigned long long> stat_coalesced(0);
+static std::atomic<unsigned long long> stat_dropped(0);
+static std::atomic<unsigned long long> stat_written(0);
+static std::atomic<unsigned long long> stat_failed(0);
+static std::atomic<unsigned long long> stat_write_us_total(0);
+static std::atomic<unsigned long long> stat_write_us_max(0);
+
+static HRESULT writeReport(const hid_command_t& command, long long origin) {
+    LARGE_INTEGER start, end;
+    HRESULT result;
+    const unsigned char* payload = report->build(command);
+
+    device->set_report_origin(origin);
+    QueryPerformanceCounter(&start);
+    result = device->write(payload, report->size(), HID_WRITE_TIMEOUT);
+    QueryPerformanceCounter(&end);
+
+    if (result != S_OK) {
+        stat_failed++;
+        logErrEvery(2, "Cannot write data to joystick (error 0x%x). Tried to write: 0x00,0x%02x,0x%02x,0x%02x,0x%02x,0x%02x,0x%02x,0x%02x.",
+            result, payload[1], payload[2], payload[3], payload[4], payload[5], payload[6], payload[7]);
+        return result;
+    }
+
+    unsigned long long us = (unsigned long long)((end.QuadPart - start.QuadPart) * 1000000 / qpc_freq.QuadPart);
+    unsigned long long max = stat_write_us_max.load(std::memory_order_relaxed);
+    if (us > max) stat_write_us_max.store(us, std::memory_order_relaxed);
+    stat_write_us_total += us;
+    stat_written++;
+    return S_OK;
+}
+
+static void writeLoop() {
+    hid_command_t command;
+    long long origin;
+    HRESULT result;
+    bool running = true;
+
+    while (running) {
+        WaitForSingleObject(writer_wakeup, INFINITE);
+        // Drain whatever is queued before honouring a stop request, so the
+        // last state sent before unloading (usually all LEDs off) goes out.
+        running = writing.load();
+
+        while (queue.next(&command, &origin)) {
+            if (discarding) continue;
+            result = writeReport(command, origin);
+            if (result != S_OK && last_write_error.exchange(result) == S_OK) {
+                // Let the poller find out now rather than on its next update.
+                SignalPoller();
+            }
+        }
+    }
+}
+
+// The transport and report buffer are owned by the caller and must outlive
+// the writer.
+HRESULT StartHIDWriter(hid_transport_t* transport, hid_report_t* device_report) {
+    if (writer_thread != nullptr) StopHIDWriter();
+    if (!transport->is_open() || !device_report->ready()) return E_INVALIDARG;
+
+    QueryPerformanceFrequency(&qpc_freq);
+
+    writer_wakeup = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (writer_wakeup == NULL) {
+        logErr("Unable to create HID writer event: 0x%x", GetLastError());
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    device = transport;
+    report = device_report;
+    queue.reset();
+    last_write_error = S_OK;
+    discarding = false;
+    writing = true;
+    writer_thread = new std::thread(writeLoop);
+    return S_OK;
+}
+
+// Without `drain`, commands still queued are dropped instead of written,
+// which is what we want once the device is gone.
+HRESULT StopHIDWriter(bool drain) {
+    if (writer_thread != nullptr) {
+        discarding = !drain;
+        writing = false;
+        SetEvent(writer_wakeup);
+        writer_thread->join();
+        delete writer_thread;
+        writer_thread = nullptr;
+    }
+
+    if (writer_wakeup != NULL) CloseHandle(writer_wakeup);
+    writer_wakeup = NULL;
+    report = nullptr;
+    device = nullptr;
+    return S_OK;
+}
+
+// Queues a command for the writer thread. Writes are asynchronous, so a
+// failed write is reported to the caller queueing the next command.
+// `origin` is when the input that led to this command arrived, if known.
+HRESULT QueueHIDCommand(const hid_command_t& command, bool coalesce, long long origin) {
+    if (writer_thread == nullptr) return HRESULT_FROM_WIN32(ERROR_DEVICE_NOT_AVAILABLE);
+
+    stat_enqueued++;
+    hid_queue_result_t queued = queue.queue(command, coalesce, origin);
+    if (queued == HID_QUEUE_FULL) {
+        stat_dropped++;
+        return HRESULT_FROM_WIN32(ERROR_BUSY);
+    }
+    if (queued == HID_QUEUE_COALESCED) stat_coalesced++;
+    SetEvent(writer_wakeup);
+
+    return last_write_error.exchange(S_OK);
+}
+
+// Error of the last failed write not reported yet, or S_OK.
+HRESULT TakeHIDWriteError() {
+    return last_write_error.exchange(S_OK);
+}
+
+void GetHIDWriterStats(hid_writer_stats_t* stats) {
+    stats->enqueued = stat_enqueued;
+    stats->coalesced = stat_coalesced;
+    stats->dropped = stat_dropped;
+    stats->written = stat_written;
+    stats->failed = stat_failed;
+    stats->write_us_total = stat_write_us_total;
+    stats->write_us_max = stat_write_us_max;
+}
+
+void LogHIDWriterStats() {
+    hid_writer_stats_t stats;
+    GetHIDWriterStats(&stats);
+    log("HID reports: %llu enqueued, %llu coalesced, %llu dropped, %llu written, %llu failed; write latency: avg %llu us, max %llu us.",
+        stats.enqueued, stats.coalesced, stats.dropped, stats.written, stats.failed,
+        stats.written ? stats.write_us_total / stats.written : 0, stats.write_us_max);
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef __HIDWRITER_H_INCLUDED__
+#define __HIDWRITER_H_INCLUDED__
+#include "pch.h"
+#include "hidreport.h"
+#include "hidtransport.h"
+
+struct hid_writer_stats_t {
+    unsigned long long enqueued;
+    unsigned long long coalesced; // replaced by a newer state before being sent
+    unsigned long long dropped; // queue was full
+    unsigned long long written;
+    unsigned long long failed;
+    unsigned long long write_us_total;
+    unsigned long long write_us_max;
+};
+
+HRESULT StartHIDWriter(hid_transport_t* transport, hid_report_t* report);
+HRESULT StopHIDWriter(bool drain = true);
+HRESULT QueueHIDCommand(const hid_command_t& command, bool coalesce = false, long long origin = 0);
+HRESULT TakeHIDWriteError();
+void GetHIDWriterStats(hid_writer_stats_t* stats);
+void LogHIDWriterStats();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,182 @@
+#ifndef __LEDANIM_H_INCLUDED__
+#define __LEDANIM_H_INCLUDED__
+
+// Keyframe LED animations. An effect is a table of segments, each a list of
+// (mask, hold time) keyframes played a number of times. Starting an effect
+// compiles it into a flat timeline, so advancing it is just a lookup: the
+// owner calls tick() whenever it likes (it never blocks) and sleeps until
+// the time tick() tells it the LEDs change next.
+//
+// Shared by the plugin and the CLI, so it doesn't depend on the plugin's
+// precompiled header. Times are in milliseconds on any monotonic clock.
+
+// Keyframe masks above the five LED bits stand for states only known while
+// playing.
+#define LED_KEY_LIVE 0x80 // whatever the gauge shows when the frame plays
+#define LED_KEY_ENTRY 0x40 // the LEDs as they were when the effect started
+
+// Segment flags.
+#define LED_SEG_UNTIL_LIVE 0x01 // end the segment once a frame shows the gauge
+#define LED_SEG_WHEN_LIVE 0x02 // only play if the gauge shows `when_live`
+
+#define LED_TIMELINE_MAX 128
+#define LED_FADE_PERIOD_MS 40 // crossfades switch between states at this period
+#define LED_NO_DEADLINE 0xffffffffU
+
+struct led_keyframe_t {
+    unsigned char mask; // G29_LED_* or LED_KEY_*
+    unsigned short hold_ms;
+};
+
+struct led_segment_t {
+    const led_keyframe_t* frames;
+    unsigned char count;
+    unsigned char repeat; // plays 1 + repeat times
+    unsigned char flags;
+    unsigned char when_live;
+};
+
+struct led_effect_t {
+    const char* name;
+    const led_segment_t* segments;
+    unsigned char count;
+};
+
+#define LED_FRAMES(frames) frames, sizeof(frames) / sizeof(led_keyframe_t)
+#define LED_SEGMENTS(segments) segments, sizeof(segments) / sizeof(led_segment_t)
+
+class led_animation_t {
+public:
+    led_animation_t() : effect(nullptr), length(0), end_ms(0), started_ms(0), fading(false), fade_from(0), fade_ms(0) {}
+
+    // Compiles the effect against the gauge state it starts from and starts
+    // playing it, replacing anything still playing. `entry` is what the LEDs
+    // show right now. Returns false if it doesn't fit in the timeline.
+    bool play(const led_effect_t& new_effect, unsigned char entry, unsigned char live, unsigned long long now_ms) {
+        unsigned int at = 0;
+
+        length = 0;
+        fading = false;
+        for (unsigned char s = 0; s < new_effect.count; s++) {
+            const led_segment_t& segment = new_effect.segments[s];
+            if ((segment.flags & LED_SEG_WHEN_LIVE) && live != segment.when_live) continue;
+
+            for (unsigned int r = 0; r <= segment.repeat; r++) {
+                for (unsigned char f = 0; f < segment.count; f++) {
+                    const led_keyframe_t& frame = segment.frames[f];
+                    if (length == LED_TIMELINE_MAX) {
+                        effect = nullptr;
+                        length = 0;
+                        return false;
+                    }
+                    mask[length] = frame.mask == LED_KEY_ENTRY ? entry : frame.mask;
+                    start_ms[length] = at;
+                    length++;
+                    if ((segment.flags & LED_SEG_UNTIL_LIVE) && resolve(frame.mask, live) == live) {
+                        // The gauge stays lit for as long as what follows says.
+                        r = segment.repeat;
+                        break;
+                    }
+                    at += frame.hold_ms;
+                }
+            }
+        }
+        effect = &new_effect;
+        end_ms = at;
+        started_ms = now_ms;
+        return true;
+    }
+
+    // Stops the effect. With a crossfade, the LEDs blend from the frame
+    // showing now to the gauge, alternating between both with a growing
+    // share of the gauge, which is the closest on/off LEDs get to a fade.
+    void cancel(unsigned long long now_ms, unsigned int crossfade_ms = 0) {
+        if (!active() || crossfade_ms == 0) {
+            effect = nullptr;
+            fading = false;
+            return;
+        }
+        if (!fading) fade_from = current(now_ms);
+        fading = true;
+        fade_ms = crossfade_ms;
+        started_ms = now_ms;
+    }
+
+    bool active() const {
+        return effect != nullptr;
+    }
+
+    const char* name() const {
+        return effect ? effect->name : nullptr;
+    }
+
+    // Returns the mask the LEDs should show at `now_ms`, and in `next_ms` how
+    // long until that changes (LED_NO_DEADLINE once the effect is over, when
+    // the result is just `live`).
+    unsigned char tick(unsigned long long now_ms, unsigned char live, unsigned int* next_ms) {
+        unsigned long long elapsed = now_ms - started_ms;
+
+        *next_ms = LED_NO_DEADLINE;
+        if (!effect) return live;
+
+        if (fading) {
+            if (elapsed >= fade_ms) {
+                effect = nullptr;
+                fading = false;
+                return live;
+            }
+            // Within each period the gauge shows for a share growing with
+            // the time faded so far.
+            unsigned int phase = (unsigned int)(elapsed % LED_FADE_PERIOD_MS);
+            unsigned int on = (unsigned int)(elapsed * LED_FADE_PERIOD_MS / fade_ms);
+            *next_ms = phase < on ? on - phase : LED_FADE_PERIOD_MS - phase;
+            if (*next_ms > fade_ms - elapsed) *next_ms = (unsigned int)(fade_ms - elapsed);
+            return phase < on ? live : resolve(fade_from, live);
+        }
+
+        if (elapsed >= end_ms) {
+            effect = nullptr;
+            return live;
+        }
+        unsigned short frame = find((unsigned int)elapsed);
+        unsigned int frame_end = frame + 1 < length ? start_ms[frame + 1] : end_ms;
+        *next_ms = frame_end - (unsigned int)elapsed;
+        return resolve(mask[frame], live);
+    }
+
+private:
+    const led_effect_t* effect;
+    unsigned char mask[LED_TIMELINE_MAX];
+    unsigned int start_ms[LED_TIMELINE_MAX];
+    unsigned short length;
+    unsigned int end_ms;
+    unsigned long long started_ms;
+
+    bool fading;
+    unsigned char fade_from;
+    unsigned int fade_ms;
+
+    static unsigned char resolve(unsigned char frame_mask, unsigned char live) {
+        return frame_mask == LED_KEY_LIVE ? live : frame_mask;
+    }
+
+    // Last frame started at or before `at`.
+    unsigned short find(unsigned int at) const {
+        unsigned short low = 0, high = length - 1;
+        while (low < high) {
+            unsigned short mid = (low + high + 1) / 2;
+            if (start_ms[mid] <= at) low = mid;
+            else high = mid - 1;
+        }
+        return low;
+    }
+
+    // Keyframe mask playing at `now_ms`, LED_KEY_LIVE included.
+    unsigned char current(unsigned long long now_ms) const {
+        unsigned long long elapsed = now_ms - started_ms;
+        if (length == 0 || elapsed >= end_ms) return LED_KEY_LIVE;
+        return mask[find((unsigned int)elapsed)];
+    }
+};
+
+#endif
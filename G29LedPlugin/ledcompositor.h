@@ -0,0 +1,111 @@
+#ifndef __LEDCOMPOSITOR_H_INCLUDED__
+#define __LEDCOMPOSITOR_H_INCLUDED__
+
+// Adds up what every LED user wants shown. Each owns a layer: the LEDs it
+// lights, the LEDs it has a say on (its coverage, opaque there and
+// transparent elsewhere), how it blends over the layers below and, if it
+// should go away by itself, when. compose() folds the layers shown into one
+// mask, lowest priority first, so the gauge, effects and warnings each keep
+// their own state and never need to know about the others.
+//
+// Doesn't depend on the plugin's precompiled header. Times are in
+// milliseconds on any monotonic clock. Not thread safe.
+
+#define LED_COMPOSITOR_LAYERS 8
+#define LED_LAYER_FOREVER (~0ULL)
+
+enum led_blend_t {
+    LED_BLEND_REPLACE, // its mask replaces the covered LEDs
+    LED_BLEND_ADD, // lights its covered LEDs on top of what's below
+    LED_BLEND_INVERT // flips its covered LEDs lit in its mask
+};
+
+struct led_layer_t {
+    const char* name;
+    int priority; // higher ones compose over lower ones
+    led_blend_t blend;
+    unsigned char coverage;
+
+    led_layer_t(const char* name, int priority, led_blend_t blend, unsigned char coverage) :
+        name(name), priority(priority), blend(blend), coverage(coverage), mask(0), shown(false), expires(LED_LAYER_FOREVER) {}
+
+    bool visible() const { return shown; }
+    unsigned char lit() const { return mask; }
+
+private:
+    friend class led_compositor_t;
+    unsigned char mask;
+    bool shown;
+    unsigned long long expires;
+};
+
+class led_compositor_t {
+public:
+    // Takes the layers for good, in any order.
+    led_compositor_t(led_layer_t* const* owned, unsigned int owned_count) : count(0) {
+        for (unsigned int i = 0; i < owned_count && i < LED_COMPOSITOR_LAYERS; i++) add(owned[i]);
+    }
+
+    // Shows `mask` on the layer, for `lifetime_ms` from `now_ms` or until
+    // hidden.
+    void show(led_layer_t* layer, unsigned char mask, unsigned long long now_ms = 0, unsigned long long lifetime_ms = LED_LAYER_FOREVER) {
+        layer->mask = mask;
+        layer->shown = true;
+        layer->expires = lifetime_ms == LED_LAYER_FOREVER ? LED_LAYER_FOREVER : now_ms + lifetime_ms;
+    }
+
+    void hide(led_layer_t* layer) {
+        layer->shown = false;
+    }
+
+    // The LEDs the layers shown at `now_ms` add up to. Layers past their
+    // lifetime are hidden on the way.
+    unsigned char compose(unsigned long long now_ms) {
+        unsigned char composite = 0;
+
+        for (unsigned int i = 0; i < count; i++) {
+            led_layer_t* layer = layers[i];
+            if (!layer->shown) continue;
+            if (layer->expires <= now_ms) {
+                layer->shown = false;
+                continue;
+            }
+
+            unsigned char mask = layer->mask & layer->coverage;
+            switch (layer->blend) {
+            case LED_BLEND_REPLACE:
+                composite = (unsigned char)((composite & ~layer->coverage) | mask);
+                break;
+            case LED_BLEND_ADD:
+                composite |= mask;
+                break;
+            case LED_BLEND_INVERT:
+                composite ^= mask;
+                break;
+            }
+        }
+        return composite;
+    }
+
+    // When the first layer shown goes away by itself, or LED_LAYER_FOREVER.
+    unsigned long long next_expiry() const {
+        unsigned long long next = LED_LAYER_FOREVER;
+        for (unsigned int i = 0; i < count; i++) {
+            if (layers[i]->shown && layers[i]->expires < next) next = layers[i]->expires;
+        }
+        return next;
+    }
+
+private:
+    // Kept sorted by priority; there are only ever a few.
+    void add(led_layer_t* layer) {
+        unsigned int i = count++;
+        for (; i > 0 && layers[i - 1]->priority > layer->priority; i--) layers[i] = layers[i - 1];
+        layers[i] = layer;
+    }
+
+    led_layer_t* layers[LED_COMPOSITOR_LAYERS];
+    unsigned int count;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef __LEDDITHER_H_INCLUDED__
+#define __LEDDITHER_H_INCLUDED__
+#include <string.h>
+
+// Temporal dithering for the wheel's on/off LEDs. Each LED gets a duty
+// cycle of 0 to `levels` frames out of `levels`, and frame() tells which
+// LEDs are lit in the next report. Every LED runs its own first order
+// sigma-delta modulator, so a duty of k/levels lights it exactly k frames in
+// every `levels`, spread as evenly as they go: the pattern repeats within
+// `levels` frames, and the owner picks the frame rate the wheel sustains.
+// LEDs start out of phase, so two half lit LEDs don't blink together.
+//
+// Shared by the plugin and the CLI, so it doesn't depend on the plugin's
+// precompiled header. Not thread safe.
+
+#define LED_DITHER_LEDS 5
+#define LED_DITHER_MAX_LEVELS 16
+// A pattern repeating slower than this is seen blinking rather than dimmed,
+// so the levels are limited to what fits in it at the frame interval.
+#define LED_DITHER_MAX_PERIOD_US 16000
+#define LED_DITHER_MIN_FRAME_US 4000
+
+class led_dither_t {
+public:
+    explicit led_dither_t(unsigned int levels = 4) {
+        set_levels(levels);
+    }
+
+    unsigned int levels() const { return steps; }
+
+    // The most of `levels` whose pattern repeats within
+    // LED_DITHER_MAX_PERIOD_US with frames `frame_us` apart, or 0 if not even
+    // two do.
+    static unsigned int fit_levels(unsigned int levels, unsigned long long frame_us) {
+        unsigned long long fit = frame_us ? LED_DITHER_MAX_PERIOD_US / frame_us : levels;
+        if (fit < levels) levels = (unsigned int)fit;
+        return levels < 2 ? 0 : levels;
+    }
+
+    // Changing the resolution drops the duty cycles set.
+    void set_levels(unsigned int levels) {
+        if (levels < 2) levels = 2;
+        if (levels > LED_DITHER_MAX_LEVELS) levels = LED_DITHER_MAX_LEVELS;
+        steps = levels;
+        memset(duty, 0, sizeof(duty));
+        for (unsigned int led = 0; led < LED_DITHER_LEDS; led++) phase[led] = led * steps / LED_DITHER_LEDS;
+    }
+
+    // `level` frames out of levels() lit, for the LED of mask bit `led`.
+    void set_duty(unsigned int led, unsigned int level) {
+        duty[led] = (unsigned char)(level < steps ? level : steps);
+    }
+
+    // Lights `full`, and `partial` `level` frames out of levels(): the usual
+    // case of a gauge in between two of its states.
+    void set(unsigned char full, unsigned char partial, unsigned int level) {
+        for (unsigned int led = 0; led < LED_DITHER_LEDS; led++) {
+            if (full & (1u << led)) set_duty(led, steps);
+            else set_duty(led, partial & (1u << led) ? level : 0);
+        }
+    }
+
+    // The duty level closest to `fraction` of the time.
+    unsigned int step(float fraction) const {
+        if (!(fraction > 0)) return 0; // NaN too
+        if (fraction >= 1) return steps;
+        return (unsigned int)(fraction * steps + 0.5f);
+    }
+
+    // Whether every LED is fully on or off, so frames never change.
+    bool steady() const {
+        for (unsigned int led = 0; led < LED_DITHER_LEDS; led++) {
+            if (duty[led] != 0 && duty[led] != steps) return false;
+        }
+        return true;
+    }
+
+    // The LEDs lit whatever the frame.
+    unsigned char solid() const {
+        unsigned char mask = 0;
+        for (unsigned int led = 0; led < LED_DITHER_LEDS; led++) {
+            if (duty[led] == steps) mask |= (unsigned char)(1u << led);
+        }
+        return mask;
+    }
+
+    // Advances every LED by a frame and returns the mask to show.
+    unsigned char frame() {
+        unsigned char mask = 0;
+        for (unsigned int led = 0; led < LED_DITHER_LEDS; led++) {
+            phase[led] += duty[led];
+            if (phase[led] >= steps) {
+                phase[led] -= steps;
+                mask |= (unsigned char)(1u << led);
+            }
+        }
+        return mask;
+    }
+
+private:
+    unsigned int steps;
+    unsigned char duty[LED_DITHER_LEDS];
+    unsigned char phase[LED_DITHER_LEDS];
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef __LEDEFFECTS_H_INCLUDED__
+#define __LEDEFFECTS_H_INCLUDED__
+#include "hidreport.h"
+#include "ledanim.h"
+
+// Effects played by the plugin and the CLI. LED_KEY_LIVE frames show the
+// gauge, LED_KEY_ENTRY frames whatever was lit when the effect started.
+
+// Truck electricity on: sweep to full, drop down to the gauge and blink it,
+// more insistently if the tank is nearly empty.
+static const led_keyframe_t ELECTRICITY_ON_SWEEP[] = {
+    { G29_LED_00000, 50 },
+    { G29_LED_00001, 50 },
+    { G29_LED_00010, 50 },
+    { G29_LED_00100, 50 },
+    { G29_LED_01000, 50 },
+    { G29_LED_10000, 50 },
+    { G29_LED_11000, 50 },
+    { G29_LED_11100, 50 },
+    { G29_LED_11110, 50 },
+    { G29_LED_11111, 50 }
+};
+static const led_keyframe_t ELECTRICITY_ON_DROP[] = {
+    { G29_LED_11111, 50 },
+    { G29_LED_01111, 50 },
+    { G29_LED_00111, 50 },
+    { G29_LED_00011, 50 },
+    { G29_LED_00001, 50 },
+    { G29_LED_00000, 50 }
+};
+static const led_keyframe_t ELECTRICITY_ON_BLINK[] = {
+    { LED_KEY_LIVE, 100 },
+    { G29_LED_NONE, 25 }
+};
+static const led_keyframe_t ELECTRICITY_ON_LOW_BLINK[] = {
+    { LED_KEY_LIVE, 100 },
+    { G29_LED_NONE, 50 }
+};
+static const led_segment_t ELECTRICITY_ON_SEGMENTS[] = {
+    { LED_FRAMES(ELECTRICITY_ON_SWEEP), 0, 0, 0 },
+    { LED_FRAMES(ELECTRICITY_ON_DROP), 0, LED_SEG_UNTIL_LIVE, 0 },
+    { LED_FRAMES(ELECTRICITY_ON_BLINK), 2, 0, 0 },
+    { LED_FRAMES(ELECTRICITY_ON_LOW_BLINK), 4, LED_SEG_WHEN_LIVE, G29_LED_00001 }
+};
+static const led_effect_t EFFECT_ELECTRICITY_ON = { "truck electricity on", LED_SEGMENTS(ELECTRICITY_ON_SEGMENTS) };
+
+// Truck electricity off: the gauge flickers out.
+static const led_keyframe_t ELECTRICITY_OFF_FLICKER[] = {
+    { G29_LED_NONE, 25 },
+    { LED_KEY_ENTRY, 200 },
+    { G29_LED_NONE, 30 },
+    { LED_KEY_ENTRY, 10 },
+    { G29_LED_NONE, 45 },
+    { LED_KEY_ENTRY, 160 },
+    { G29_LED_NONE, 50 },
+    { LED_KEY_ENTRY, 25 },
+    { G29_LED_NONE, 70 },
+    { LED_KEY_ENTRY, 10 }
+};
+static const led_segment_t ELECTRICITY_OFF_SEGMENTS[] = {
+    { LED_FRAMES(ELECTRICITY_OFF_FLICKER), 0, 0, 0 }
+};
+static const led_effect_t EFFECT_ELECTRICITY_OFF = { "truck electricity off", LED_SEGMENTS(ELECTRICITY_OFF_SEGMENTS) };
+
+// Star wars laser shot: a single LED running left to right, slowing down.
+static const led_keyframe_t LASER_SHOT[] = {
+    { G29_LED_10000, 50 },
+    { G29_LED_01000, 100 },
+    { G29_LED_00100, 150 },
+    { G29_LED_00010, 200 },
+    { G29_LED_00001, 450 },
+    { G29_LED_NONE, 100 }
+};
+static const led_keyframe_t LASER_REST[] = {
+    { G29_LED_NONE, 500 }
+};
+static const led_segment_t LASER_SEGMENTS[] = {
+    { LED_FRAMES(LASER_SHOT), 3, 0, 0 },
+    { LED_FRAMES(LASER_REST), 0, 0, 0 }
+};
+static const led_effect_t EFFECT_LASER = { "laser fire", LED_SEGMENTS(LASER_SEGMENTS) };
+
+// Tank fill: the gauge fills up, then a gap runs through the full bar.
+static const led_keyframe_t TANK_FILL_UP[] = {
+    { LED_KEY_ENTRY, 150 },
+    { G29_LED_00000, 150 },
+    { G29_LED_00001, 150 },
+    { G29_LED_00011, 150 },
+    { G29_LED_00111, 150 },
+    { G29_LED_01111, 150 },
+    { G29_LED_11111, 150 }
+};
+static const led_keyframe_t TANK_FILL_MISS[] = {
+    { G29_LED_11110, 50 },
+    { G29_LED_11101, 50 },
+    { G29_LED_11011, 50 },
+    { G29_LED_10111, 50 },
+    { G29_LED_01111, 50 }
+};
+static const led_keyframe_t TANK_FILL_FULL[] = {
+    { G29_LED_11111, 500 }
+};
+static const led_segment_t TANK_FILL_SEGMENTS[] = {
+    { LED_FRAMES(TANK_FILL_UP), 0, 0, 0 },
+    { LED_FRAMES(TANK_FILL_MISS), 9, 0, 0 },
+    { LED_FRAMES(TANK_FILL_FULL), 0, 0, 0 }
+};
+static const led_effect_t EFFECT_TANK_FILL = { "tank fill", LED_SEGMENTS(TANK_FILL_SEGMENTS) };
+
+#endif
@@ -1,6 +1,8 @@
 #include "pch.h"
 #include <stdio.h>
 #include <share.h>
+#include <atomic>
+#include <thread>
 #include "log.h"
 
 // TODO: Use ATS/ETS2 documents path (next to game.log.txt)
@@ -9,122 +11,292 @@
 #define LOGPATH LOGDIR LOGFILE
 #define LOG_PREFIX "G29LedPlugin: "
 
+// Messages are formatted straight into a slot of a bounded ring shared by
+// every thread, and written out to the game log (or our log file) by a
+// background thread, so logging costs the caller a single vsnprintf and
+// never a lock, an allocation or file I/O.
+//
+// The ring is a multi-producer queue: each slot carries a sequence number
+// telling whether it is free for the producer that claimed it or holds a
+// message for the consumer. Whoever holds logfile_access is the consumer:
+// the drain thread, or the logging thread itself while the drain thread
+// isn't running (before StartLogging() and after StopLogging()).
+#define LOG_RING_LEN 256 // must be a power of two
+#define LOG_MESSAGE_MAX 512 // longer messages are truncated
+#define LOG_DRAIN_INTERVAL 50 // ms the drain thread sleeps when not woken up
+
+struct log_slot_t {
+    std::atomic<unsigned int> sequence;
+    scs_log_type_t type;
+    FILETIME time;
+    char text[LOG_MESSAGE_MAX]; // LOG_PREFIX, then the message
+};
+
 scs_log_t game_log = nullptr;
 std::mutex logfile_access;
 
 static const size_t logprefix_len = strlen(LOG_PREFIX);
 
-static void logSCS(scs_log_type_t tp, const char* const message, va_list args) {
-    SYSTEMTIME st;
-    char* parsed_message;
-    int len;
+static log_slot_t ring[LOG_RING_LEN];
+static std::atomic<unsigned int> ring_tail(0); // next slot producers claim
+static unsigned int ring_head = 0; // next slot the consumer reads
+static std::atomic<bool> ring_ready(false);
+static std::mutex ring_init;
 
-    if (game_log != nullptr) {
-        len = _vscprintf(message, args) + 1;
-        if (len < 1) return;
-        parsed_message = (char*)malloc((len + logprefix_len) * sizeof(char));
-        if (!parsed_message) return;
-        memcpy_s(parsed_message, logprefix_len, LOG_PREFIX, logprefix_len);
-        if (!&parsed_message[logprefix_len]) return;
-        vsprintf_s(&parsed_message[logprefix_len], len, message, args);
-        game_log(tp, parsed_message);
-        free(parsed_message);
-    } else {
-        GetSystemTime(&st);
-        logfile_access.lock();
-        FILE* loghandle = _fsopen(LOGPATH, "a", _SH_DENYWR);
-        fprintf_s(loghandle, "%04d-%02d-%02d %02d:%02d:%02d.%03d UTC: ",
-            st.wYear, st.wMonth, st.wDay,
-            st.wHour, st.wMinute, st.wSecond,
-            st.wMilliseconds);
-
-        vfprintf(loghandle, message, args);
-
-        fwrite("\n", 1, 1, loghandle);
-        fclose(loghandle);
-        logfile_access.unlock();
+static std::atomic<bool> draining(false);
+static std::thread* drain_thread = nullptr;
+static HANDLE drain_wakeup = NULL;
+static FILE* logfile = nullptr;
+
+static std::atomic<unsigned long long> stat_messages(0);
+static std::atomic<unsigned long long> stat_dropped(0);
+static std::atomic<unsigned long long> stat_ticks(0); // QueryPerformanceCounter ticks spent in log calls
+
+static void initRing() {
+    std::lock_guard<std::mutex> guard(ring_init);
+    if (ring_ready) return;
+    for (unsigned int i = 0; i < LOG_RING_LEN; i++) ring[i].sequence.store(i, std::memory_order_relaxed);
+    ring_ready = true;
+}
+
+// Claims a free slot, or returns nullptr if the ring is full. The caller
+// fills it in and hands it over with publish().
+static log_slot_t* claim(unsigned int* position) {
+    unsigned int pos = ring_tail.load(std::memory_order_relaxed);
+
+    if (!ring_ready) initRing();
+    while (true) {
+        log_slot_t* slot = &ring[pos & (LOG_RING_LEN - 1)];
+        int diff = (int)(slot->sequence.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (ring_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                *position = pos;
+                return slot;
+            }
+        } else if (diff < 0) {
+            return nullptr;
+        } else {
+            pos = ring_tail.load(std::memory_order_relaxed);
+        }
     }
 }
 
-static void logSCS(scs_log_type_t tp, const wchar_t* const message, va_list args) {
+static void publish(log_slot_t* slot, unsigned int position) {
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+static void writeEntry(const log_slot_t* slot) {
     SYSTEMTIME st;
-    wchar_t* parsed_message;
-    char* converted_message;
-    int wlen;
-    size_t sz;
 
     if (game_log != nullptr) {
-        wlen = _vscwprintf(message, args) + 1;
+        game_log(slot->type, slot->text);
+        return;
+    }
+
+    if (logfile == nullptr) {
+        logfile = _fsopen(LOGPATH, "a", _SH_DENYWR);
+        if (logfile == nullptr) return;
+    }
+    FileTimeToSystemTime(&slot->time, &st);
+    fprintf_s(logfile, "%04d-%02d-%02d %02d:%02d:%02d.%03d UTC: %s\n",
+        st.wYear, st.wMonth, st.wDay,
+        st.wHour, st.wMinute, st.wSecond,
+        st.wMilliseconds, &slot->text[logprefix_len]);
+}
 
-        if (wlen < 1) return;
+// Writes out every message published so far. Callers hold logfile_access.
+static void drain() {
+    unsigned long long dropped;
+    bool wrote = false;
+
+    while (true) {
+        log_slot_t* slot = &ring[ring_head & (LOG_RING_LEN - 1)];
+        if (slot->sequence.load(std::memory_order_acquire) != ring_head + 1) break;
+        writeEntry(slot);
+        slot->sequence.store(ring_head + LOG_RING_LEN, std::memory_order_release);
+        ring_head++;
+        wrote = true;
+    }
 
-        parsed_message = (wchar_t*)malloc(wlen * sizeof(wchar_t));
-        if (!parsed_message) return;
-        vswprintf_s(parsed_message, wlen, message, args);
+    dropped = stat_dropped.exchange(0);
+    if (dropped) {
+        log_slot_t note;
+        note.type = SCS_LOG_TYPE_warning;
+        GetSystemTimeAsFileTime(&note.time);
+        snprintf(note.text, sizeof(note.text), LOG_PREFIX "%llu log messages dropped: the log ring was full.", dropped);
+        writeEntry(&note);
+        wrote = true;
+    }
 
-        if (wcstombs_s(&sz, nullptr, 0, parsed_message, _TRUNCATE) == S_OK) {
-            converted_message = (char*)malloc(sz + logprefix_len);
-            memcpy_s(converted_message, logprefix_len, LOG_PREFIX, logprefix_len);
-            if (wcstombs_s(nullptr, &converted_message[logprefix_len], sz, parsed_message, _TRUNCATE) == S_OK)
-                game_log(tp, converted_message);
-            free(converted_message);
+    // Close the file between bursts while nothing keeps it open for us.
+    if (wrote && logfile != nullptr) {
+        if (draining) fflush(logfile);
+        else {
+            fclose(logfile);
+            logfile = nullptr;
         }
-        free(parsed_message);
+    }
+}
+
+static void drainLoop() {
+    while (draining) {
+        WaitForSingleObject(drain_wakeup, LOG_DRAIN_INTERVAL);
+        std::lock_guard<std::mutex> guard(logfile_access);
+        drain();
+    }
+}
+
+static void enqueue(scs_log_type_t tp, const char* message, const wchar_t* wmessage, va_list args) {
+    LARGE_INTEGER start, end;
+    unsigned int position;
+    log_slot_t* slot;
+
+    QueryPerformanceCounter(&start);
+    slot = claim(&position);
+    if (slot == nullptr) {
+        stat_dropped++;
+        return;
+    }
+
+    slot->type = tp;
+    GetSystemTimeAsFileTime(&slot->time);
+    memcpy(slot->text, LOG_PREFIX, logprefix_len);
+    if (message != nullptr) {
+        vsnprintf(&slot->text[logprefix_len], LOG_MESSAGE_MAX - logprefix_len, message, args);
     } else {
-        GetSystemTime(&st);
-        logfile_access.lock();
-        FILE* loghandle = _fsopen(LOGPATH, "a", _SH_DENYWR);
-        fwprintf_s(loghandle, L"%04d-%02d-%02d %02d:%02d:%02d.%03d UTC: ",
-            st.wYear, st.wMonth, st.wDay,
-            st.wHour, st.wMinute, st.wSecond,
-            st.wMilliseconds);
-
-        vfwprintf(loghandle, message, args);
-
-        fwprintf_s(loghandle, L"\n");
-        fclose(loghandle);
-        logfile_access.unlock();
+        wchar_t wide[LOG_MESSAGE_MAX];
+        size_t converted;
+        _vsnwprintf_s(wide, LOG_MESSAGE_MAX, _TRUNCATE, wmessage, args);
+        if (wcstombs_s(&converted, &slot->text[logprefix_len], LOG_MESSAGE_MAX - logprefix_len, wide, _TRUNCATE) != 0) {
+            slot->text[logprefix_len] = '\0';
+        }
     }
+    publish(slot, position);
+
+    stat_messages++;
+    QueryPerformanceCounter(&end);
+    stat_ticks += end.QuadPart - start.QuadPart;
+
+    if (!draining) {
+        std::lock_guard<std::mutex> guard(logfile_access);
+        drain();
+    } else if (tp == SCS_LOG_TYPE_error || (position & (LOG_RING_LEN / 2 - 1)) == 0) {
+        // Errors go out right away; otherwise the drain thread wakes up on
+        // its own, or every half ring during bursts.
+        SetEvent(drain_wakeup);
+    }
+}
+
+// Starts writing messages out from a background thread. Until then, and
+// after StopLogging(), each log call writes its message out itself.
+HRESULT StartLogging() {
+    if (drain_thread != nullptr) return S_OK;
+
+    drain_wakeup = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (drain_wakeup == NULL) return HRESULT_FROM_WIN32(GetLastError());
+
+    stat_messages = 0;
+    stat_ticks = 0;
+    draining = true;
+    drain_thread = new std::thread(drainLoop);
+    return S_OK;
+}
+
+// Writes out everything still queued and stops the background thread. Must
+// be called while game_log is still usable.
+void StopLogging() {
+    LARGE_INTEGER frequency;
+    unsigned long long messages = stat_messages, ticks = stat_ticks;
+
+    if (drain_thread == nullptr) return;
+
+    QueryPerformanceFrequency(&frequency);
+    log("Logging: %llu messages, %llu ns per call on average.",
+        messages, messages ? (unsigned long long)(ticks * 1000000000ULL / frequency.QuadPart / messages) : 0ULL);
+
+    draining = false;
+    SetEvent(drain_wakeup);
+    drain_thread->join();
+    delete drain_thread;
+    drain_thread = nullptr;
+    CloseHandle(drain_wakeup);
+    drain_wakeup = NULL;
+
+    std::lock_guard<std::mutex> guard(logfile_access);
+    drain();
+    if (logfile != nullptr) fclose(logfile);
+    logfile = nullptr;
+}
+
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_DEBUG
+void logDebugMessage(const char* message, ...) {
+    va_list args;
+    va_start(args, message);
+    enqueue(SCS_LOG_TYPE_message, message, nullptr, args);
+    va_end(args);
 }
+#endif
 
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_INFO
 void log(const char* message, ...) {
     va_list args;
     va_start(args, message);
-    logSCS(SCS_LOG_TYPE_message, message, args);
+    enqueue(SCS_LOG_TYPE_message, message, nullptr, args);
     va_end(args);
 }
 
-void logErr(const char* message, ...) {
+void log(const wchar_t* message, ...) {
     va_list args;
     va_start(args, message);
-    logSCS(SCS_LOG_TYPE_error, message, args);
+    enqueue(SCS_LOG_TYPE_message, nullptr, message, args);
     va_end(args);
 }
+#endif
 
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_WARNING
 void logWarn(const char* message, ...) {
     va_list args;
     va_start(args, message);
-    logSCS(SCS_LOG_TYPE_warning, message, args);
+    enqueue(SCS_LOG_TYPE_warning, message, nullptr, args);
     va_end(args);
 }
 
-void log(const wchar_t* message, ...) {
+void logWarn(const wchar_t* message, ...) {
     va_list args;
     va_start(args, message);
-    logSCS(SCS_LOG_TYPE_message, message, args);
+    enqueue(SCS_LOG_TYPE_warning, nullptr, message, args);
     va_end(args);
 }
+#endif
 
-void logErr(const wchar_t* message, ...) {
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_ERROR
+void logErr(const char* message, ...) {
     va_list args;
     va_start(args, message);
-    logSCS(SCS_LOG_TYPE_error, message, args);
+    enqueue(SCS_LOG_TYPE_error, message, nullptr, args);
     va_end(args);
 }
 
-void logWarn(const wchar_t* message, ...) {
+void logErr(const wchar_t* message, ...) {
     va_list args;
     va_start(args, message);
-    logSCS(SCS_LOG_TYPE_warning, message, args);
+    enqueue(SCS_LOG_TYPE_error, nullptr, message, args);
     va_end(args);
-}
\ No newline at end of file
+}
+#endif
+
+// Logs `msg` along with the system's description of GetLastError().
+void detailedError(const wchar_t* msg) {
+    LPVOID lpMsgBuf;
+    DWORD leid = GetLastError();
+    FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+        NULL,
+        leid,
+        0,
+        (LPWSTR)&lpMsgBuf,
+        0, NULL);
+
+    logErr(L"Error: %s: %s (0x%x)", msg, (LPWSTR)lpMsgBuf, leid);
+    LocalFree(lpMsgBuf);
+    SetLastError(leid);
+}
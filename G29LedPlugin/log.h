@@ -1,14 +1,118 @@
 #ifndef __LOG_H_INCLUDED__
 #define __LOG_H_INCLUDED__
+#include <atomic>
 #include <mutex>
 
+// Severities, lowest first. Levels below G29LED_LOG_LEVEL are compiled out:
+// their functions turn into empty inlines the compiler drops along with the
+// call, and their macros (logDebug() and the rate limited *Every() ones)
+// into nothing at all, arguments included. Building with
+// G29LED_LOG_LEVEL=LOG_LEVEL_DEBUG is what it takes to get debug output.
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+#ifndef G29LED_LOG_LEVEL
+#define G29LED_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
 extern scs_log_t game_log;
 extern std::mutex logfile_access;
+
+HRESULT StartLogging();
+void StopLogging();
+
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_DEBUG
+void logDebugMessage(const char* const message, ...);
+#define logDebug(...) logDebugMessage(__VA_ARGS__)
+#else
+#define logDebug(...) ((void)0)
+#endif
+
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_INFO
 void log(const char* const message, ...);
 void log(const wchar_t* const message, ...);
-void logErr(const char* const message, ...);
-void logErr(const wchar_t* const message, ...);
+#else
+inline void log(const char* const, ...) {}
+inline void log(const wchar_t* const, ...) {}
+#endif
+
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_WARNING
 void logWarn(const char* const message, ...);
 void logWarn(const wchar_t* const message, ...);
+#else
+inline void logWarn(const char* const, ...) {}
+inline void logWarn(const wchar_t* const, ...) {}
+#endif
+
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_ERROR
+void logErr(const char* const message, ...);
+void logErr(const wchar_t* const message, ...);
+#else
+inline void logErr(const char* const, ...) {}
+inline void logErr(const wchar_t* const, ...) {}
+#endif
+
+void detailedError(const wchar_t* msg);
+
+// Per call site budget of messages per second, for sites that may run every
+// frame. Lives in a function local static, so it needs no constructor.
+struct log_rate_limit_t {
+    std::atomic<unsigned long long> second; // GetTickCount64() / 1000 when the budget was last reset
+    std::atomic<unsigned int> sent; // this second
+    std::atomic<unsigned long long> suppressed; // since the last message that got through
+
+    // Whether a message may go out now. If so, `skipped` tells how many were
+    // suppressed before it.
+    bool allow(unsigned int per_second, unsigned long long* skipped) {
+        unsigned long long now = GetTickCount64() / 1000;
+        if (second.load(std::memory_order_relaxed) != now) {
+            // Racing threads may each reset it; a message or two more is fine.
+            second.store(now, std::memory_order_relaxed);
+            sent.store(0, std::memory_order_relaxed);
+        }
+        if (sent.fetch_add(1, std::memory_order_relaxed) >= per_second) {
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        *skipped = suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+// Logs at most `per_second` messages a second from this call site. The
+// first message let through after some were dropped is preceded by a note
+// saying how many.
+#define LOG_RATE_LIMITED(logger, per_second, ...) do { \
+        static log_rate_limit_t log_site_limit; \
+        unsigned long long log_site_skipped; \
+        if (log_site_limit.allow(per_second, &log_site_skipped)) { \
+            if (log_site_skipped) logger("(%llu similar messages suppressed)", log_site_skipped); \
+            logger(__VA_ARGS__); \
+        } \
+    } while (0)
+
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define logDebugEvery(per_second, ...) LOG_RATE_LIMITED(logDebugMessage, per_second, __VA_ARGS__)
+#else
+#define logDebugEvery(per_second, ...) ((void)0)
+#endif
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_INFO
+#define logEvery(per_second, ...) LOG_RATE_LIMITED(log, per_second, __VA_ARGS__)
+#else
+#define logEvery(per_second, ...) ((void)0)
+#endif
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_WARNING
+#define logWarnEvery(per_second, ...) LOG_RATE_LIMITED(logWarn, per_second, __VA_ARGS__)
+#else
+#define logWarnEvery(per_second, ...) ((void)0)
+#endif
+#if G29LED_LOG_LEVEL <= LOG_LEVEL_ERROR
+#define logErrEvery(per_second, ...) LOG_RATE_LIMITED(logErr, per_second, __VA_ARGS__)
+#else
+#define logErrEvery(per_second, ...) ((void)0)
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,459 @@
+// Built without the precompiled header: shared with the tools, which may
+// run on other systems.
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "memscan.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MEMSCAN_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MEMSCAN_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define MEMSCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Regions are filtered this many words at a time, checking for cancellation
+// in between (1 MiB).
+#define MEM_SCAN_CHUNK 131072
+
+// A word is a candidate if (value - low) <= (high - low), compared unsigned:
+// a single subtraction and comparison per word, whatever the range.
+
+static void filterScalar(const uintptr_t* words, size_t count, uintptr_t low, uintptr_t span, std::vector<unsigned int>* out) {
+    for (size_t i = 0; i < count; i++) {
+        if (words[i] - low <= span) out->push_back((unsigned int)i);
+    }
+}
+
+#if defined(MEMSCAN_X86) && (defined(_M_X64) || defined(__x86_64__))
+// SSE2 has no 64-bit comparisons, so four words at a time are compared on
+// the high halves of (value - low) only; the few that pass are checked in
+// full. With the spans we search (a few GiB) nearly every word is rejected
+// by the first test.
+static void filterSSE2(const uintptr_t* words, size_t count, uintptr_t low, uintptr_t span, std::vector<unsigned int>* out) {
+    const __m128i bias = _mm_set1_epi32((int)0x80000000);
+    const __m128i lows = _mm_set1_epi64x((long long)low);
+    const __m128i limit = _mm_xor_si128(_mm_set1_epi32((int)(unsigned int)(span >> 32)), bias);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i d0 = _mm_sub_epi64(_mm_loadu_si128((const __m128i*)&words[i]), lows);
+        __m128i d1 = _mm_sub_epi64(_mm_loadu_si128((const __m128i*)&words[i + 2]), lows);
+        __m128 high = _mm_shuffle_ps(_mm_castsi128_ps(d0), _mm_castsi128_ps(d1), _MM_SHUFFLE(3, 1, 3, 1));
+        __m128i over = _mm_cmpgt_epi32(_mm_xor_si128(_mm_castps_si128(high), bias), limit);
+        int pass = ~_mm_movemask_ps(_mm_castsi128_ps(over)) & 0xf;
+
+        while (pass) {
+            int lane = 0;
+            while (!(pass & (1 << lane))) lane++;
+            pass &= pass - 1;
+            if (words[i + lane] - low <= span) out->push_back((unsigned int)(i + lane));
+        }
+    }
+    for (; i < count; i++) {
+        if (words[i] - low <= span) out->push_back((unsigned int)i);
+    }
+}
+
+// AVX2 compares 64-bit lanes directly; biasing both sides by the sign bit
+// turns its signed comparison into an unsigned one. Eight words per round.
+MEMSCAN_TARGET_AVX2
+static void filterAVX2(const uintptr_t* words, size_t count, uintptr_t low, uintptr_t span, std::vector<unsigned int>* out) {
+    const __m256i bias = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    const __m256i lows = _mm256_set1_epi64x((long long)low);
+    const __m256i limit = _mm256_xor_si256(_mm256_set1_epi64x((long long)span), bias);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i d0 = _mm256_xor_si256(_mm256_sub_epi64(_mm256_loadu_si256((const __m256i*)&words[i]), lows), bias);
+        __m256i d1 = _mm256_xor_si256(_mm256_sub_epi64(_mm256_loadu_si256((const __m256i*)&words[i + 4]), lows), bias);
+        int over = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(d0, limit))) |
+            (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(d1, limit))) << 4);
+        int pass = ~over & 0xff;
+
+        while (pass) {
+            int lane = 0;
+            while (!(pass & (1 << lane))) lane++;
+            pass &= pass - 1;
+            out->push_back((unsigned int)(i + lane));
+        }
+    }
+    for (; i < count; i++) {
+        if (words[i] - low <= span) out->push_back((unsigned int)i);
+    }
+}
+#define MEMSCAN_SIMD
+#endif
+
+mem_scan_impl_t BestScanImpl() {
+#ifdef MEMSCAN_SIMD
+    static mem_scan_impl_t best = MEM_SCAN_AUTO;
+    if (best != MEM_SCAN_AUTO) return best;
+
+    bool avx2;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    avx2 = false;
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        // OSXSAVE and AVX, and the OS saving the YMM registers.
+        if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+    }
+#else
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+    best = avx2 ? MEM_SCAN_AVX2 : MEM_SCAN_SSE2;
+    return best;
+#else
+    return MEM_SCAN_SCALAR;
+#endif
+}
+
+const char* ScanImplName(mem_scan_impl_t impl) {
+    switch (impl) {
+    case MEM_SCAN_SCALAR: return "scalar";
+    case MEM_SCAN_SSE2: return "SSE2";
+    case MEM_SCAN_AVX2: return "AVX2";
+    default: return "auto";
+    }
+}
+
+static mem_scan_impl_t resolveImpl(mem_scan_impl_t impl) {
+    mem_scan_impl_t best = BestScanImpl();
+    if (impl == MEM_SCAN_AUTO || impl > best) return best;
+    return impl;
+}
+
+void FilterPointerWords(const uintptr_t* words, size_t count, uintptr_t low, uintptr_t high,
+    mem_scan_impl_t impl, std::vector<unsigned int>* out) {
+    if (high < low) return;
+
+    switch (resolveImpl(impl)) {
+#ifdef MEMSCAN_SIMD
+    case MEM_SCAN_AVX2:
+        filterAVX2(words, count, low, high - low, out);
+        break;
+    case MEM_SCAN_SSE2:
+        filterSSE2(words, count, low, high - low, out);
+        break;
+#endif
+    default:
+        filterScalar(words, count, low, high - low, out);
+    }
+}
+
+// The window is searched in bands of increasing distance from `ref`: band
+// k holds the words between k and k + 1 times MEM_SCAN_BAND bytes below it
+// and above it. Each band is filtered and its candidates validated in the
+// walk's order, so the first band holding a match holds the nearest one.
+// Workers take bands in order; once a match is confirmed in a band, bands
+// further away are dropped, and bands nearer still being worked on are
+// finished, as they may hold a nearer match.
+#define MEM_SCAN_BAND (MEM_SCAN_CHUNK * sizeof(uintptr_t))
+#define MEM_SCAN_NO_BAND ((size_t)-1)
+
+struct mem_scan_job_t {
+    const mem_region_t* regions;
+    size_t count;
+    const mem_scan_t* scan;
+    mem_scan_validator_t validate;
+    void* context;
+    mem_scan_impl_t impl;
+    size_t bands;
+    std::atomic<size_t> next_band;
+    std::atomic<size_t> best_band; // nearest band with a match so far
+    std::atomic<bool> faulted;
+    std::vector<uintptr_t> matches; // by band
+};
+
+// Worker-side part of mem_scan_stats_t.
+struct mem_scan_counts_t {
+    unsigned long long words;
+    unsigned long long candidates;
+    unsigned long long validated;
+    bool cancelled;
+};
+
+static bool stopBand(mem_scan_job_t* job, size_t band, mem_scan_counts_t* counts) {
+    if (job->scan->cancel != nullptr && job->scan->cancel->load(std::memory_order_relaxed)) {
+        counts->cancelled = true;
+        return true;
+    }
+    return job->best_band.load(std::memory_order_relaxed) < band;
+}
+
+// Appends the addresses of the candidates in [from, to) to `candidates`,
+// ascending. Returns false if the band was given up on.
+static bool collectBand(mem_scan_job_t* job, size_t band, uintptr_t from, uintptr_t to,
+    std::vector<uintptr_t>* candidates, std::vector<unsigned int>* hits, mem_scan_counts_t* counts) {
+    const mem_scan_t& scan = *job->scan;
+    const uintptr_t skew = scan.ref % sizeof(uintptr_t);
+    const mem_region_t* region = std::upper_bound(job->regions, job->regions + job->count, from,
+        [](uintptr_t at, const mem_region_t& region) { return at < region.base; });
+    if (region != job->regions) region--;
+
+    for (; region < job->regions + job->count && region->base < to; region++) {
+        uintptr_t start = std::max(region->base, from);
+        uintptr_t end = std::min(region->base + region->size, to);
+
+        // Only words at a whole number of words from `ref`, like the walk.
+        start += (skew - start % sizeof(uintptr_t) + sizeof(uintptr_t)) % sizeof(uintptr_t);
+        if (end <= start || end - start < sizeof(uintptr_t)) continue;
+
+        size_t words = (end - start) / sizeof(uintptr_t);
+        const uintptr_t* first = (const uintptr_t*)(region->data + (start - region->base));
+
+        for (size_t done = 0; done < words; done += MEM_SCAN_CHUNK) {
+            size_t chunk = std::min(words - done, (size_t)MEM_SCAN_CHUNK);
+            if (stopBand(job, band, counts)) return false;
+
+            hits->clear();
+            FilterPointerWords(first + done, chunk, scan.low, scan.high, job->impl, hits);
+            for (size_t i = 0; i < hits->size(); i++) {
+                uintptr_t address = start + (done + (*hits)[i]) * sizeof(uintptr_t);
+                if (address != scan.ref) candidates->push_back(address);
+            }
+            counts->words += chunk;
+        }
+    }
+    return true;
+}
+
+static void scanBand(mem_scan_job_t* job, size_t band, std::vector<uintptr_t>* candidates,
+    std::vector<unsigned int>* hits, mem_scan_counts_t* counts) {
+    const mem_scan_t& scan = *job->scan;
+    uintptr_t near_offset = band * MEM_SCAN_BAND, far_offset = near_offset + MEM_SCAN_BAND;
+    size_t first_above;
+
+    // Below `ref`, then above it, clipped to the window.
+    candidates->clear();
+    if (scan.ref > near_offset) {
+        uintptr_t from = std::max(scan.ref > far_offset ? scan.ref - far_offset : 0, scan.from);
+        uintptr_t to = std::min(scan.ref - near_offset, scan.to);
+        if (from < to && !collectBand(job, band, from, to, candidates, hits, counts)) return;
+    }
+    first_above = candidates->size();
+    {
+        uintptr_t from = std::max(scan.ref + near_offset, scan.from);
+        uintptr_t to = std::min(scan.ref + far_offset, scan.to);
+        if (from < to && !collectBand(job, band, from, to, candidates, hits, counts)) return;
+    }
+    counts->candidates += candidates->size();
+
+    // Walk outwards from `ref`, the lower side first on a tie.
+    size_t below = first_above, above = first_above;
+    while (below > 0 || above < candidates->size()) {
+        uintptr_t address;
+        if (above == candidates->size() ||
+            (below > 0 && scan.ref - (*candidates)[below - 1] <= (*candidates)[above] - scan.ref)) {
+            address = (*candidates)[--below];
+        } else {
+            address = (*candidates)[above++];
+        }
+
+        const mem_region_t* region = std::upper_bound(job->regions, job->regions + job->count, address,
+            [](uintptr_t at, const mem_region_t& region) { return at < region.base; }) - 1;
+        uintptr_t value;
+        memcpy(&value, region->data + (address - region->base), sizeof(value));
+
+        if (stopBand(job, band, counts)) return;
+
+        counts->validated++;
+        if (job->validate(value, address, job->context)) {
+            size_t best = job->best_band.load(std::memory_order_relaxed);
+            job->matches[band] = address;
+            while (band < best && !job->best_band.compare_exchange_weak(best, band, std::memory_order_relaxed)) {}
+            return;
+        }
+    }
+}
+
+// Live memory may be released while it's scanned; on Windows that's caught
+// and the search given up on, leaking the band's vectors.
+static bool guardedBand(mem_scan_job_t* job, size_t band, std::vector<uintptr_t>* candidates,
+    std::vector<unsigned int>* hits, mem_scan_counts_t* counts) {
+#ifdef _MSC_VER
+    __try {
+        scanBand(job, band, candidates, hits, counts);
+    } __except (GetExceptionCode() == EXCEPTION_ACCESS_VIOLATION ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        return false;
+    }
+#else
+    scanBand(job, band, candidates, hits, counts);
+#endif
+    return true;
+}
+
+static void scanBands(mem_scan_job_t* job, mem_scan_counts_t* counts) {
+    std::vector<uintptr_t> candidates;
+    std::vector<unsigned int> hits;
+
+    memset(counts, 0, sizeof(*counts));
+    while (!counts->cancelled && !job->faulted.load(std::memory_order_relaxed)) {
+        size_t band = job->next_band.fetch_add(1, std::memory_order_relaxed);
+        if (band >= job->bands || band > job->best_band.load(std::memory_order_relaxed)) break;
+        if (!guardedBand(job, band, &candidates, &hits, counts)) job->faulted = true;
+    }
+}
+
+// Helpers kept from one search to the next: starting and joining threads
+// took about as long as a small search. They sleep until a search posts its
+// job, each take a share of its bands, and the last one done wakes the
+// search up. Searches take turns.
+struct mem_scan_pool_t {
+    std::mutex searching; // held for a whole search
+    std::mutex lock; // the rest
+    std::condition_variable posted;
+    std::condition_variable done;
+    std::vector<std::thread> helpers;
+    mem_scan_job_t* job; // while a search runs
+    mem_scan_counts_t* counts; // the job's, one per thread; 0 is the search's own
+    unsigned int wanted; // helpers the job asked for
+    unsigned int taken; // helpers that joined it
+    unsigned int busy; // helpers not done with it yet
+    bool stopping;
+
+    mem_scan_pool_t() : job(nullptr), counts(nullptr), wanted(0), taken(0), busy(0), stopping(false) {}
+    ~mem_scan_pool_t() { stop(); }
+
+    void helperLoop() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            posted.wait(guard, [this] { return stopping || (job != nullptr && taken < wanted); });
+            if (stopping) return;
+            mem_scan_job_t* current = job;
+            mem_scan_counts_t* mine = &counts[++taken];
+            guard.unlock();
+            scanBands(current, mine);
+            guard.lock();
+            if (--busy == 0) done.notify_one();
+        }
+    }
+
+    // Runs `job` on `threads` threads, the calling one included.
+    void run(mem_scan_job_t* new_job, mem_scan_counts_t* job_counts, unsigned int threads) {
+        std::lock_guard<std::mutex> turn(searching);
+        while (helpers.size() < threads - 1) helpers.emplace_back(&mem_scan_pool_t::helperLoop, this);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            job = new_job;
+            counts = job_counts;
+            wanted = threads - 1;
+            taken = 0;
+            busy = threads - 1;
+        }
+        if (threads > 1) posted.notify_all();
+
+        scanBands(new_job, &job_counts[0]);
+
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this] { return busy == 0; });
+        job = nullptr;
+        counts = nullptr;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> turn(searching);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        posted.notify_all();
+        for (std::thread& helper : helpers) helper.join();
+        helpers.clear();
+        stopping = false;
+    }
+};
+
+static mem_scan_pool_t scan_pool;
+
+// In a DLL, this must run before it's unloaded: static destructors run
+// under the loader lock there, and can't wait for threads to exit.
+void StopPointerSearchThreads() {
+    scan_pool.stop();
+}
+
+uintptr_t FindNearestPointer(const mem_region_t* regions, size_t count, const mem_scan_t& scan,
+    mem_scan_validator_t validate, void* context, mem_scan_stats_t* stats) {
+    mem_scan_job_t job;
+    unsigned int threads = std::max(scan.threads, 1u);
+    std::vector<mem_scan_counts_t> counts(threads);
+    // How far from `ref` the window reaches, on either side.
+    uintptr_t reach = std::max(scan.ref - std::min(scan.from, scan.ref), std::max(scan.to, scan.ref) - scan.ref);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->impl = resolveImpl(scan.impl);
+    stats->threads = threads;
+    for (size_t r = 0; r < count; r++) {
+        if (regions[r].base < scan.to && regions[r].base + regions[r].size > scan.from) stats->regions++;
+    }
+    if (scan.from >= scan.to) return 0;
+
+    job.regions = regions;
+    job.count = count;
+    job.scan = &scan;
+    job.validate = validate;
+    job.context = context;
+    job.impl = stats->impl;
+    job.bands = (reach + MEM_SCAN_BAND - 1) / MEM_SCAN_BAND;
+    job.next_band = 0;
+    job.best_band = MEM_SCAN_NO_BAND;
+    job.faulted = false;
+    job.matches.assign(job.bands, 0);
+
+    scan_pool.run(&job, counts.data(), threads);
+
+    for (const mem_scan_counts_t& worker : counts) {
+        stats->words += worker.words;
+        stats->candidates += worker.candidates;
+        stats->validated += worker.validated;
+        stats->cancelled |= worker.cancelled;
+    }
+    stats->faulted = job.faulted;
+    if (stats->cancelled || stats->faulted || job.best_band == MEM_SCAN_NO_BAND) return 0;
+    return job.matches[job.best_band];
+}
+
+#ifdef _WIN32
+void CollectReadableRegions(uintptr_t from, uintptr_t to, std::vector<mem_region_t>* regions) {
+    const DWORD readable = PAGE_READONLY | PAGE_READWRITE | PAGE_WRITECOPY |
+        PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+    MEMORY_BASIC_INFORMATION info;
+    uintptr_t at = from;
+
+    while (at < to && VirtualQuery((LPCVOID)at, &info, sizeof(info)) == sizeof(info)) {
+        uintptr_t base = (uintptr_t)info.BaseAddress;
+        uintptr_t end = base + info.RegionSize;
+        if (end <= at) break;
+
+        if (info.State == MEM_COMMIT && (info.Protect & readable) && !(info.Protect & (PAGE_GUARD | PAGE_NOACCESS))) {
+            uintptr_t start = std::max(base, from);
+            uintptr_t stop = std::min(end, to);
+            if (!regions->empty() && regions->back().base + regions->back().size == start) {
+                // Adjacent regions only differ in attributes we don't care about.
+                regions->back().size += stop - start;
+            } else {
+                mem_region_t region = { start, stop - start, (const unsigned char*)start };
+                regions->push_back(region);
+            }
+        }
+        at = end;
+    }
+}
+#endif
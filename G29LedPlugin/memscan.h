@@ -0,0 +1,81 @@
+#ifndef __MEMSCAN_H_INCLUDED__
+#define __MEMSCAN_H_INCLUDED__
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// Pointer search over memory regions: looks for words holding a value within
+// a range (pointers into the game's read-write heap), nearest to a reference
+// address first, and hands each one to a validator until it accepts one.
+//
+// Regions are either live memory or an image of it (a dump, a synthetic
+// heap), so the scan can run and be measured away from the game. Built
+// without the precompiled header for the same reason.
+
+struct mem_region_t {
+    uintptr_t base; // address the region has in the scanned process
+    size_t size; // bytes
+    const unsigned char* data; // its contents, readable by us
+};
+
+enum mem_scan_impl_t {
+    MEM_SCAN_AUTO, // best the CPU supports
+    MEM_SCAN_SCALAR,
+    MEM_SCAN_SSE2,
+    MEM_SCAN_AVX2
+};
+
+struct mem_scan_t {
+    uintptr_t ref; // words are tried nearest to this address first
+    uintptr_t from, to; // addresses of the words to look at
+    uintptr_t low, high; // values of interest, inclusive
+    mem_scan_impl_t impl;
+    const std::atomic<bool>* cancel; // optional; set to stop the search early
+    unsigned int threads; // searching, the calling one included; 0 means 1
+};
+
+struct mem_scan_stats_t {
+    size_t regions;
+    unsigned long long words; // scanned
+    unsigned long long candidates; // words holding a value in [low, high]
+    unsigned long long validated; // candidates handed to the validator
+    mem_scan_impl_t impl; // actually used
+    unsigned int threads;
+    bool cancelled;
+    bool faulted; // memory was released while being scanned (Windows only)
+};
+
+// Gets the candidate value and the address of the word holding it; returns
+// true to stop the search there. With several threads, it's called from all
+// of them at once.
+typedef bool (*mem_scan_validator_t)(uintptr_t value, uintptr_t address, void* context);
+
+// Indexes of the `count` words whose value lies in [low, high], appended to
+// `out` in order.
+void FilterPointerWords(const uintptr_t* words, size_t count, uintptr_t low, uintptr_t high,
+    mem_scan_impl_t impl, std::vector<unsigned int>* out);
+
+// Finds the candidate the validator accepts that the word by word walk away
+// from `ref` would have reached first: one word below, one above, two
+// below... With several threads, candidates further away may be validated
+// too, but the nearest match still wins. Returns the address of the word
+// holding it, 0 if there's none or the search was cancelled. Regions must be
+// sorted by address and not overlap.
+uintptr_t FindNearestPointer(const mem_region_t* regions, size_t count, const mem_scan_t& scan,
+    mem_scan_validator_t validate, void* context, mem_scan_stats_t* stats);
+
+// Ends the threads FindNearestPointer() keeps between searches; the next
+// search starts them again.
+void StopPointerSearchThreads();
+
+mem_scan_impl_t BestScanImpl();
+const char* ScanImplName(mem_scan_impl_t impl);
+
+#ifdef _WIN32
+// Committed, readable regions of our own process overlapping [from, to),
+// clipped to it, as found by VirtualQuery.
+void CollectReadableRegions(uintptr_t from, uintptr_t to, std::vector<mem_region_t>* regions);
+#endif
+
+#endif
@@ -1,24 +1,44 @@
 #include "pch.h"
+#include <mutex>
+#include <thread>
 #include "log.h"
 #include "poller.h"
 #include "truck.h"
 #include "g29led.h"
 
-#define LOCK truck_data_access.lock();
-#define UNLOCK truck_data_access.unlock();
-
-#define POLL_INTERVAL 10
-
-#define WAITPOLL Sleep(POLL_INTERVAL);
-#define WAITNEXT WAITPOLL continue;
+// How long to wait before retrying after failing to update the LEDs.
+#define RETRY_INTERVAL 1000
+// How long an effect cut short by pausing takes to fade into the gauge.
+#define ANIMATION_CROSSFADE_MS 200
 
 bool concurrent_thread_running = false;
 bool polling = false;
 std::mutex threadlock;
 
+// Auto-reset event the poller thread blocks on. It is set whenever the game
+// delivered changed truck data (see SignalPoller()) or polling should stop.
+static HANDLE poll_event = NULL;
+
+static LARGE_INTEGER clock_freq;
+static timer_wheel_t poll_timers;
+
+// Failed updates are retried on the first wake up after this fires, which
+// the timer itself makes sure of.
+static void onRetryDue(timer_entry_t* timer, void* context) {}
+static timer_entry_t retry_timer(onRetryDue);
+
 void Poll();
 
 HRESULT StartPolling() {
+    poll_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (poll_event == NULL) {
+        logErr("Unable to create the poller wake up event: 0x%x", GetLastError());
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    QueryPerformanceFrequency(&clock_freq);
+    poll_timers.advance(PollerClock());
+    SelectGauge();
     polling = true;
     log("Polling for truck state changes...");
     new std::thread(Poll);
@@ -28,14 +48,56 @@ HRESULT StartPolling() {
 
 HRESULT StopPolling() {
     polling = false;
+    SignalPoller();
     threadlock.lock();
     log("Stopped polling for truck state changes.");
     // don't just set it to false, wait the thread to exit!
     concurrent_thread_running = false;
+    if (poll_event != NULL) {
+        CloseHandle(poll_event);
+        poll_event = NULL;
+    }
     threadlock.unlock();
     return S_OK;
 }
 
+// Wakes the poller thread up. Cheap enough to be called from the game's
+// frame callback; if nothing changed the caller should not bother.
+void SignalPoller() {
+    if (poll_event != NULL) SetEvent(poll_event);
+}
+
+// Milliseconds on the performance counter, as GetTickCount64() only moves
+// every 15.6 ms.
+unsigned long long PollerClock() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (unsigned long long)now.QuadPart * 1000 / clock_freq.QuadPart;
+}
+
+void SchedulePollTimer(timer_entry_t* timer, unsigned long long delay_ms) {
+    poll_timers.schedule_in(timer, delay_ms);
+}
+
+void CancelPollTimer(timer_entry_t* timer) {
+    poll_timers.cancel(timer);
+}
+
+// Fires the timers due.
+void RunPollTimers() {
+    poll_timers.advance(PollerClock());
+}
+
+// How long the poller may sleep before the next deadline.
+static DWORD pollTimeout() {
+    unsigned long long next = poll_timers.next_expiry();
+    if (next == TIMER_WHEEL_NEVER) return INFINITE;
+
+    unsigned long long now = PollerClock();
+    if (next <= now) return 0;
+    return next - now < INFINITE ? (DWORD)(next - now) : INFINITE - 1;
+}
+
 void Poll() {
     threadlock.lock();
     truck_info_t last, current;
@@ -44,59 +106,74 @@ void Poll() {
     bool shut_leds = false;
     bool start_leds = false;
     bool status_failed = false;
-#define UpdateFuelCHK() status_failed = UpdateFuelLevel() != S_OK
+    bool retry;
+    unsigned int dirty;
+    long long changed_at;
+
+    // Until something fails or an effect plays, there's no timer to wake up
+    // for: the thread only runs when the game tells it something changed.
+#define UpdateFuelCHK() status_failed = UpdateGauge(changed_at) != S_OK
     log("Thread started polling.");
     while (polling) {
-        LOCK;
-        if (truck_data.paused) {
-            UNLOCK;
+        WaitForSingleObject(poll_event, pollTimeout());
+        if (!polling) break;
+
+        if (TickLEDs() != S_OK) status_failed = true;
+
+        dirty = TakeTruckDataDirty(&changed_at);
+        retry = status_failed;
+        if (dirty == 0 && !retry) continue;
+        status_failed = false;
+
+        current = truck_data.read();
+        if (UpdateWarnings(!current.paused && current.is_set(TRUCK_ELECTRICITY) && current.is_set(TRUCK_AIR_PRESSURE_WARNING)) != S_OK) {
+            status_failed = true;
+        }
+        if (current.paused) {
             if (!last.paused) {
                 log("Paused.");
                 // stop all effects, but be ready to resume where they were once it is unpaused.
+                CancelAnimation(ANIMATION_CROSSFADE_MS);
+                if (PauseGauge() != S_OK) status_failed = true;
                 last.paused = true;
             }
-            WAITNEXT;
+            // Nothing else to update, but failures still need their retry.
         } else if (last.paused) {
             log("Unpaused. Resuming fuel gauge updates.");
-            last = truck_data;
-            UNLOCK;
-            if (last.electricity) UpdateFuelCHK();
+            last = current;
+            if (last.is_set(TRUCK_ELECTRICITY)) UpdateFuelCHK();
             else ClearLEDs();
-            WAITNEXT;
-        }
+        } else {
+            if (current.is_set(TRUCK_ELECTRICITY) != last.is_set(TRUCK_ELECTRICITY)) {
+                if (!current.is_set(TRUCK_ELECTRICITY)) {
+                    // Truck turned off. Turn all LEDs off.
+                    shut_leds = true;
+                } else {
+                    start_leds = true;
+                }
+                last = current;
+            }
 
-        if (truck_data.electricity != last.electricity) {
-            if (!truck_data.electricity) {
-                // Truck turned off. Turn all LEDs off.
-                shut_leds = true;
-            } else {
-                start_leds = true;
+            if (shut_leds) {
+                ShutdownFuelGaugeAnimation();
+                shut_leds = false;
+            } else if (start_leds) {
+                InitFuelGaugeAnimation();
+                UpdateFuelCHK();
+                start_leds = false;
+            } else if (retry || GaugeChanged(current, last, dirty)) {
+                UpdateFuelCHK();
+                last = current;
             }
-            last = truck_data;
-        }
-        current = truck_data;
-        UNLOCK;
-
-        if (shut_leds) {
-            ShutdownFuelGaugeAnimation();
-            shut_leds = false;
-        } else if (start_leds) {
-            InitFuelGaugeAnimation();
-            UpdateFuelCHK();
-            start_leds = false;
-        } else if (current.fuel < (last.fuel - 0.01) || current.fuel > (last.fuel + 0.01) || current.fuel_max != last.fuel_max) {
-            UpdateFuelCHK();
-            last = current;
         }
 
         if (status_failed) {
-            log("Failed updating LED status.");
-            Sleep(1000);
+            logEvery(1, "Failed updating LED status.");
+            if (!retry_timer.pending()) SchedulePollTimer(&retry_timer, RETRY_INTERVAL);
         }
-
-        WAITPOLL;
     }
     ClearLEDs();
+    poll_timers.cancel_all();
     log("Thread stopped polling.");
     threadlock.unlock();
 }
\ No newline at end of file
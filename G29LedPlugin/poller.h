@@ -1,10 +1,20 @@
 #ifndef __POLLER_H_INCLUDED__
 #define __POLLER_H_INCLUDED__
 #include "pch.h"
+#include "timerwheel.h"
 
 extern bool concurrent_thread_running;
 
 HRESULT StartPolling();
 HRESULT StopPolling();
+void SignalPoller();
+
+// Deadlines of the poller thread, on a timer wheel ticking in milliseconds:
+// the thread sleeps until the first one, or until SignalPoller(). Only to be
+// used from the poller thread.
+unsigned long long PollerClock();
+void SchedulePollTimer(timer_entry_t* timer, unsigned long long delay_ms);
+void CancelPollTimer(timer_entry_t* timer);
+void RunPollTimers();
 
 #endif
\ No newline at end of file
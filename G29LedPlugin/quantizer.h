@@ -0,0 +1,62 @@
+#ifndef __QUANTIZER_H_INCLUDED__
+#define __QUANTIZER_H_INCLUDED__
+
+// Turns a continuous value, such as the fuel tank's fill ratio, into one of
+// count + 1 levels split by increasing thresholds, with hysteresis: once at
+// a level, the value has to go `margin` past the threshold above or below it
+// to move to the next one. A value wavering around a threshold (fuel sloshing
+// in the tank) then keeps the LEDs still instead of toggling them.
+//
+// Doesn't depend on the plugin's precompiled header. Not thread safe: each
+// gauge owns one, used from the poller thread.
+
+struct level_quantizer_t {
+    const float* thresholds;
+    unsigned int count;
+    float margin;
+
+    level_quantizer_t(const float* thresholds, unsigned int count, float margin)
+        : thresholds(thresholds), count(count), margin(margin), level(0), known(false) {}
+
+    // Forgets the level, so the next value is taken as it is.
+    void reset() { known = false; }
+
+    // The level of `value` without hysteresis. NaN reads as the top level.
+    unsigned int raw(float value) const {
+        unsigned int raw_level = 0;
+        while (raw_level < count && !(value < thresholds[raw_level])) raw_level++;
+        return raw_level;
+    }
+
+    // The level `value` would move to, without moving there.
+    unsigned int peek(float value) const {
+        if (!known) return raw(value);
+
+        unsigned int next = level;
+        while (next < count && value >= thresholds[next] + margin) next++;
+        while (next > 0 && value < thresholds[next - 1] - margin) next--;
+        return next;
+    }
+
+    bool changes(float value) const {
+        return !known || peek(value) != level;
+    }
+
+    // Whether the hysteresis alone keeps `value` from another level.
+    bool holds(float value) const {
+        return known && peek(value) != raw(value);
+    }
+
+    // Moves to the level of `value` and returns it.
+    unsigned int quantize(float value) {
+        level = peek(value);
+        known = true;
+        return level;
+    }
+
+private:
+    unsigned int level;
+    bool known;
+};
+
+#endif
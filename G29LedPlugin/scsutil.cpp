@@ -1,5 +1,9 @@
 #include "pch.h"
 #include "scsutil.h"
+#include "truck.h"
+#include <math.h>
+
+telemetry_recorder_t telemetry_recorder;
 
 /**
  * @brief Finds attribute with specified name in the configuration structure.
@@ -21,7 +25,8 @@ const scs_named_value_t* find_attribute(const scs_telemetry_configuration_t& con
     return NULL;
 }
 
-#define REGFAIL(x, y) logErr("Received " x " while trying to update " y " telemetry value"); \
+// Every frame while it happens, so these are rate limited.
+#define REGFAIL(x, y) logErrEvery(1, "Received " x " while trying to update " y " telemetry value"); \
     return;
 
 #define REGCHECKS(what, valtype) if (value == nullptr) { \
@@ -32,20 +37,50 @@ const scs_named_value_t* find_attribute(const scs_telemetry_configuration_t& con
         REGFAIL("null context handle", what) \
     }
 
+// The channel callbacks only flag changed values as dirty; the poller is woken
+// once per frame by the frame end event, after all channels were delivered.
+// Values within the channel's deadband of the one stored are dropped here,
+// before they cost a seqlock write or wake anyone.
+static void storeFloat(const truck_channel_t* channel, float value) {
+    truck_channel_stats_t& stats = truck_channel_stats[channel - truck_channels];
+    float stored = truck_data.peek()->values[channel->slot];
+    stats.received++;
+    // Written this way so NaN never gets stored.
+    if (!(fabsf(value - stored) > channel->threshold)) {
+        stats.suppressed++;
+        return;
+    }
+
+    truck_data.begin_write()->values[channel->slot] = value;
+    truck_data.end_write();
+    if (truck_data_wake.load(std::memory_order_relaxed) & channel->field) MarkTruckDataDirty(channel->field);
+}
+
+static void storeFlag(const truck_channel_t* channel, bool value) {
+    truck_channel_stats_t& stats = truck_channel_stats[channel - truck_channels];
+    unsigned int bit = 1u << channel->slot;
+    unsigned int flags = truck_data.peek()->flags;
+    stats.received++;
+    if (((flags & bit) != 0) == value) {
+        stats.suppressed++;
+        return;
+    }
+
+    truck_data.begin_write()->flags = flags ^ bit;
+    truck_data.end_write();
+    if (truck_data_wake.load(std::memory_order_relaxed) & channel->field) MarkTruckDataDirty(channel->field);
+}
+
 SCSAPI_VOID update_bool_value(const scs_string_t name, const scs_u32_t index, const scs_value_t* const value, const scs_context_t context)
 {
+    if (telemetry_recorder.recording()) telemetry_recorder.channel(name, index, value);
     REGCHECKS("boolean", SCS_VALUE_TYPE_bool)
-        * static_cast<bool*>(context) = value->value_bool.value;
+    storeFlag(static_cast<const truck_channel_t*>(context), value->value_bool.value != 0);
 }
 
 SCSAPI_VOID update_float_value(const scs_string_t name, const scs_u32_t index, const scs_value_t* const value, const scs_context_t context)
 {
+    if (telemetry_recorder.recording()) telemetry_recorder.channel(name, index, value);
     REGCHECKS("floating point", SCS_VALUE_TYPE_float)
-        * static_cast<float*>(context) = value->value_float.value;
+    storeFloat(static_cast<const truck_channel_t*>(context), value->value_float.value);
 }
-
-SCSAPI_VOID update_int_value(const scs_string_t name, const scs_u32_t index, const scs_value_t* const value, const scs_context_t context)
-{
-    REGCHECKS("integer", SCS_VALUE_TYPE_s32)
-        * static_cast<int*>(context) = value->value_s32.value;
-}
\ No newline at end of file
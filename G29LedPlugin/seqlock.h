@@ -0,0 +1,74 @@
+#ifndef __SEQLOCK_H_INCLUDED__
+#define __SEQLOCK_H_INCLUDED__
+#include <atomic>
+#include <type_traits>
+#include <string.h>
+
+// Sequence lock around a small, trivially copyable structure.
+//
+// Single writer: the writer bumps the sequence to an odd number, changes the
+// value in place and bumps it again. Readers copy the value out and retry if
+// the sequence was odd or changed while they copied, so they always get a
+// consistent snapshot without ever making the writer wait.
+//
+// Only the game thread writes. A second writer would spin in begin_write()
+// while the other one is in the middle of a change; it's counted in
+// writer_waits(), which `G29LedBench seqlock` checks stays at zero.
+template <typename T>
+class seqlock_t {
+    static_assert(std::is_trivially_copyable<T>::value, "seqlock_t only works with trivially copyable types");
+
+public:
+    seqlock_t() : sequence(0), waits(0) {
+        memset(&value, 0, sizeof(value));
+    }
+
+    // Starts changing the value. Every call must be paired with end_write().
+    T* begin_write() {
+        unsigned int seq = sequence.load(std::memory_order_relaxed);
+        while ((seq & 1) || !sequence.compare_exchange_strong(seq, seq + 1, std::memory_order_relaxed)) {
+            waits.fetch_add(1, std::memory_order_relaxed);
+            if (seq & 1) seq = sequence.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return &value;
+    }
+
+    void end_write() {
+        sequence.fetch_add(1, std::memory_order_release);
+    }
+
+    // How many times begin_write() found another writer in the way. Stays at
+    // zero with a single writer.
+    unsigned long long writer_waits() const {
+        return waits.load(std::memory_order_relaxed);
+    }
+
+    // Writer-side view of the current value, to check whether a change is
+    // needed at all before calling begin_write(). Readers must use read().
+    const T* peek() const {
+        return &value;
+    }
+
+    // Adds the copies thrown away to `retries`, if given.
+    T read(unsigned long long* retries = nullptr) const {
+        T copy;
+        unsigned int before, after, attempts = 0;
+        do {
+            attempts++;
+            before = sequence.load(std::memory_order_acquire);
+            memcpy(&copy, &value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        if (retries) *retries += attempts - 1;
+        return copy;
+    }
+
+private:
+    std::atomic<unsigned int> sequence;
+    std::atomic<unsigned long long> waits;
+    T value;
+};
+
+#endif
\ No newline at end of file
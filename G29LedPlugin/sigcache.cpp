@@ -0,0 +1,150 @@
+#include "pch.h"
+#include <stdio.h>
+#include <share.h>
+#include <string>
+#include <vector>
+#include "log.h"
+#include "sigcache.h"
+
+// The cache is a small text file, one signature per line, most recently
+// used first:
+//   <game id> <game version> <offset> <prefix field> <AdBlue capacity>
+// Set G29LEDPLUGIN_SIGNATURE_CACHE to use another file than the default one
+// in the local application data folder.
+#define SIGNATURE_CACHE_DIR "G29LedPlugin"
+#define SIGNATURE_CACHE_FILE "signatures.txt"
+#define SIGNATURE_CACHE_PER_GAME 4 // signatures kept per game build
+#define SIGNATURE_CACHE_MAX 64 // lines kept overall
+
+struct signature_entry_t {
+    std::string game_id;
+    scs_u32_t game_version;
+    struct_signature_t signature;
+};
+
+// Only used from the plugin's init and shutdown and the search thread,
+// which runs in between.
+static std::vector<signature_entry_t> entries;
+static std::string cache_path;
+static std::string current_game;
+static scs_u32_t current_version = 0;
+static signature_cache_stats_t stats;
+
+static bool isCurrent(const signature_entry_t& entry) {
+    return entry.game_version == current_version && entry.game_id == current_game;
+}
+
+static bool cachePath(std::string* path) {
+    char value[MAX_PATH];
+    DWORD len = GetEnvironmentVariableA("G29LEDPLUGIN_SIGNATURE_CACHE", value, MAX_PATH);
+    if (len > 0 && len < MAX_PATH) {
+        *path = value;
+        return true;
+    }
+
+    len = GetEnvironmentVariableA("LOCALAPPDATA", value, MAX_PATH);
+    if (len == 0 || len >= MAX_PATH) return false;
+    *path = std::string(value) + "\\" SIGNATURE_CACHE_DIR;
+    if (!CreateDirectoryA(path->c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) return false;
+    *path += "\\" SIGNATURE_CACHE_FILE;
+    return true;
+}
+
+static void save() {
+    std::string temp = cache_path + ".tmp";
+    FILE* file = _fsopen(temp.c_str(), "w", _SH_DENYWR);
+    if (file == nullptr) {
+        logWarn("Unable to write the signature cache: %s", temp.c_str());
+        return;
+    }
+    for (const signature_entry_t& entry : entries) {
+        fprintf_s(file, "%s %u %lld %u %.9g\n", entry.game_id.c_str(), entry.game_version,
+            entry.signature.offset, entry.signature.prefield, entry.signature.adblue_cap);
+    }
+    fclose(file);
+    if (!MoveFileExA(temp.c_str(), cache_path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        logWarn("Unable to replace the signature cache: %s", cache_path.c_str());
+    }
+}
+
+// Loads the signatures found in earlier sessions, and selects the ones of
+// this game build.
+HRESULT OpenSignatureCache(const char* game_id, scs_u32_t game_version) {
+    char id[64];
+    signature_entry_t entry;
+    size_t current = 0;
+    FILE* file;
+
+    entries.clear();
+    memset(&stats, 0, sizeof(stats));
+    current_game = game_id;
+    current_version = game_version;
+    if (!cachePath(&cache_path)) {
+        cache_path.clear();
+        return HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND);
+    }
+
+    file = _fsopen(cache_path.c_str(), "r", _SH_DENYWR);
+    if (file == nullptr) return S_FALSE; // nothing cached yet
+    while (entries.size() < SIGNATURE_CACHE_MAX &&
+        fscanf_s(file, "%63s %u %lld %u %f", id, (unsigned int)sizeof(id), &entry.game_version,
+            &entry.signature.offset, &entry.signature.prefield, &entry.signature.adblue_cap) == 5) {
+        entry.game_id = id;
+        entries.push_back(entry);
+        if (isCurrent(entry)) current++;
+    }
+    fclose(file);
+
+    log("Signature cache: %zu signatures for this game build in %s.", current, cache_path.c_str());
+    return S_OK;
+}
+
+void CloseSignatureCache() {
+    if (stats.searches > 0) {
+        log("Signature cache: found at a cached location in %llu of %llu searches (%llu had signatures to try, %.0f%% hit rate).",
+            stats.hits, stats.searches, stats.lookups, stats.lookups ? stats.hits * 100.0 / stats.lookups : 0.0);
+    }
+    entries.clear();
+    cache_path.clear();
+}
+
+// Signatures of this game build for a truck with the given AdBlue capacity,
+// most recently used first.
+size_t FindSignatures(float adblue_cap, struct_signature_t* signatures, size_t max) {
+    size_t found = 0;
+    for (size_t i = 0; i < entries.size() && found < max; i++) {
+        if (isCurrent(entries[i]) && entries[i].signature.adblue_cap == adblue_cap) {
+            signatures[found++] = entries[i].signature;
+        }
+    }
+    return found;
+}
+
+// Puts the signature first, dropping this game build's least recently used
+// ones beyond SIGNATURE_CACHE_PER_GAME, and writes the cache out.
+void RememberSignature(const struct_signature_t& signature) {
+    signature_entry_t entry = { current_game, current_version, signature };
+    size_t kept = 1;
+
+    if (cache_path.empty()) return;
+    if (!entries.empty() && isCurrent(entries[0]) && memcmp(&entries[0].signature, &signature, sizeof(signature)) == 0) return;
+
+    for (size_t i = 0; i < entries.size();) {
+        bool same = isCurrent(entries[i]) && memcmp(&entries[i].signature, &signature, sizeof(signature)) == 0;
+        if (same || (isCurrent(entries[i]) && ++kept > SIGNATURE_CACHE_PER_GAME)) entries.erase(entries.begin() + i);
+        else i++;
+    }
+    entries.insert(entries.begin(), entry);
+    if (entries.size() > SIGNATURE_CACHE_MAX) entries.resize(SIGNATURE_CACHE_MAX);
+    save();
+}
+
+void CountSignatureLookup(bool tried, bool hit) {
+    stats.searches++;
+    if (tried) stats.lookups++;
+    if (hit) stats.hits++;
+}
+
+void GetSignatureCacheStats(signature_cache_stats_t* out) {
+    *out = stats;
+}
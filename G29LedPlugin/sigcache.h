@@ -0,0 +1,28 @@
+#ifndef __SIGCACHE_H_INCLUDED__
+#define __SIGCACHE_H_INCLUDED__
+#include "pch.h"
+
+// Where the fuel capacity search found the truck structure, remembered
+// across sessions for the same game build: the pointer to it sits at a
+// fixed distance from the configuration's attributes more often than not,
+// so later searches check there before scanning.
+struct struct_signature_t {
+    long long offset; // of the word pointing to the structure, from the attributes
+    scs_u32_t prefield; // the structure's non-zero prefix field
+    float adblue_cap; // telemetry's figure the structure matched
+};
+
+struct signature_cache_stats_t {
+    unsigned long long lookups; // searches that had signatures to try
+    unsigned long long hits; // of them, found where a signature said
+    unsigned long long searches;
+};
+
+HRESULT OpenSignatureCache(const char* game_id, scs_u32_t game_version);
+void CloseSignatureCache();
+size_t FindSignatures(float adblue_cap, struct_signature_t* signatures, size_t max);
+void RememberSignature(const struct_signature_t& signature);
+void CountSignatureLookup(bool tried, bool hit);
+void GetSignatureCacheStats(signature_cache_stats_t* stats);
+
+#endif
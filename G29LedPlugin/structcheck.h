@@ -0,0 +1,294 @@
+#ifndef __STRUCTCHECK_H_INCLUDED__
+#define __STRUCTCHECK_H_INCLUDED__
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+// Validation of structures found in game memory, described as a table of
+// field checks instead of code: a range, a class of pointer, or equality
+// with another field or a value given at run time.
+//
+// Checks are grouped into stages. A stage evaluates all of its checks
+// without branching, its field offsets and bounds folded in at compile
+// time, and a structure is rejected by the first stage where any check
+// fails. Stages run in table order at first; each validator counts how
+// often each stage rejects, and reorder() then puts the ones rejecting the
+// most first.
+//
+// The validator works on a copy or a mapping of the structure's bytes, so
+// it runs the same on live memory, dumps and synthetic images. Built
+// without the precompiled header for the tools' sake.
+
+// Where pointers of each class go, and the run-time value compared by
+// CHECK_EQUAL_PARAM.
+struct struct_env_t {
+    uint64_t ro_low, ro_high; // read-only memory (the game's image), inclusive
+    uint64_t rw_low, rw_high; // read-write memory (its heap), inclusive
+    float param;
+};
+
+enum struct_check_kind_t : uint8_t {
+    CHECK_RANGE, // number within [low, high]
+    CHECK_RO_POINTER,
+    CHECK_RW_POINTER,
+    CHECK_EQUAL_FIELD, // same bits as the field at `other`
+    CHECK_EQUAL_PARAM // float equal to struct_env_t::param
+};
+
+// Some structures come in two flavours: linked, with pointers to read-write
+// memory, and unlinked, with zeroes where those pointers would go. Which
+// one a structure is is told by a field named by the validator.
+enum struct_check_when_t : uint8_t {
+    WHEN_ALWAYS,
+    WHEN_LINKED,
+    WHEN_UNLINKED
+};
+
+enum : uint8_t {
+    CHECK_REPORT = 1, // failing here is unusual enough to be worth logging
+    CHECK_SOFT = 2 // only checked on structures that passed, and never rejects
+};
+
+struct struct_check_t {
+    const char* name;
+    uint8_t stage;
+    struct_check_kind_t kind;
+    struct_check_when_t when;
+    uint8_t flags;
+    uint16_t offset;
+    uint16_t other; // CHECK_EQUAL_FIELD
+    uint8_t size; // 4 or 8 bytes
+    bool is_float;
+    bool is_signed;
+    int64_t ilow, ihigh; // integer ranges
+    float flow, fhigh; // float ranges
+};
+
+// Type, offset and size of a field, possibly an array element's member.
+#define STRUCT_FIELD_TYPE(layout, field) std::remove_reference<decltype(((layout*)nullptr)->field)>::type
+#define STRUCT_FIELD(layout, field) offsetof(layout, field), sizeof(STRUCT_FIELD_TYPE(layout, field)), \
+    std::is_floating_point<STRUCT_FIELD_TYPE(layout, field)>::value, std::is_signed<STRUCT_FIELD_TYPE(layout, field)>::value
+
+constexpr struct_check_t structCheck(const char* name, uint8_t stage, struct_check_kind_t kind,
+    size_t offset, size_t size, bool is_float, bool is_signed, size_t other, double low, double high,
+    struct_check_when_t when = WHEN_ALWAYS, uint8_t flags = 0) {
+    return struct_check_t{ name, stage, kind, when, flags, (uint16_t)offset, (uint16_t)other, (uint8_t)size,
+        is_float, is_signed, (int64_t)low, (int64_t)high, (float)low, (float)high };
+}
+
+// Table entries. The optional arguments are the struct_check_when_t and the
+// flags.
+#define CHECK_FIELD_RANGE(layout, field, stage, low, high, ...) \
+    structCheck(#field, stage, CHECK_RANGE, STRUCT_FIELD(layout, field), 0, low, high, ##__VA_ARGS__)
+#define CHECK_FIELD_RO(layout, field, stage, ...) \
+    structCheck(#field, stage, CHECK_RO_POINTER, STRUCT_FIELD(layout, field), 0, 0, 0, ##__VA_ARGS__)
+#define CHECK_FIELD_RW(layout, field, stage, ...) \
+    structCheck(#field, stage, CHECK_RW_POINTER, STRUCT_FIELD(layout, field), 0, 0, 0, ##__VA_ARGS__)
+#define CHECK_FIELD_EQUAL(layout, field, other, stage, ...) \
+    structCheck(#field " == " #other, stage, CHECK_EQUAL_FIELD, STRUCT_FIELD(layout, field), offsetof(layout, other), 0, 0, ##__VA_ARGS__)
+#define CHECK_FIELD_PARAM(layout, field, stage, ...) \
+    structCheck(#field, stage, CHECK_EQUAL_PARAM, STRUCT_FIELD(layout, field), 0, 0, 0, ##__VA_ARGS__)
+
+inline uint64_t structLoad(const unsigned char* data, size_t offset, size_t size, bool is_signed) {
+    if (size == 8) {
+        uint64_t value;
+        memcpy(&value, data + offset, sizeof(value));
+        return value;
+    }
+    uint32_t value;
+    memcpy(&value, data + offset, sizeof(value));
+    return is_signed ? (uint64_t)(int64_t)(int32_t)value : value;
+}
+
+inline float structLoadFloat(const unsigned char* data, size_t offset) {
+    float value;
+    memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+// With `check` a constant, the switch and the bounds fold away, leaving a
+// load and a comparison or two. NaNs fail float ranges.
+inline bool structCheckFails(const struct_check_t& check, const unsigned char* data, const struct_env_t& env, bool unlinked) {
+    uint64_t value = structLoad(data, check.offset, check.size, check.is_signed);
+    bool pass;
+
+    switch (check.kind) {
+    case CHECK_RANGE:
+        if (check.is_float) {
+            float number = structLoadFloat(data, check.offset);
+            pass = (number >= check.flow) & (number <= check.fhigh);
+        } else {
+            pass = value - (uint64_t)check.ilow <= (uint64_t)(check.ihigh - check.ilow);
+        }
+        break;
+    case CHECK_RO_POINTER:
+        pass = value - env.ro_low <= env.ro_high - env.ro_low;
+        break;
+    case CHECK_RW_POINTER:
+        pass = value - env.rw_low <= env.rw_high - env.rw_low;
+        break;
+    case CHECK_EQUAL_FIELD:
+        pass = value == structLoad(data, check.other, check.size, check.is_signed);
+        break;
+    case CHECK_EQUAL_PARAM:
+        pass = structLoadFloat(data, check.offset) == env.param;
+        break;
+    default:
+        pass = false;
+    }
+    return !pass & (check.when == WHEN_ALWAYS || (check.when == WHEN_UNLINKED) == unlinked);
+}
+
+// The field's value as text, for reports.
+inline void structFormatValue(const struct_check_t& check, const unsigned char* data, char* text, size_t size) {
+    if (check.is_float) snprintf(text, size, "%.4f", structLoadFloat(data, check.offset));
+    else if (check.kind == CHECK_RO_POINTER || check.kind == CHECK_RW_POINTER) snprintf(text, size, "0x%016llx", (unsigned long long)structLoad(data, check.offset, check.size, false));
+    else if (check.is_signed) snprintf(text, size, "%lld", (long long)structLoad(data, check.offset, check.size, true));
+    else snprintf(text, size, "%llu", (unsigned long long)structLoad(data, check.offset, check.size, false));
+}
+
+// Checks first (in table order) and count of stage `stage`. Stages must be
+// numbered from 0 in table order.
+constexpr size_t structStageFirst(const struct_check_t* checks, size_t count, size_t stage) {
+    size_t i = 0;
+    while (i < count && checks[i].stage < stage) i++;
+    return i;
+}
+
+constexpr size_t structStageCount(const struct_check_t* checks, size_t count, size_t stage) {
+    return structStageFirst(checks, count, stage + 1) - structStageFirst(checks, count, stage);
+}
+
+constexpr bool structStagesValid(const struct_check_t* checks, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 ? checks[i].stage != 0 : checks[i].stage != checks[i - 1].stage && checks[i].stage != checks[i - 1].stage + 1) return false;
+        if (i > 0 && checks[i].stage == checks[i - 1].stage && (checks[i].flags & CHECK_SOFT) != (checks[i - 1].flags & CHECK_SOFT)) return false;
+        if (structStageCount(checks, count, checks[i].stage) > 64) return false;
+    }
+    return count > 0;
+}
+
+// Validator for the structure described by `Checks`. `LinkOffset` is the
+// offset of the 8-byte field telling linked structures (non-zero) from
+// unlinked ones.
+template <const struct_check_t* Checks, size_t Count, size_t LinkOffset>
+class struct_validator_t {
+public:
+    static const size_t stages = Checks[Count - 1].stage + 1;
+    static const size_t no_check = (size_t)-1;
+
+    struct_validator_t() {
+        for (size_t i = 0; i < stages; i++) {
+            order[i] = (uint8_t)i;
+            first[i] = structStageFirst(Checks, Count, i);
+            soft[i] = (Checks[first[i]].flags & CHECK_SOFT) != 0;
+            evaluated[i] = 0;
+            rejected[i] = 0;
+        }
+        for (size_t i = 0; i < Count; i++) failed[i] = 0;
+    }
+
+    // Index of a check that fails, or no_check if the structure passes.
+    // Safe to call from several threads at once, but not with reorder().
+    size_t validate(const unsigned char* data, const struct_env_t& env) {
+        bool unlinked = structLoad(data, LinkOffset, 8, false) == 0;
+
+        for (size_t i = 0; i < stages; i++) {
+            size_t stage = order[i];
+            if (soft[stage]) continue;
+
+            uint64_t failures = stage_failures[stage](data, env, unlinked);
+            evaluated[stage].fetch_add(1, std::memory_order_relaxed);
+            if (failures != 0) {
+                rejected[stage].fetch_add(1, std::memory_order_relaxed);
+                return count(stage, failures);
+            }
+        }
+        return no_check;
+    }
+
+    // Index of a soft check failing on a structure that passed validate(),
+    // or no_check.
+    size_t doubtful(const unsigned char* data, const struct_env_t& env) {
+        bool unlinked = structLoad(data, LinkOffset, 8, false) == 0;
+
+        for (size_t stage = 0; stage < stages; stage++) {
+            if (!soft[stage]) continue;
+            uint64_t failures = stage_failures[stage](data, env, unlinked);
+            if (failures != 0) return count(stage, failures);
+        }
+        return no_check;
+    }
+
+    // Puts the stages rejecting the most structures per evaluation first.
+    // Not to be called while validate() runs.
+    void reorder() {
+        double rates[stages];
+        for (size_t i = 0; i < stages; i++) rates[i] = rejectionRate(i);
+        std::stable_sort(order, order + stages, [&rates](uint8_t a, uint8_t b) { return rates[a] > rates[b]; });
+    }
+
+    double rejectionRate(size_t stage) const {
+        unsigned long long runs = evaluated[stage].load(std::memory_order_relaxed);
+        return runs ? (double)rejected[stage].load(std::memory_order_relaxed) / runs : 0.0;
+    }
+
+    unsigned long long evaluations(size_t stage) const { return evaluated[stage].load(std::memory_order_relaxed); }
+    unsigned long long failures(size_t check) const { return failed[check].load(std::memory_order_relaxed); }
+    size_t stageAt(size_t position) const { return order[position]; }
+
+    static const struct_check_t& check(size_t index) { return Checks[index]; }
+    static size_t checks() { return Count; }
+    size_t stageFirst(size_t stage) const { return first[stage]; }
+
+private:
+    typedef uint64_t (*stage_fn_t)(const unsigned char* data, const struct_env_t& env, bool unlinked);
+
+    // Bit i set if check First + i fails; every check is evaluated.
+    template <size_t First, size_t... I>
+    static uint64_t rangeFailures(const unsigned char* data, const struct_env_t& env, bool unlinked, std::index_sequence<I...>) {
+        uint64_t failures = 0;
+        int expand[] = { 0, ((failures |= (uint64_t)structCheckFails(Checks[First + I], data, env, unlinked) << I), 0)... };
+        (void)expand;
+        return failures;
+    }
+
+    template <size_t Stage>
+    static uint64_t stageFailures(const unsigned char* data, const struct_env_t& env, bool unlinked) {
+        return rangeFailures<structStageFirst(Checks, Count, Stage)>(data, env, unlinked,
+            std::make_index_sequence<structStageCount(Checks, Count, Stage)>());
+    }
+
+    template <size_t... S>
+    static const stage_fn_t* stageTable(std::index_sequence<S...>) {
+        static const stage_fn_t table[] = { &stageFailures<S>... };
+        return table;
+    }
+
+    size_t count(size_t stage, uint64_t failures) {
+        size_t lowest = no_check;
+        for (size_t i = first[stage]; failures != 0; i++, failures >>= 1) {
+            if (!(failures & 1)) continue;
+            failed[i].fetch_add(1, std::memory_order_relaxed);
+            if (lowest == no_check) lowest = i;
+        }
+        return lowest;
+    }
+
+    static_assert(structStagesValid(Checks, Count), "checks must be grouped in stages numbered from 0, of up to 64 checks, all soft or none");
+
+    const stage_fn_t* stage_failures = stageTable(std::make_index_sequence<stages>());
+    uint8_t order[stages];
+    size_t first[stages]; // check
+    bool soft[stages];
+    std::atomic<unsigned long long> evaluated[stages];
+    std::atomic<unsigned long long> rejected[stages];
+    std::atomic<unsigned long long> failed[Count];
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include "pch.h"
+#include <share.h>
+#include "telemetry_record.h"
+
+#define MAX_INTERNED_NAMES 0xffff
+
+// Size of the fixed size value types, as stored in scs_value_t. Strings are
+// stored apart, as length-prefixed bytes.
+static size_t valueSize(scs_value_type_t type) {
+    switch (type) {
+    case SCS_VALUE_TYPE_bool: return sizeof(scs_value_bool_t);
+    case SCS_VALUE_TYPE_s32: return sizeof(scs_value_s32_t);
+    case SCS_VALUE_TYPE_u32: return sizeof(scs_value_u32_t);
+    case SCS_VALUE_TYPE_u64: return sizeof(scs_value_u64_t);
+    case SCS_VALUE_TYPE_s64: return sizeof(scs_value_s64_t);
+    case SCS_VALUE_TYPE_float: return sizeof(scs_value_float_t);
+    case SCS_VALUE_TYPE_double: return sizeof(scs_value_double_t);
+    case SCS_VALUE_TYPE_fvector: return sizeof(scs_value_fvector_t);
+    case SCS_VALUE_TYPE_dvector: return sizeof(scs_value_dvector_t);
+    case SCS_VALUE_TYPE_euler: return sizeof(scs_value_euler_t);
+    case SCS_VALUE_TYPE_fplacement: return sizeof(scs_value_fplacement_t);
+    case SCS_VALUE_TYPE_dplacement: return sizeof(scs_value_dplacement_t);
+    default: return 0;
+    }
+}
+
+HRESULT telemetry_recorder_t::open(const char* path, const char* game_id, scs_u32_t game_version) {
+    const unsigned int version = TELEMETRY_RECORD_VERSION;
+
+    close();
+    file = _fsopen(path, "wb", _SH_DENYWR);
+    if (!file) return HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
+
+    QueryPerformanceFrequency(&qpc_freq);
+    QueryPerformanceCounter(&last);
+    names.clear();
+
+    fwrite(TELEMETRY_RECORD_MAGIC, 1, 4, file);
+    fwrite(&version, sizeof(version), 1, file);
+
+    header(TELEMETRY_RECORD_session);
+    writeString(game_id);
+    fwrite(&game_version, sizeof(game_version), 1, file);
+    return S_OK;
+}
+
+void telemetry_recorder_t::close() {
+    if (file) fclose(file);
+    file = nullptr;
+}
+
+void telemetry_recorder_t::header(telemetry_record_kind_t kind) {
+    LARGE_INTEGER now;
+    unsigned char k = (unsigned char)kind;
+    unsigned long long delay;
+    unsigned int delay_us;
+
+    QueryPerformanceCounter(&now);
+    delay = (unsigned long long)(now.QuadPart - last.QuadPart) * 1000000 / qpc_freq.QuadPart;
+    delay_us = delay > 0xffffffffULL ? 0xffffffff : (unsigned int)delay;
+    // Only move forward by what was stored, so rounding errors don't add up.
+    last.QuadPart += (LONGLONG)delay_us * qpc_freq.QuadPart / 1000000;
+
+    fwrite(&k, 1, 1, file);
+    fwrite(&delay_us, sizeof(delay_us), 1, file);
+}
+
+void telemetry_recorder_t::writeString(const char* str) {
+    size_t len = str ? strlen(str) : 0;
+    unsigned short slen = len > 0xffff ? 0xffff : (unsigned short)len;
+
+    fwrite(&slen, sizeof(slen), 1, file);
+    if (slen) fwrite(str, 1, slen, file);
+}
+
+// Returns the id of `name`, writing a name record the first time it is seen.
+unsigned short telemetry_recorder_t::intern(const char* name) {
+    unsigned short id;
+
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) return (unsigned short)i;
+    }
+    if (names.size() >= MAX_INTERNED_NAMES) return MAX_INTERNED_NAMES;
+
+    id = (unsigned short)names.size();
+    names.push_back(name);
+    header(TELEMETRY_RECORD_name);
+    fwrite(&id, sizeof(id), 1, file);
+    writeString(name);
+    return id;
+}
+
+void telemetry_recorder_t::writeValue(const scs_value_t& value) {
+    unsigned char type = (unsigned char)value.type;
+
+    fwrite(&type, 1, 1, file);
+    if (value.type == SCS_VALUE_TYPE_string) {
+        writeString(value.value_string.value);
+    } else {
+        fwrite(&value.value_bool, 1, valueSize(value.type), file);
+    }
+}
+
+void telemetry_recorder_t::event(const scs_event_t event, const void* const event_info) {
+    if (!file) return;
+
+    if (event == SCS_TELEMETRY_EVENT_configuration) {
+        const scs_telemetry_configuration_t* info = static_cast<const scs_telemetry_configuration_t*>(event_info);
+        unsigned short id_name = intern(info->id);
+        unsigned short count = 0;
+        const scs_named_value_t* current;
+
+        // Intern everything first, so name records don't land in the middle
+        // of the configuration record.
+        for (current = info->attributes; current->name; ++current) {
+            intern(current->name);
+            count++;
+        }
+
+        header(TELEMETRY_RECORD_configuration);
+        fwrite(&id_name, sizeof(id_name), 1, file);
+        fwrite(&count, sizeof(count), 1, file);
+        for (current = info->attributes; current->name; ++current) {
+            unsigned short name = intern(current->name);
+            fwrite(&name, sizeof(name), 1, file);
+            fwrite(&current->index, sizeof(current->index), 1, file);
+            writeValue(current->value);
+        }
+    } else {
+        header(TELEMETRY_RECORD_event);
+        fwrite(&event, sizeof(event), 1, file);
+    }
+}
+
+void telemetry_recorder_t::channel(const scs_string_t name, const scs_u32_t index, const scs_value_t* const value) {
+    unsigned short id;
+
+    // Channels registered with the no_value flag may send no value at all.
+    if (!file || !value) return;
+
+    id = intern(name);
+    header(TELEMETRY_RECORD_channel);
+    fwrite(&id, sizeof(id), 1, file);
+    fwrite(&index, sizeof(index), 1, file);
+    writeValue(*value);
+}
+
+HRESULT telemetry_replay_t::open(const char* path) {
+    char magic[4];
+    unsigned int version;
+
+    close();
+    if (fopen_s(&file, path, "rb") != 0 || !file) {
+        file = nullptr;
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, TELEMETRY_RECORD_MAGIC, 4) != 0 ||
+        fread(&version, sizeof(version), 1, file) != 1 || version != TELEMETRY_RECORD_VERSION) {
+        close();
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    time_us = 0;
+    names.clear();
+    return S_OK;
+}
+
+void telemetry_replay_t::close() {
+    if (file) fclose(file);
+    file = nullptr;
+}
+
+bool telemetry_replay_t::readString(std::string* str) {
+    unsigned short len;
+
+    if (fread(&len, sizeof(len), 1, file) != 1) return false;
+    str->resize(len);
+    return len == 0 || fread(&(*str)[0], 1, len, file) == len;
+}
+
+bool telemetry_replay_t::readName(const char** name) {
+    unsigned short id;
+
+    if (fread(&id, sizeof(id), 1, file) != 1 || id >= names.size()) return false;
+    *name = names[id].c_str();
+    return true;
+}
+
+bool telemetry_replay_t::readValue(scs_value_t* value) {
+    unsigned char type;
+    size_t size;
+
+    if (fread(&type, 1, 1, file) != 1) return false;
+    memset(value, 0, sizeof(*value));
+    value->type = type;
+
+    if (type == SCS_VALUE_TYPE_string) {
+        strings.push_back(std::string());
+        if (!readString(&strings.back())) return false;
+        value->value_string.value = strings.back().c_str();
+        return true;
+    }
+
+    size = valueSize(type);
+    return size == 0 || fread(&value->value_bool, 1, size, file) == size;
+}
+
+HRESULT telemetry_replay_t::next(telemetry_record_t* record) {
+    unsigned char kind;
+    unsigned int delay_us;
+    unsigned short id, count;
+    std::string name;
+
+    if (!file) return E_FAIL;
+    strings.clear();
+
+    while (true) {
+        if (fread(&kind, 1, 1, file) != 1) return S_FALSE;
+        if (fread(&delay_us, sizeof(delay_us), 1, file) != 1) return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+        time_us += delay_us;
+
+        memset(record, 0, sizeof(*record));
+        record->kind = (telemetry_record_kind_t)kind;
+        record->time_us = time_us;
+
+        switch (kind) {
+        case TELEMETRY_RECORD_name:
+            if (fread(&id, sizeof(id), 1, file) != 1 || id != names.size() || !readString(&name)) {
+                return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+            }
+            names.push_back(name);
+            continue;
+        case TELEMETRY_RECORD_session:
+            strings.push_back(std::string());
+            if (!readString(&strings.back()) || fread(&record->game_version, sizeof(record->game_version), 1, file) != 1) {
+                return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+            }
+            record->game_id = strings.back().c_str();
+            return S_OK;
+        case TELEMETRY_RECORD_event:
+            if (fread(&record->event, sizeof(record->event), 1, file) != 1) return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+            return S_OK;
+        case TELEMETRY_RECORD_configuration:
+            record->event = SCS_TELEMETRY_EVENT_configuration;
+            if (!readName(&record->configuration.id) || fread(&count, sizeof(count), 1, file) != 1) {
+                return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+            }
+            attributes.resize(count + 1);
+            memset(&attributes[0], 0, attributes.size() * sizeof(scs_named_value_t));
+            for (unsigned short i = 0; i < count; i++) {
+                if (!readName(&attributes[i].name) ||
+                    fread(&attributes[i].index, sizeof(attributes[i].index), 1, file) != 1 ||
+                    !readValue(&attributes[i].value)) {
+                    return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+                }
+            }
+            record->configuration.attributes = &attributes[0];
+            return S_OK;
+        case TELEMETRY_RECORD_channel:
+            if (!readName(&record->name) ||
+                fread(&record->index, sizeof(record->index), 1, file) != 1 ||
+                !readValue(&record->value)) {
+                return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+            }
+            return S_OK;
+        default:
+            return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+        }
+    }
+}
\ No newline at end of file
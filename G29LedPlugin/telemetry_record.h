@@ -0,0 +1,93 @@
+#ifndef __TELEMETRY_RECORD_H_INCLUDED__
+#define __TELEMETRY_RECORD_H_INCLUDED__
+#include "pch.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+// Binary recording of the SCS telemetry callbacks the plugin receives, used
+// to replay a game session without the game (see G29LedReplay).
+//
+// File layout: "G29R", u32 format version, then records. Every record starts
+// with a u8 kind and a u32 delay in microseconds since the previous record.
+// Strings (channel, attribute and configuration names) are interned: the
+// first time one is seen a name record assigns it a u16 id.
+
+#define TELEMETRY_RECORD_MAGIC "G29R"
+#define TELEMETRY_RECORD_VERSION 1
+
+enum telemetry_record_kind_t {
+    TELEMETRY_RECORD_session = 1, // game id (string) and u32 game version
+    TELEMETRY_RECORD_name = 2, // u16 id, string
+    TELEMETRY_RECORD_event = 3, // u32 event; no payload
+    TELEMETRY_RECORD_configuration = 4, // u16 id name, u16 count, attributes
+    TELEMETRY_RECORD_channel = 5 // u16 name, u32 index, value
+};
+
+class telemetry_recorder_t {
+public:
+    telemetry_recorder_t() : file(nullptr) {}
+    ~telemetry_recorder_t() { close(); }
+
+    HRESULT open(const char* path, const char* game_id, scs_u32_t game_version);
+    void close();
+    bool recording() const { return file != nullptr; }
+
+    void event(const scs_event_t event, const void* const event_info);
+    void channel(const scs_string_t name, const scs_u32_t index, const scs_value_t* const value);
+
+private:
+    FILE* file;
+    LARGE_INTEGER qpc_freq;
+    LARGE_INTEGER last;
+    std::vector<std::string> names;
+
+    void header(telemetry_record_kind_t kind);
+    unsigned short intern(const char* name);
+    void writeString(const char* str);
+    void writeValue(const scs_value_t& value);
+};
+
+struct telemetry_record_t {
+    telemetry_record_kind_t kind;
+    unsigned long long time_us; // since the recording started
+    scs_event_t event;
+
+    // session
+    const char* game_id;
+    scs_u32_t game_version;
+
+    // channel
+    const char* name;
+    scs_u32_t index;
+    scs_value_t value;
+
+    // configuration; attributes are terminated by a NULL name, as the game does
+    scs_telemetry_configuration_t configuration;
+};
+
+class telemetry_replay_t {
+public:
+    telemetry_replay_t() : file(nullptr), time_us(0) {}
+    ~telemetry_replay_t() { close(); }
+
+    HRESULT open(const char* path);
+    void close();
+
+    // Reads the next record the plugin would see. Name records are handled
+    // internally. Returns S_FALSE at the end of the file.
+    HRESULT next(telemetry_record_t* record);
+
+private:
+    FILE* file;
+    unsigned long long time_us;
+    std::deque<std::string> names;
+    std::deque<std::string> strings; // string values of the current record
+    std::vector<scs_named_value_t> attributes;
+
+    bool readString(std::string* str);
+    bool readName(const char** name);
+    bool readValue(scs_value_t* value);
+};
+
+#endif
\ No newline at end of file
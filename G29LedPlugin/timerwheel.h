@@ -0,0 +1,181 @@
+#ifndef __TIMERWHEEL_H_INCLUDED__
+#define __TIMERWHEEL_H_INCLUDED__
+#include <stddef.h>
+
+// Hierarchical timer wheel (the scheduling kind, not the steering one).
+// Timers hang in one of TIMER_WHEEL_LEVELS rings of slots; level n slots
+// are 64^n ticks wide, so a timer goes to the ring its delay fits in, and
+// moves down a level each time the ring below wraps around, until it fires
+// from level 0. Scheduling and cancelling a timer are O(1) list operations,
+// whatever the number of timers.
+//
+// Timers are intrusive: the owner keeps the timer_entry_t, typically in a
+// static, and nothing is ever allocated. Ticks are whatever unit the owner
+// advances the wheel in (the poller uses milliseconds). Delays beyond the
+// wheel's span (64^4 ticks, 4.6 hours in ms) are cut to it.
+//
+// Doesn't depend on the plugin's precompiled header. Not thread safe: only
+// the thread advancing the wheel may touch it or its timers.
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1u << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_NEVER (~0ULL)
+
+struct timer_entry_t;
+typedef void (*timer_callback_t)(timer_entry_t* timer, void* context);
+
+struct timer_entry_t {
+    timer_callback_t callback; // may reschedule this timer or any other
+    void* context;
+    unsigned long long expires; // tick, while pending
+
+    timer_entry_t(timer_callback_t callback, void* context = nullptr) :
+        callback(callback), context(context), expires(0), next(nullptr), pprev(nullptr) {}
+
+    bool pending() const { return pprev != nullptr; }
+
+private:
+    friend class timer_wheel_t;
+    timer_entry_t* next;
+    timer_entry_t** pprev; // the pointer to this timer in its list
+};
+
+class timer_wheel_t {
+public:
+    explicit timer_wheel_t(unsigned long long now = 0) : current(now), count(0), moving(nullptr) {
+        for (unsigned int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            for (unsigned int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) slots[level][slot] = nullptr;
+        }
+    }
+
+    // The last tick advance() went through.
+    unsigned long long now() const { return current; }
+    size_t pending() const { return count; }
+
+    // (Re)schedules `timer` to fire at `expires`, or on the next tick if
+    // that's past.
+    void schedule(timer_entry_t* timer, unsigned long long expires) {
+        if (timer->pending()) unlink(timer);
+        else count++;
+        if (expires <= current) expires = current + 1;
+        if (expires - current >= SPAN) expires = current + SPAN - 1;
+        timer->expires = expires;
+        insert(timer);
+    }
+
+    void schedule_in(timer_entry_t* timer, unsigned long long delay) {
+        schedule(timer, current + delay);
+    }
+
+    void cancel(timer_entry_t* timer) {
+        if (!timer->pending()) return;
+        unlink(timer);
+        count--;
+    }
+
+    // Cancels every timer, e.g. once the thread advancing the wheel is done.
+    void cancel_all() {
+        for (unsigned int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            for (unsigned int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+                while (slots[level][slot] != nullptr) unlink(slots[level][slot]);
+            }
+        }
+        count = 0;
+    }
+
+    // Fires every timer due by `now`, tick by tick. Callbacks run on
+    // the caller's thread and may schedule or cancel timers, these included.
+    void advance(unsigned long long now) {
+        // Nothing can fire in between, so an empty wheel just skips ahead.
+        if (count == 0 && now > current) current = now;
+
+        while (current < now) {
+            current++;
+            unsigned int slot = (unsigned int)(current & TIMER_WHEEL_MASK);
+            // Wrapped around: bring the next slot of the level above down,
+            // and further up if that one wrapped too.
+            for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS && slot == 0; level++) {
+                slot = (unsigned int)((current >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK);
+                cascade(level, slot);
+            }
+
+            take(&slots[0][current & TIMER_WHEEL_MASK]);
+            while (moving != nullptr) {
+                timer_entry_t* timer = moving;
+                unlink(timer);
+                count--;
+                timer->callback(timer, timer->context);
+            }
+            if (count == 0) current = now;
+        }
+    }
+
+    // The earliest tick a pending timer may fire at, or TIMER_WHEEL_NEVER.
+    // Exact for timers less than 64 ticks away; for the others it's when
+    // their slot moves down, so a wheel advanced to it may fire nothing.
+    unsigned long long next_expiry() const {
+        unsigned long long next = TIMER_WHEEL_NEVER;
+
+        // A level's timers are 1 to 64 of its slots ahead, and the first
+        // taken of a level may come after the first of the level above.
+        for (unsigned int level = 0; level < TIMER_WHEEL_LEVELS && count != 0; level++) {
+            unsigned int shift = level * TIMER_WHEEL_BITS;
+            unsigned long long base = current >> shift;
+            for (unsigned int offset = 1; offset <= TIMER_WHEEL_SLOTS; offset++) {
+                if (slots[level][(base + offset) & TIMER_WHEEL_MASK] == nullptr) continue;
+                unsigned long long start = (base + offset) << shift;
+                if (start < next) next = start;
+                break;
+            }
+        }
+        return next;
+    }
+
+private:
+    static const unsigned long long SPAN = 1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS);
+
+    void insert(timer_entry_t* timer) {
+        unsigned long long delta = timer->expires - current;
+        unsigned int level = 0;
+        while (level + 1 < TIMER_WHEEL_LEVELS && delta >= (1ULL << ((level + 1) * TIMER_WHEEL_BITS))) level++;
+
+        timer_entry_t** head = &slots[level][(timer->expires >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK];
+        timer->next = *head;
+        if (timer->next != nullptr) timer->next->pprev = &timer->next;
+        timer->pprev = head;
+        *head = timer;
+    }
+
+    static void unlink(timer_entry_t* timer) {
+        *timer->pprev = timer->next;
+        if (timer->next != nullptr) timer->next->pprev = timer->pprev;
+        timer->next = nullptr;
+        timer->pprev = nullptr;
+    }
+
+    // Moves a slot's list to a local head, so timers stay cancellable (and
+    // the slot reusable) while it's being emptied.
+    void take(timer_entry_t** head) {
+        moving = *head;
+        *head = nullptr;
+        if (moving != nullptr) moving->pprev = &moving;
+    }
+
+    void cascade(unsigned int level, unsigned int slot) {
+        take(&slots[level][slot]);
+        while (moving != nullptr) {
+            timer_entry_t* timer = moving;
+            unlink(timer);
+            insert(timer);
+        }
+    }
+
+    unsigned long long current;
+    size_t count;
+    timer_entry_t* moving; // the list being fired or cascaded
+    timer_entry_t* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+#endif
@@ -3,8 +3,21 @@
 #include "poller.h"
 #include "truck.h"
 
-std::mutex truck_data_access;
-truck_info_t truck_data;
+seqlock_t<truck_info_t> truck_data;
+std::atomic<unsigned int> truck_data_dirty(0);
+std::atomic<unsigned int> truck_data_wake(0);
+std::atomic<long long> truck_data_changed_at(0);
+
+#define TRUCK_FLOAT_CHANNEL(id, channel, policy, threshold) \
+    { SCS_TELEMETRY_TRUCK_CHANNEL_##channel, SCS_VALUE_TYPE_float, TRUCK_##id, TRUCK_FIELD_##id, policy, threshold },
+#define TRUCK_BOOL_CHANNEL(id, channel, policy) \
+    { SCS_TELEMETRY_TRUCK_CHANNEL_##channel, SCS_VALUE_TYPE_bool, TRUCK_##id, TRUCK_FIELD_##id, policy, 0.0f },
+
+const truck_channel_t truck_channels[] = {
+    TRUCK_CHANNELS(TRUCK_FLOAT_CHANNEL, TRUCK_BOOL_CHANNEL)
+};
+const size_t truck_channel_count = sizeof(truck_channels) / sizeof(truck_channel_t);
+truck_channel_stats_t truck_channel_stats[sizeof(truck_channels) / sizeof(truck_channel_t)];
 
 HRESULT InitTruckData() {
     if (concurrent_thread_running) {
@@ -12,10 +25,56 @@ HRESULT InitTruckData() {
         return RPC_E_TOO_LATE;
     }
 
-    memset(&truck_data, 0, sizeof(truck_data));
+    truck_info_t* data = truck_data.begin_write();
+    memset(data, 0, sizeof(truck_info_t));
 
     // Initially, the game is paused.
-    truck_data.paused = true;
+    data->paused = true;
+    truck_data.end_write();
+    truck_data_dirty = 0;
+    truck_data_changed_at = 0;
+    memset(truck_channel_stats, 0, sizeof(truck_channel_stats));
+
+    unsigned int wake = TRUCK_FIELD_PAUSED | TRUCK_FIELD_FUEL_MAX | TRUCK_FIELD_RPM_LIMIT;
+    for (size_t i = 0; i < truck_channel_count; i++) {
+        if (truck_channels[i].policy == TRUCK_UPDATE_WAKE) wake |= truck_channels[i].field;
+    }
+    truck_data_wake = wake;
 
     return S_OK;
-}
\ No newline at end of file
+}
+
+// Overrides the update policy of the channels behind `fields`, for LED modes
+// that need channels woken up on which are quiet otherwise.
+void WakeOnTruckData(unsigned int fields, bool wake) {
+    if (wake) truck_data_wake.fetch_or(fields);
+    else truck_data_wake.fetch_and(~fields);
+}
+
+// Flags fields as changed. This does not wake the poller by itself; channel
+// updates are batched until the frame end event calls SignalPoller().
+void MarkTruckDataDirty(unsigned int fields) {
+    if (truck_data_dirty.load(std::memory_order_relaxed) == 0) {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        truck_data_changed_at.store(now.QuadPart, std::memory_order_relaxed);
+    }
+    truck_data_dirty.fetch_or(fields, std::memory_order_release);
+}
+
+// Returns the fields changed since the last call and clears them. If asked,
+// also tells when the first of those changes happened (0 if none did).
+unsigned int TakeTruckDataDirty(long long* changed_at) {
+    unsigned int dirty = truck_data_dirty.exchange(0, std::memory_order_acquire);
+    if (changed_at) *changed_at = dirty ? truck_data_changed_at.load(std::memory_order_relaxed) : 0;
+    return dirty;
+}
+// Called once the game no longer delivers channel values.
+void LogTruckChannelStats() {
+    for (size_t i = 0; i < truck_channel_count; i++) {
+        const truck_channel_stats_t& stats = truck_channel_stats[i];
+        if (stats.received == 0) continue;
+        log("Channel %s: %llu values, %llu suppressed (%.1f%%).", truck_channels[i].name,
+            stats.received, stats.suppressed, 100.0 * stats.suppressed / stats.received);
+    }
+}
@@ -1,21 +1,100 @@
 #ifndef __TRUCK_H_INCLUDED__
 #define __TRUCK_H_INCLUDED__
-#include <mutex>
+#include <atomic>
+#include <stddef.h>
+#include "pch.h"
+#include "channels.h"
+#include "seqlock.h"
 
-extern std::mutex truck_data_access;
+// Ids of the channels in TRUCK_CHANNELS. Floats and booleans are numbered
+// separately, as each kind has its own array in truck_info_t.
+#define TRUCK_CHANNEL_ID(id, ...) TRUCK_##id,
+#define TRUCK_CHANNEL_SKIP(id, ...)
+enum truck_float_t {
+    TRUCK_CHANNELS(TRUCK_CHANNEL_ID, TRUCK_CHANNEL_SKIP)
+    TRUCK_FLOAT_COUNT
+};
+enum truck_flag_t {
+    TRUCK_CHANNELS(TRUCK_CHANNEL_SKIP, TRUCK_CHANNEL_ID)
+    TRUCK_FLAG_COUNT
+};
 
-// The game should keep updating this structure.
-// We may create a separate thread loop to poll this and, when
-// it detect changes, update the LEDs accordingly.
+// Bits telling which truck_info_t fields changed since the poller last
+// looked at them: one per channel, then the ones the plugin fills itself.
+#define TRUCK_FIELD_BIT(id, ...) TRUCK_FIELD_BIT_##id,
+enum {
+    TRUCK_CHANNELS(TRUCK_FIELD_BIT, TRUCK_FIELD_BIT)
+    TRUCK_FIELD_BIT_PAUSED,
+    TRUCK_FIELD_BIT_FUEL_MAX,
+    TRUCK_FIELD_BIT_RPM_LIMIT
+};
+#define TRUCK_FIELD_MASK(id, ...) TRUCK_FIELD_##id = 1u << TRUCK_FIELD_BIT_##id,
+enum : unsigned int {
+    TRUCK_CHANNELS(TRUCK_FIELD_MASK, TRUCK_FIELD_MASK)
+    TRUCK_FIELD_MASK(PAUSED)
+    TRUCK_FIELD_MASK(FUEL_MAX)
+    TRUCK_FIELD_MASK(RPM_LIMIT)
+};
+
+// The game keeps updating this structure from its own thread, while the
+// poller takes snapshots of it to update the LEDs accordingly. Channel
+// values are kept by kind, indexed by their id, so a snapshot stays a
+// small flat copy however many channels there are.
 struct truck_info_t {
     bool paused; // if the game is paused, in menu, etc
-    bool electricity;
     float fuel_max;
-    float fuel;
+    float rpm_limit;
+    unsigned int flags; // boolean channels, bit n is truck_flag_t n
+    float values[TRUCK_FLOAT_COUNT];
+
+    float get(truck_float_t id) const { return values[id]; }
+    bool is_set(truck_flag_t id) const { return (flags >> id) & 1; }
+};
+static_assert(TRUCK_FLAG_COUNT <= 32, "truck_info_t::flags can't hold every boolean channel");
+
+enum truck_update_t {
+    TRUCK_UPDATE_WAKE,
+    TRUCK_UPDATE_QUIET
+};
+
+// One per TRUCK_CHANNELS entry, and the context given to its SCS callback.
+struct truck_channel_t {
+    const char* name;
+    scs_value_type_t type;
+    unsigned int slot; // truck_float_t or truck_flag_t
+    unsigned int field; // dirty bit
+    truck_update_t policy;
+    float threshold;
+};
+
+extern const truck_channel_t truck_channels[];
+extern const size_t truck_channel_count;
+
+// Per channel, in truck_channels order: how many values the game delivered
+// and how many of them the deadband (or, for booleans, being unchanged) kept
+// from being stored. Only the game thread writes them.
+struct truck_channel_stats_t {
+    unsigned long long received;
+    unsigned long long suppressed;
 };
+extern truck_channel_stats_t truck_channel_stats[];
 
-extern truck_info_t truck_data;
+// Written by the SCS callbacks without ever blocking, and only by them: the
+// memory search hands fuel_max over to the game thread instead. Read it with
+// truck_data.read() to get a consistent copy.
+extern seqlock_t<truck_info_t> truck_data;
+extern std::atomic<unsigned int> truck_data_dirty;
+// Fields whose changes are flagged in truck_data_dirty (and so wake the
+// poller up). Starts from the channels' update policies.
+extern std::atomic<unsigned int> truck_data_wake;
+// QueryPerformanceCounter ticks of the first change the poller didn't take
+// yet, to measure how long it takes to reach the wheel.
+extern std::atomic<long long> truck_data_changed_at;
 
 HRESULT InitTruckData();
+void WakeOnTruckData(unsigned int fields, bool wake);
+void MarkTruckDataDirty(unsigned int fields);
+unsigned int TakeTruckDataDirty(long long* changed_at = nullptr);
+void LogTruckChannelStats();
 
 #endif
\ No newline at end of file
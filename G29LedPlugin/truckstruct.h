@@ -0,0 +1,189 @@
+#ifndef __TRUCKSTRUCT_H_INCLUDED__
+#define __TRUCKSTRUCT_H_INCLUDED__
+#include "structcheck.h"
+
+// Layouts of the game's (64-bit) structures holding the truck's actual fuel
+// tank capacity, and how to tell them apart from whatever else is in its
+// memory. Shared with the tools, hence fixed-size types all along.
+
+// Where the game's image is mapped. TODO: appropriately get the module
+// addresses to determine the module address space.
+#define ROMEM_MIN_ADDR 0x00007ff000000000ULL
+#define ROMEM_MAX_ADDR 0x00007fff00000000ULL
+
+struct ptrpair_t {
+    uint64_t romem;
+    uint64_t rwmem;
+};
+
+struct int_float_pair_t {
+    int32_t intfld;
+    float floatfld;
+};
+
+struct ptrp_lens_t {
+    ptrpair_t addrs;
+    uint64_t lens[2];
+};
+
+struct truck_info_with_capacity_t {
+    // searching memory, many more pointers are set to an additional
+    // romem-uint-zero structure (16 bytes total), thus prepending this to
+    // the structure increases the odds on finding the structure faster.
+    // This applies for all 3 occurrences of this structure in game memory
+    // (as 1.47.x), being:
+    // struct #1: 14 pointers to -16-byte; 01 pointer to 0-byte
+    // structs #2 and #3: 2 pointers to -16-byte; 01 pointer to 0-byte
+    // the "uint" part of the structure seems to change from 00 00 00 04 to
+    // 06 00 00 a4, at least in the few checks performed. The latter usually
+    // has rw-pointers after ro-pointers where the former has zero-pointers
+    // where those rw-pointers would go.
+    uint64_t prefield01_romem;
+    uint32_t prefield02_nznum;
+    uint32_t prefield03_znum;
+
+    ptrp_lens_t f01_04_addrs;
+    uint64_t f05_rwmem;
+    // 06: e.g 89 ce 00 00
+    // 07: 0.0-1.0; e.g. 0.50
+    // 08: e.g 1007
+    // 09: 0.0-1.0
+    // 10: e.g. 1990
+    // 11: e.g. 72.15
+    // 12: e.g. 2350
+    // 13: 0.0-1.0, e.g. 0.54
+    int_float_pair_t f06_f13_pairs[4];
+    ptrpair_t f14_15_addrs;
+    uint32_t f16_17_num[2]; // e.g. 16:16; 17:32
+    int_float_pair_t f18_19_nums; // e.g. 18:inintelligible; 19: 38.44
+    // resp "lens", 3, 6, 6, 6
+    ptrp_lens_t f20_35_data[4];
+    float f36_39_num[4]; // e.g.: -1.0, 0.01, -1.0, -1.0
+    uint64_t f40_data; // inintelligible (993454364 int at the time of writing)
+    float f41_num; // e.g. 7856.00 (don't know where this came from)
+    float f42_tank_cap; // e.g. 681.40 (our value!)
+    float f43_adblue_cap; // e.g. 80.0 (can get from telemetry to double-check)
+    float f44_num; // e.g. 0.0, 0.48, -25.95 (no idea)
+    uint32_t f45_46_num[2]; // inintelligible; both equal
+    uint32_t f47_num; // inintelligible (99
+    float f48_tank_fill; // e.g. 0.21 (21%) fuel
+    float f49_adbl_fill; // e.g. 0.23 (23%), usually higher than fuel fill unless both 100%
+    float f50_num; // e.g. 2.10 (10x tank_fill?)
+    float f51_num; // e.g. 0.75 -- no idea
+
+    // From this point on, the values are very unreliable between structures found
+    //float f52_num; // e.g. 0.12? -- no idea, and might be int, depending where the structure is found
+    //ptrp_lens_t f53_56_data; // e.g. 7
+    //int32_t f57_num; // inintelligible
+    //float f58_64num[7]; // resp: 0.08, -0.10, -5.0, 0.15, -0.10, 5.0, -10.0
+    //uint64_t f65_nulptr; // 0x00
+};
+static_assert(offsetof(truck_info_with_capacity_t, f42_tank_cap) == 0x114, "truck_info_with_capacity_t layout changed");
+static_assert(sizeof(truck_info_with_capacity_t) == 0x140, "truck_info_with_capacity_t layout changed");
+
+// A pointer pair: linked structures point to both kinds of memory, unlinked
+// ones only to read-only memory.
+#define CHECK_PTR_PAIR(layout, pair, stage, ...) \
+    CHECK_FIELD_RO(layout, pair.romem, stage, WHEN_ALWAYS, ##__VA_ARGS__), \
+    CHECK_FIELD_RW(layout, pair.rwmem, stage, WHEN_LINKED, ##__VA_ARGS__), \
+    CHECK_FIELD_RANGE(layout, pair.rwmem, stage, 0, 0, WHEN_UNLINKED, ##__VA_ARGS__)
+
+// A pointer pair and two lengths. When there's an address to read-write
+// memory, both lengths should be the same non-zero value. When it's null,
+// the first length must be zero, but the second one may be zero or a number.
+#define CHECK_PTR_LENS(layout, frame, stage, ...) \
+    CHECK_PTR_PAIR(layout, frame.addrs, stage, ##__VA_ARGS__), \
+    CHECK_FIELD_RANGE(layout, frame.lens[0], stage, 1, 10000, WHEN_LINKED, ##__VA_ARGS__), \
+    CHECK_FIELD_EQUAL(layout, frame.lens[1], frame.lens[0], stage, WHEN_LINKED, ##__VA_ARGS__), \
+    CHECK_FIELD_RANGE(layout, frame.lens[0], stage, 0, 0, WHEN_UNLINKED, ##__VA_ARGS__), \
+    CHECK_FIELD_RANGE(layout, frame.lens[1], stage, 0, 10000, WHEN_UNLINKED, ##__VA_ARGS__)
+
+#define TRUCK_STRUCT truck_info_with_capacity_t
+
+// Stages follow the order the checks were written in by hand: the target
+// value first, then the rest of the structure. From field 5 on, candidates
+// already matched a lot and should be correct, so failures are reported.
+constexpr struct_check_t truck_struct_checks[] = {
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f42_tank_cap, 0, 30.0, 5000.0),
+    CHECK_FIELD_PARAM(TRUCK_STRUCT, f43_adblue_cap, 1), // telemetry's AdBlue capacity
+    // Prefix: [ r/o mem addr : non-zero uint : zero uint ]
+    CHECK_FIELD_RO(TRUCK_STRUCT, prefield01_romem, 2),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, prefield02_nznum, 2, 1, 0xffffffff),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, prefield03_znum, 2, 0, 0),
+    CHECK_PTR_LENS(TRUCK_STRUCT, f01_04_addrs, 3),
+    CHECK_FIELD_RW(TRUCK_STRUCT, f05_rwmem, 4, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f06_f13_pairs[0].intfld, 5, 0, 100000, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f06_f13_pairs[0].floatfld, 5, 0.0, 1.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f06_f13_pairs[1].intfld, 5, 0, 10000, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f06_f13_pairs[1].floatfld, 5, 0.0, 10.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f06_f13_pairs[2].intfld, 5, 0, 20000, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f06_f13_pairs[2].floatfld, 5, 0.0, 10000.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f06_f13_pairs[3].intfld, 5, 0, 20000, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f06_f13_pairs[3].floatfld, 5, 0.0, 1.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_PTR_PAIR(TRUCK_STRUCT, f14_15_addrs, 6, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f16_17_num[0], 7, 0, 10000, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f16_17_num[1], 7, 0, 10000, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f18_19_nums.floatfld, 8, 0.0, 10000.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_PTR_LENS(TRUCK_STRUCT, f20_35_data[0], 9, CHECK_REPORT),
+    CHECK_PTR_LENS(TRUCK_STRUCT, f20_35_data[1], 9, CHECK_REPORT),
+    CHECK_PTR_LENS(TRUCK_STRUCT, f20_35_data[2], 9, CHECK_REPORT),
+    CHECK_PTR_LENS(TRUCK_STRUCT, f20_35_data[3], 9, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f36_39_num[0], 10, -1.0, 1.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f36_39_num[1], 10, -1.0, 1.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f36_39_num[2], 10, -1.0, 1.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f36_39_num[3], 10, -1.0, 1.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f41_num, 11, 0.0, 100000.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f48_tank_fill, 12, 0.0, 1.0, WHEN_ALWAYS, CHECK_REPORT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f49_adbl_fill, 13, 0.0, 1.0, WHEN_ALWAYS, CHECK_REPORT),
+    // Not very meaningful to check, and never verified well enough to
+    // reject structures on: only reported when a match doesn't pass them.
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f44_num, 14, -1000.0, 1000.0, WHEN_ALWAYS, CHECK_SOFT),
+    CHECK_FIELD_EQUAL(TRUCK_STRUCT, f45_46_num[1], f45_46_num[0], 14, WHEN_ALWAYS, CHECK_SOFT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f50_num, 14, 0.0, 1000.0, WHEN_ALWAYS, CHECK_SOFT),
+    CHECK_FIELD_RANGE(TRUCK_STRUCT, f51_num, 14, 0.0, 1.0, WHEN_ALWAYS, CHECK_SOFT)
+};
+
+typedef struct_validator_t<truck_struct_checks, sizeof(truck_struct_checks) / sizeof(truck_struct_checks[0]),
+    offsetof(truck_info_with_capacity_t, f01_04_addrs.addrs.rwmem)> truck_struct_validator_t;
+
+// There are many fewer pointers pointing to this structure, and only one copy of it
+// throughout game memory; and it doesn't have any other meaningful data other than
+// the tank capaticy itself, but this could prove useful when/if the other structures
+// become unreliable across binary changes or versions.
+struct tank_info_t {
+    uint64_t words[53];
+    float tank_cap;
+};
+
+#define TANK_WORD(word, check, stage, ...) \
+    check(tank_info_t, words[word], stage, ##__VA_ARGS__)
+
+constexpr struct_check_t tank_struct_checks[] = {
+    CHECK_FIELD_RANGE(tank_info_t, tank_cap, 0, 200.0, 5000.0),
+    // Words always zero.
+    TANK_WORD(9, CHECK_FIELD_RANGE, 1, 0, 0), TANK_WORD(10, CHECK_FIELD_RANGE, 1, 0, 0),
+    TANK_WORD(11, CHECK_FIELD_RANGE, 1, 0, 0), TANK_WORD(19, CHECK_FIELD_RANGE, 1, 0, 0),
+    TANK_WORD(20, CHECK_FIELD_RANGE, 1, 0, 0), TANK_WORD(21, CHECK_FIELD_RANGE, 1, 0, 0),
+    TANK_WORD(27, CHECK_FIELD_RANGE, 1, 0, 0), TANK_WORD(28, CHECK_FIELD_RANGE, 1, 0, 0),
+    TANK_WORD(29, CHECK_FIELD_RANGE, 1, 0, 0), TANK_WORD(31, CHECK_FIELD_RANGE, 1, 0, 0),
+    TANK_WORD(32, CHECK_FIELD_RANGE, 1, 0, 0), TANK_WORD(33, CHECK_FIELD_RANGE, 1, 0, 0),
+    TANK_WORD(40, CHECK_FIELD_RANGE, 1, 0, 0), TANK_WORD(43, CHECK_FIELD_RANGE, 1, 0, 0),
+    TANK_WORD(46, CHECK_FIELD_RANGE, 1, 0, 0), TANK_WORD(52, CHECK_FIELD_RANGE, 1, 0, 0),
+    // Pointers to read-write memory. Words 3 and 6 proved to be unreliable.
+    TANK_WORD(15, CHECK_FIELD_RW, 2), TANK_WORD(23, CHECK_FIELD_RW, 2),
+    TANK_WORD(36, CHECK_FIELD_RW, 2), TANK_WORD(48, CHECK_FIELD_RW, 2),
+    // Pointers to read-only memory.
+    TANK_WORD(0, CHECK_FIELD_RO, 3), TANK_WORD(2, CHECK_FIELD_RO, 3), TANK_WORD(5, CHECK_FIELD_RO, 3),
+    TANK_WORD(8, CHECK_FIELD_RO, 3), TANK_WORD(14, CHECK_FIELD_RO, 3), TANK_WORD(18, CHECK_FIELD_RO, 3),
+    TANK_WORD(22, CHECK_FIELD_RO, 3), TANK_WORD(26, CHECK_FIELD_RO, 3), TANK_WORD(30, CHECK_FIELD_RO, 3),
+    TANK_WORD(35, CHECK_FIELD_RO, 3), TANK_WORD(38, CHECK_FIELD_RO, 3), TANK_WORD(39, CHECK_FIELD_RO, 3),
+    TANK_WORD(41, CHECK_FIELD_RO, 3), TANK_WORD(42, CHECK_FIELD_RO, 3), TANK_WORD(44, CHECK_FIELD_RO, 3),
+    TANK_WORD(45, CHECK_FIELD_RO, 3), TANK_WORD(47, CHECK_FIELD_RO, 3)
+};
+
+// The tank structure has no unlinked flavour: word 15 always points to
+// read-write memory.
+typedef struct_validator_t<tank_struct_checks, sizeof(tank_struct_checks) / sizeof(tank_struct_checks[0]),
+    offsetof(tank_info_t, words[15])> tank_struct_validator_t;
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef __WHEELS_H_INCLUDED__
+#define __WHEELS_H_INCLUDED__
+#include "hidreport.h"
+
+// The wheels we know, how to tell them among the system's HID devices and
+// how to drive their LEDs. Shared by the plugin and the CLI, so it doesn't
+// depend on the plugin's precompiled header.
+
+struct hid_device_id_t {
+    unsigned short vendor_id;
+    unsigned short product_id;
+    int interface_number; // -1 matches any interface, or none was given
+};
+
+#define LOGITECH_VID 0x046d
+
+enum wheel_led_encoding_t {
+    WHEEL_LEDS_NONE, // recognized, but we can't drive its LEDs
+    WHEEL_LEDS_LOGITECH_EXT // extended command: f8 12 <mask> 00 00 00 01
+};
+
+struct wheel_model_t {
+    const char* name;
+    unsigned short vendor_id;
+    unsigned short product_id;
+    int interface_number; // taking the LED reports; -1 on single interface devices
+    wheel_led_encoding_t led_encoding;
+    unsigned char led_count; // bits of the G29_LED_* masks it shows
+};
+
+// The G920 and the G923 in Xbox mode only take LED commands through
+// Logitech's HID++ protocol, which we don't speak: they're recognized so the
+// log can tell why they're left alone.
+static const wheel_model_t WHEEL_MODELS[] = {
+    { "Logitech G27", LOGITECH_VID, 0xc29b, -1, WHEEL_LEDS_LOGITECH_EXT, 5 },
+    { "Logitech G29", LOGITECH_VID, 0xc24f, 0, WHEEL_LEDS_LOGITECH_EXT, 5 },
+    { "Logitech G920", LOGITECH_VID, 0xc262, 0, WHEEL_LEDS_NONE, 5 },
+    { "Logitech G923 (PlayStation)", LOGITECH_VID, 0xc266, 0, WHEEL_LEDS_LOGITECH_EXT, 5 },
+    { "Logitech G923 (Xbox)", LOGITECH_VID, 0xc26e, 0, WHEEL_LEDS_NONE, 5 }
+};
+
+#define WHEEL_MODEL_COUNT (sizeof(WHEEL_MODELS) / sizeof(WHEEL_MODELS[0]))
+#define WHEEL_INDEX_BITS 4 // the index keeps at least half of its slots free
+
+// Open addressing hash of the models by vendor and product id, so every
+// device enumerated costs one probe or two whatever the table's length.
+class wheel_index_t {
+public:
+    wheel_index_t() {
+        for (unsigned int i = 0; i < (1u << WHEEL_INDEX_BITS); i++) slots[i] = -1;
+        for (unsigned int model = 0; model < WHEEL_MODEL_COUNT; model++) {
+            unsigned int slot = slotOf(WHEEL_MODELS[model].vendor_id, WHEEL_MODELS[model].product_id);
+            while (slots[slot] >= 0) slot = (slot + 1) & ((1u << WHEEL_INDEX_BITS) - 1);
+            slots[slot] = (signed char)model;
+        }
+    }
+
+    const wheel_model_t* find(unsigned short vendor_id, unsigned short product_id) const {
+        unsigned int slot = slotOf(vendor_id, product_id);
+        for (; slots[slot] >= 0; slot = (slot + 1) & ((1u << WHEEL_INDEX_BITS) - 1)) {
+            const wheel_model_t& model = WHEEL_MODELS[slots[slot]];
+            if (model.vendor_id == vendor_id && model.product_id == product_id) return &model;
+        }
+        return nullptr;
+    }
+
+private:
+    static_assert(WHEEL_MODEL_COUNT * 2 <= (1u << WHEEL_INDEX_BITS), "grow WHEEL_INDEX_BITS");
+
+    static unsigned int slotOf(unsigned short vendor_id, unsigned short product_id) {
+        return (((unsigned int)vendor_id << 16 | product_id) * 0x9e3779b1u) >> (32 - WHEEL_INDEX_BITS);
+    }
+
+    signed char slots[1u << WHEEL_INDEX_BITS];
+};
+
+// The model of a device found, if we know it and it's the interface taking
+// LED reports. Safe to call from any thread.
+inline const wheel_model_t* FindWheel(const hid_device_id_t& found) {
+    static const wheel_index_t index;
+    const wheel_model_t* model = index.find(found.vendor_id, found.product_id);
+
+    if (model == nullptr) return nullptr;
+    if (model->interface_number >= 0 && found.interface_number != model->interface_number) return nullptr;
+    return model;
+}
+
+template <typename Char>
+inline int parseHexField(const Char* text, int digits) {
+    int value = 0;
+    for (int i = 0; i < digits; i++) {
+        Char c = text[i];
+        if (c >= '0' && c <= '9') value = value * 16 + (c - '0');
+        else if (c >= 'a' && c <= 'f') value = value * 16 + (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') value = value * 16 + (c - 'A' + 10);
+        else return -1;
+    }
+    return value;
+}
+
+// Case insensitive, `key` being upper case.
+template <typename Char>
+inline bool startsWithKey(const Char* text, const char* key) {
+    for (; *key != '\0'; text++, key++) {
+        Char c = *text >= 'a' && *text <= 'z' ? *text - 'a' + 'A' : *text;
+        if (c != *key) return false;
+    }
+    return true;
+}
+
+// Reads the ids out of Windows hardware IDs ("HID\VID_046D&PID_C24F&REV_...
+// &MI_00") and device interface paths ("\\?\hid#vid_046d&pid_c24f&mi_00#..."),
+// whatever the case, in a single pass. The interface number is -1 if there's
+// none. Returns false without a vendor and a product id.
+template <typename Char>
+inline bool ParseHardwareId(const Char* name, hid_device_id_t* id) {
+    int vendor = -1, product = -1, mi = -1;
+
+    for (const Char* field = name; *field != '\0'; field++) {
+        if (*field == '#' && vendor >= 0) break; // past the device part of a path
+        // Fields start the name or follow a separator.
+        if (field != name && field[-1] != '\\' && field[-1] != '&' && field[-1] != '#') continue;
+        if (startsWithKey(field, "VID_")) vendor = parseHexField(field + 4, 4);
+        else if (startsWithKey(field, "PID_")) product = parseHexField(field + 4, 4);
+        else if (startsWithKey(field, "MI_")) mi = parseHexField(field + 3, 2);
+    }
+    if (vendor < 0 || product < 0) return false;
+
+    id->vendor_id = (unsigned short)vendor;
+    id->product_id = (unsigned short)product;
+    id->interface_number = mi;
+    return true;
+}
+
+// The LED command for the wheel, LEDs it doesn't have left out.
+inline hid_command_t EncodeWheelLEDs(const wheel_model_t& model, unsigned char led_mask) {
+    led_mask &= (unsigned char)((1u << model.led_count) - 1);
+    switch (model.led_encoding) {
+    case WHEEL_LEDS_LOGITECH_EXT:
+    default:
+        return EncodeLEDs(led_mask);
+    }
+}
+
+#endif
@@ -0,0 +1,228 @@
+// G29LedReplay: feeds a telemetry recording made with G29LEDPLUGIN_RECORD
+// back into the plugin DLL, driving a mock wheel instead of the real one.
+//
+// Usage: G29LedReplay <recording> [--plugin path\G29LedPlugin.dll] [--speed N | --fast]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "pch.h"
+#include "telemetry_record.h"
+
+#define UNUSED(x)
+
+typedef SCSAPI_RESULT(*scs_telemetry_init_t)(const scs_u32_t version, const scs_telemetry_init_params_t* const params);
+typedef SCSAPI_VOID(*scs_telemetry_shutdown_t)();
+
+struct replay_event_t {
+    scs_telemetry_event_callback_t callback;
+    scs_context_t context;
+};
+
+struct replay_channel_t {
+    std::string name;
+    scs_u32_t index;
+    scs_value_type_t type;
+    scs_telemetry_channel_callback_t callback;
+    scs_context_t context;
+};
+
+static replay_event_t events[SCS_TELEMETRY_EVENT_gameplay + 1];
+static std::vector<replay_channel_t> channels;
+
+static SCSAPI_RESULT replay_register_for_event(const scs_event_t event, const scs_telemetry_event_callback_t callback, const scs_context_t context) {
+    if (event >= sizeof(events) / sizeof(events[0])) return SCS_RESULT_unsupported;
+    if (events[event].callback) return SCS_RESULT_already_registered;
+    events[event].callback = callback;
+    events[event].context = context;
+    return SCS_RESULT_ok;
+}
+
+static SCSAPI_RESULT replay_unregister_from_event(const scs_event_t event) {
+    if (event >= sizeof(events) / sizeof(events[0]) || !events[event].callback) return SCS_RESULT_not_found;
+    events[event].callback = nullptr;
+    return SCS_RESULT_ok;
+}
+
+static SCSAPI_RESULT replay_register_for_channel(const scs_string_t name, const scs_u32_t index, const scs_value_type_t type, const scs_u32_t UNUSED(flags), const scs_telemetry_channel_callback_t callback, const scs_context_t context) {
+    for (const replay_channel_t& channel : channels) {
+        if (channel.name == name && channel.index == index && channel.type == type) return SCS_RESULT_already_registered;
+    }
+    channels.push_back({ name, index, type, callback, context });
+    return SCS_RESULT_ok;
+}
+
+static SCSAPI_RESULT replay_unregister_from_channel(const scs_string_t name, const scs_u32_t index, const scs_value_type_t type) {
+    for (auto it = channels.begin(); it != channels.end(); ++it) {
+        if (it->name == name && it->index == index && it->type == type) {
+            channels.erase(it);
+            return SCS_RESULT_ok;
+        }
+    }
+    return SCS_RESULT_not_found;
+}
+
+static SCSAPI_VOID replay_log(const scs_log_type_t type, const scs_string_t message) {
+    static const char* prefix[] = { "", "[warn] ", "[error] " };
+    printf("%s%s\n", type >= 0 && type <= 2 ? prefix[type] : "", message);
+}
+
+static void dispatchEvent(scs_event_t event, const void* info) {
+    if (event < sizeof(events) / sizeof(events[0]) && events[event].callback) {
+        events[event].callback(event, info, events[event].context);
+    }
+}
+
+static bool dispatchChannel(const telemetry_record_t& record) {
+    for (const replay_channel_t& channel : channels) {
+        if (channel.index == record.index && channel.type == record.value.type && channel.name == record.name) {
+            channel.callback(record.name, record.index, &record.value, channel.context);
+            return true;
+        }
+    }
+    return false;
+}
+
+static double fileTimeSeconds(const FILETIME& time) {
+    ULARGE_INTEGER value;
+    value.LowPart = time.dwLowDateTime;
+    value.HighPart = time.dwHighDateTime;
+    return value.QuadPart / 1e7;
+}
+
+static void usage() {
+    printf("Usage: G29LedReplay <recording> [--plugin <dll>] [--speed <factor> | --fast]\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* recording = nullptr;
+    const char* plugin = "G29LedPlugin.dll";
+    double speed = 1.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--plugin") == 0 && i + 1 < argc) {
+            plugin = argv[++i];
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+            if (speed <= 0) {
+                usage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--fast") == 0) {
+            speed = 0;
+        } else if (!recording && argv[i][0] != '-') {
+            recording = argv[i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (!recording) {
+        usage();
+        return 1;
+    }
+
+    telemetry_replay_t replay;
+    telemetry_record_t record;
+    HRESULT hr = replay.open(recording);
+    if (hr != S_OK) {
+        printf("Unable to open recording %s (0x%08lx)\n", recording, (unsigned long)hr);
+        return 1;
+    }
+
+    // The first record describes the game the session was recorded in.
+    hr = replay.next(&record);
+    if (hr != S_OK || record.kind != TELEMETRY_RECORD_session) {
+        printf("%s does not start with a session record\n", recording);
+        return 1;
+    }
+    std::string game_id = record.game_id;
+    scs_u32_t game_version = record.game_version;
+
+    // The plugin must never see the real wheel (or record the replay).
+    SetEnvironmentVariableA("G29LEDPLUGIN_DEVICE", "mock");
+    SetEnvironmentVariableA("G29LEDPLUGIN_RECORD", nullptr);
+
+    HMODULE module = LoadLibraryA(plugin);
+    if (!module) {
+        printf("Unable to load plugin %s (error %lu)\n", plugin, GetLastError());
+        return 1;
+    }
+    scs_telemetry_init_t init = (scs_telemetry_init_t)GetProcAddress(module, "scs_telemetry_init");
+    scs_telemetry_shutdown_t shutdown = (scs_telemetry_shutdown_t)GetProcAddress(module, "scs_telemetry_shutdown");
+    if (!init || !shutdown) {
+        printf("%s does not export the telemetry API\n", plugin);
+        FreeLibrary(module);
+        return 1;
+    }
+
+    scs_telemetry_init_params_v101_t params;
+    memset(&params, 0, sizeof(params));
+    params.common.game_name = game_id.c_str();
+    params.common.game_id = game_id.c_str();
+    params.common.game_version = game_version;
+    params.common.log = replay_log;
+    params.register_for_event = replay_register_for_event;
+    params.unregister_from_event = replay_unregister_from_event;
+    params.register_for_channel = replay_register_for_channel;
+    params.unregister_from_channel = replay_unregister_from_channel;
+
+    if (init(SCS_TELEMETRY_VERSION_1_01, &params) != SCS_RESULT_ok) {
+        printf("Plugin initialization failed\n");
+        FreeLibrary(module);
+        return 1;
+    }
+
+    LARGE_INTEGER freq, start, now;
+    unsigned long long frames = 0, values = 0, unmatched = 0;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+
+    while ((hr = replay.next(&record)) == S_OK) {
+        if (speed > 0) {
+            // Sleep is coarse; wait the bulk of the gap and spin the rest.
+            unsigned long long due_us = (unsigned long long)(record.time_us / speed);
+            for (;;) {
+                QueryPerformanceCounter(&now);
+                unsigned long long elapsed_us = (now.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart;
+                if (elapsed_us >= due_us) break;
+                if (due_us - elapsed_us > 2000) Sleep((DWORD)((due_us - elapsed_us) / 1000 - 1));
+            }
+        }
+
+        switch (record.kind) {
+        case TELEMETRY_RECORD_event:
+            if (record.event == SCS_TELEMETRY_EVENT_frame_end) frames++;
+            dispatchEvent(record.event, nullptr);
+            break;
+        case TELEMETRY_RECORD_configuration:
+            dispatchEvent(record.event, &record.configuration);
+            break;
+        case TELEMETRY_RECORD_channel:
+            values++;
+            if (!dispatchChannel(record)) unmatched++;
+            break;
+        default:
+            break;
+        }
+    }
+    QueryPerformanceCounter(&now);
+
+    shutdown();
+    FreeLibrary(module);
+
+    if (FAILED(hr)) printf("Recording is truncated or corrupt (0x%08lx)\n", (unsigned long)hr);
+
+    FILETIME created, exited, kernel, user;
+    double wall = (double)(now.QuadPart - start.QuadPart) / freq.QuadPart;
+    printf("Replayed %llu frames, %llu channel values (%llu not registered by the plugin)\n", frames, values, unmatched);
+    if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+        printf("Wall time %.3f s, CPU time %.3f s user + %.3f s kernel\n", wall, fileTimeSeconds(user), fileTimeSeconds(kernel));
+    } else {
+        printf("Wall time %.3f s\n", wall);
+    }
+    return FAILED(hr) ? 1 : 0;
+}